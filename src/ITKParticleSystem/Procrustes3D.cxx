@@ -16,30 +16,37 @@
 #include "Procrustes3D.h"
 #include <vnl/algo/vnl_svd.h>
 
+#ifdef SW_USE_OPENMP
+#include <omp.h>
+#endif /* SW_USE_OPENMP */
+
 void
 Procrustes3D::
 AlignShapes(SimilarityTransformListType & transforms, ShapeListType & shapes)
 {
   const RealType SOS_EPSILON = 1.0e-8;
+  const int numShapes = static_cast<int>(shapes.size());
   
   PointType center;
-  ShapeListIteratorType shapeListIt;
-  SimilarityTransformListIteratorType transformIt;
   ShapeIteratorType shapeIt;
 
-  ShapeType mean;
+  ShapeType sum;
 
-  SimilarityTransform3D transform;
-  transform.rotation.set_identity();
-  transform.scale = 1.0;
-
-  transforms.clear();
-  transforms.reserve(shapes.size());
+  // Start from the given rotations and scales if there is one per shape,
+  // otherwise from identity.
+  if (transforms.size() != shapes.size())
+  {
+    SimilarityTransform3D transform;
+    transform.rotation.set_identity();
+    transform.scale = 1.0;
+    transform.translation.fill(0.0);
+    transforms.assign(shapes.size(), transform);
+  }
 
-  // Remove translation
-  for(shapeListIt = shapes.begin(); shapeListIt != shapes.end(); shapeListIt++)
+  // Remove translation, then apply the starting rotation and scale
+  for(int i = 0; i < numShapes; i++)
   {
-    ShapeType & shape = (*shapeListIt);
+    ShapeType & shape = shapes[i];
     center.fill(0.0);
 
     for(shapeIt = shape.begin(); shapeIt != shape.end(); shapeIt++)
@@ -47,56 +54,55 @@ AlignShapes(SimilarityTransformListType & transforms, ShapeListType & shapes)
 
     center /= static_cast<RealType>(shape.size());
 
-    transform.translation = -center;
+    SimilarityTransform3D start = transforms[i];
+    start.translation = -center;
+    transforms[i].translation = -center;
 
-    // First time through transforms we need to push_back
-    transforms.push_back(transform);
-
-    // Apply translation to shape
-    for(shapeIt = shape.begin(); shapeIt != shape.end(); shapeIt++)
-      (*shapeIt) += center;
+    TransformShape(shape, start);
   }
 
+  // The leave-one-out mean is undefined for a single shape.
+  if (numShapes < 2) return;
+
   // Remove rotation and scale iteratively
   RealType sumOfSquares = ComputeSumOfSquares(shapes);
   RealType newSumOfSquares, diff = 1e10;
 
   while(diff > SOS_EPSILON)
   {
-    shapeListIt = shapes.begin();
-    transformIt = transforms.begin();
-    LeaveOneOutMean(mean, shapes, shapeListIt);
-    while(shapeListIt != shapes.end())
-    {
+    // Each shape is aligned to the mean of the others as they were at the
+    // start of the sweep, so the fits are independent of each other.
+    ComputeSum(sum, shapes);
 
-      AlignTwoShapes((*transformIt), mean, (*shapeListIt));
+#pragma omp parallel
+    {
+    ShapeType mean;
 
-      shapeListIt++;
-      transformIt++;
+#pragma omp for schedule(dynamic, 1)
+    for(int i = 0; i < numShapes; i++)
+    {
+      LeaveOneOutMean(mean, sum, shapes[i], numShapes);
+      AlignTwoShapes(transforms[i], mean, shapes[i]);
+    }
     }
 
     // Fix scalings so geometric average = 1
     RealType scaleAve = 0.0;
-    for(transformIt = transforms.begin(); transformIt != transforms.end();
-        transformIt++)
-      scaleAve += log((*transformIt).scale);
+    for(int i = 0; i < numShapes; i++)
+      scaleAve += log(transforms[i].scale);
 
-    scaleAve = exp(scaleAve / static_cast<RealType>(transforms.size()));
+    scaleAve = exp(scaleAve / static_cast<RealType>(numShapes));
 
     SimilarityTransform3D scaleSim;
     scaleSim.rotation.set_identity();
     scaleSim.translation.fill(0.0);
     scaleSim.scale = 1.0 / scaleAve;
 
-    shapeListIt = shapes.begin();
-    transformIt = transforms.begin();
-    while(shapeListIt != shapes.end())
+#pragma omp parallel for
+    for(int i = 0; i < numShapes; i++)
     {
-      TransformShape((*shapeListIt), scaleSim);
-      (*transformIt).scale /= scaleAve;
-
-      shapeListIt++;
-      transformIt++;
+      TransformShape(shapes[i], scaleSim);
+      transforms[i].scale /= scaleAve;
     }
 
     newSumOfSquares = ComputeSumOfSquares(shapes);
@@ -145,29 +151,32 @@ Procrustes3D::RealType
 Procrustes3D::
 ComputeSumOfSquares(ShapeListType & shapes)
 {
-  ShapeListIteratorType shapeIt1, shapeIt2;
-  ShapeIteratorType pointIt1, pointIt2;
-  
-  RealType sum = 0.0;
+  // The sum of squared distances over all pairs of shapes, computed in
+  // linear time as 2 n times the squared distances to the mean shape:
+  // sum_ij |x_i - x_j|^2 = 2 n sum_i |x_i - m|^2.
+  ShapeListIteratorType shapeListIt;
+  ShapeIteratorType shapeIt, meanIt;
 
-  for(shapeIt1 = shapes.begin(); shapeIt1 != shapes.end(); shapeIt1++)
+  const RealType n = static_cast<RealType>(shapes.size());
+  ShapeType mean;
+  ComputeSum(mean, shapes);
+  for(meanIt = mean.begin(); meanIt != mean.end(); meanIt++)
+    (*meanIt) /= n;
+
+  RealType sum = 0.0;
+  for(shapeListIt = shapes.begin(); shapeListIt != shapes.end(); shapeListIt++)
     {
-    for(shapeIt2 = shapes.begin(); shapeIt2 != shapes.end(); shapeIt2++)
+    ShapeType & shape = (*shapeListIt);
+    shapeIt = shape.begin();
+    meanIt = mean.begin();
+    while(shapeIt != shape.end() && meanIt != mean.end())
       {
-      ShapeType & shape1 = (*shapeIt1);
-      ShapeType & shape2 = (*shapeIt2);
-      
-      pointIt1 = shape1.begin();
-      pointIt2 = shape2.begin();
-      while(pointIt1 != shape1.end() && pointIt2 != shape2.end())
-        {
-        sum += ((*pointIt1) - (*pointIt2)).squared_magnitude();
-        pointIt1++;
-        pointIt2++;
-        }
+      sum += ((*shapeIt) - (*meanIt)).squared_magnitude();
+      shapeIt++;
+      meanIt++;
       }
     }
-  return sum / static_cast<RealType>(shapes.size() * shapes[0].size());
+  return 2.0 * n * sum / static_cast<RealType>(shapes.size() * shapes[0].size());
 }
 
 void
@@ -239,37 +248,37 @@ AlignTwoShapes(SimilarityTransform3D & transform, ShapeType & shape1,
 
 void
 Procrustes3D::
-LeaveOneOutMean(ShapeType & mean, ShapeListType & shapeList,
-                ShapeListIteratorType & leaveOutIt)
+ComputeSum(ShapeType & sum, ShapeListType & shapeList)
 {
   ShapeListIteratorType shapeListIt;
-  ShapeIteratorType shapeIt, meanIt;
-
-  int i, numPoints = shapeList[0].size();
+  ShapeIteratorType shapeIt, sumIt;
 
-  mean.clear();
-  mean.reserve(numPoints);
-  for(i = 0; i < numPoints; i++)
-    mean.push_back(vnl_vector_fixed<RealType, 3>(0.0, 0.0, 0.0));
+  sum.assign(shapeList[0].size(), PointType(0.0, 0.0, 0.0));
 
   for(shapeListIt = shapeList.begin(); shapeListIt != shapeList.end();
       shapeListIt++)
   {
-    //    if(shapeListIt != leaveOutIt)
+    ShapeType & shape = (*shapeListIt);
+    shapeIt = shape.begin();
+    sumIt = sum.begin();
+    while(shapeIt != shape.end() && sumIt != sum.end())
     {
-      ShapeType & shape = (*shapeListIt);
-      shapeIt = shape.begin();
-      meanIt = mean.begin();
-      while(shapeIt != shape.end())
-      {
-        (*meanIt) += (*shapeIt);
+      (*sumIt) += (*shapeIt);
 
-        shapeIt++;
-        meanIt++;
-      }
+      shapeIt++;
+      sumIt++;
     }
   }
+}
 
-  for(meanIt = mean.begin(); meanIt != mean.end(); meanIt++)
-    (*meanIt) /= static_cast<RealType>(shapeList.size() - 1);
+void
+Procrustes3D::
+LeaveOneOutMean(ShapeType & mean, const ShapeType & sum,
+                const ShapeType & leaveOut, int numShapes)
+{
+  const RealType norm = 1.0 / static_cast<RealType>(numShapes - 1);
+
+  mean.resize(sum.size());
+  for(unsigned int i = 0; i < sum.size(); i++)
+    mean[i] = (sum[i] - leaveOut[i]) * norm;
 }
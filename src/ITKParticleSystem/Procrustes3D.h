@@ -43,7 +43,11 @@ public:
 
   Procrustes3D() {}
 
-  // Align a list of shapes using Generalized Procrustes Analysis
+  // Align a list of shapes using Generalized Procrustes Analysis.  If
+  // transforms holds one transform per shape, their rotations and scales are
+  // the starting point (e.g. the result of the previous alignment), otherwise
+  // the alignment starts from identity.  The per-shape fits of each sweep run
+  // in parallel.
   void AlignShapes(SimilarityTransformListType & transforms,
                    ShapeListType & shapes);
 
@@ -55,6 +59,8 @@ public:
   static void TransformShapes(ShapeListType & shapes,
                               SimilarityTransformListType & transforms);
 
+  // Sum of squared distances over all pairs of shapes, normalized by the
+  // number of shapes and points.  Linear in the number of shapes.
   static RealType ComputeSumOfSquares(ShapeListType & shapes);
 
 private:
@@ -62,9 +68,12 @@ private:
   void AlignTwoShapes(SimilarityTransform3D & transform,
                       ShapeType & shape1, ShapeType & shape2);
 
-  // Compute mean of all shapes except the one at leaveOutIt
-  void LeaveOneOutMean(ShapeType & mean, ShapeListType & shapeList,
-                       ShapeListIteratorType & leaveOutIt);
+  // Compute the point-wise sum of all shapes
+  static void ComputeSum(ShapeType & sum, ShapeListType & shapeList);
+
+  // Compute mean of all shapes except leaveOut from their sum
+  static void LeaveOneOutMean(ShapeType & mean, const ShapeType & sum,
+                              const ShapeType & leaveOut, int numShapes);
 
   //  const RealType SOS_EPSILON = 1.0e-8;
 };
@@ -42,6 +42,10 @@ MaximumEntropyCorrespondenceSampler<TImage>::MaximumEntropyCorrespondenceSampler
   Superclass::m_ParticleSystem->RegisterAttribute(m_LinearRegressionShapeMatrix);
   Superclass::m_ParticleSystem->RegisterAttribute(m_MixedEffectsShapeMatrix);
   Superclass::m_ParticleSystem->RegisterAttribute(m_FunctionShapeData);
+
+  // The shape matrices and ensemble functions read every transformed
+  // position on every update, so keep them in world space.
+  Superclass::m_ParticleSystem->SetWorldPositionsOn();
   m_CorrespondenceMode = 0;
 }
 
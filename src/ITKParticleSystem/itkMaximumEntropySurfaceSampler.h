@@ -248,6 +248,36 @@ public:
   void SetPrefixTransformFile(const char *s)
   { m_PrefixTransformFile = std::string(s); }
   
+  /** Upper bound, in megabytes, on the scratch memory used while domains are
+      constructed in parallel.  Each domain computes gradient, Hessian and
+      curvature images from its distance transform, so the number of domains
+      built at once is limited to fit this budget.  0 (the default) means no
+      limit other than the number of threads. */
+  itkSetMacro(DomainConstructionMemoryLimit, double);
+  itkGetMacro(DomainConstructionMemoryLimit, double);
+
+  /** Directory in which the domains cache the gradient and curvature images
+      they derive from the inputs, so that reruns on the same inputs start
+      quickly.  Empty (the default) disables the cache. */
+  void SetDomainFieldCacheDirectory(const std::string &s)
+  { m_DomainFieldCacheDirectory = s; }
+  const std::string &GetDomainFieldCacheDirectory() const
+  { return m_DomainFieldCacheDirectory; }
+
+  /** Skin of the Verlet neighbor lists kept by the neighborhoods, in the
+      units of the inputs' physical space; see ParticleRegionNeighborhood.
+      0 (the default) disables the lists. */
+  void SetVerletSkin(double s)
+  {
+    m_VerletSkin = s;
+    for (unsigned int i = 0; i < m_NeighborhoodList.size(); i++)
+      {
+      m_NeighborhoodList[i]->SetVerletSkin(s);
+      }
+  }
+  double GetVerletSkin() const
+  { return m_VerletSkin; }
+
   void ReadTransforms();
   void ReadPointsFiles();
   virtual void AllocateDataCaches();
@@ -281,6 +311,9 @@ protected:
   bool m_Initialized;
   int m_AdaptivityMode;
   bool m_Initializing;
+  double m_DomainConstructionMemoryLimit;
+  std::string m_DomainFieldCacheDirectory;
+  double m_VerletSkin;
 
   std::vector<typename TImage::Pointer> m_WorkingImages;
   
@@ -18,6 +18,11 @@
 #include "itkParticlePositionReader.h"
 #include "itkImageRegionIterator.h"
 #include "object_reader.h"
+#include <algorithm>
+
+#ifdef SW_USE_OPENMP
+#include <omp.h>
+#endif /* SW_USE_OPENMP */
 
 namespace itk
 {
@@ -27,6 +32,8 @@ MaximumEntropySurfaceSampler<TImage>::MaximumEntropySurfaceSampler()
 {
   m_AdaptivityMode = 0;
   m_Initializing = false;
+  m_DomainConstructionMemoryLimit = 0.0;
+  m_VerletSkin = 0.0;
 
 
   m_PrefixTransformFile = "";
@@ -94,17 +101,67 @@ MaximumEntropySurfaceSampler<TImage>::AllocateDomainsAndNeighborhoods()
   // Allocate all the necessary domains and neighborhoods. This must be done
   // *after* registering the attributes to the particle system since some of
   // them respond to AddDomain.
-  for (unsigned int i = 0; i < this->GetNumberOfInputs(); i++)
+  const unsigned int num_inputs = this->GetNumberOfInputs();
+  for (unsigned int i = 0; i < num_inputs; i++)
     { 
     m_DomainList.push_back( ParticleImplicitSurfaceDomain<typename
                             ImageType::PixelType, Dimension>::New() );
     //    m_NeighborhoodList.push_back(ParticleRegionNeighborhood<Dimension>::New());
     m_NeighborhoodList.push_back( ParticleSurfaceNeighborhood<ImageType>::New() );
+    m_NeighborhoodList.back()->SetVerletSkin(m_VerletSkin);
+    }
 
-    m_DomainList[i]->SetSigma(m_WorkingImages[i]->GetSpacing()[0] * 2.0);
-    
-    m_DomainList[i]->SetImage(m_WorkingImages[i]);
+  // Setting the image is by far the most expensive step: it computes the
+  // gradient, smoothed Hessian and mean curvature images of each input.
+  // Domains are independent of one another, so they are built concurrently,
+  // as many at a time as the memory limit allows.
+  int num_threads = 1;
+#ifdef SW_USE_OPENMP
+  num_threads = omp_get_max_threads();
+  if (m_DomainConstructionMemoryLimit > 0.0 && num_inputs > 0)
+    {
+    // Rough peak per domain: the distance transform plus the gradient,
+    // Hessian, curvature and filter scratch images, about 16 images of the
+    // input pixel type.
+    const double voxels = static_cast<double>
+      (m_WorkingImages[0]->GetLargestPossibleRegion().GetNumberOfPixels());
+    const double mb_per_domain
+      = voxels * sizeof(typename ImageType::PixelType) * 16.0 / (1024.0 * 1024.0);
+    const int fit = static_cast<int>(m_DomainConstructionMemoryLimit / mb_per_domain);
+    num_threads = std::max(1, std::min(num_threads, fit));
+    }
+#endif /* SW_USE_OPENMP */
+
+  bool failed = false;
+  ExceptionObject error;
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int n = 0; n < static_cast<int>(num_inputs); n++)
+    {
+    const unsigned int i = static_cast<unsigned int>(n);
+    try
+      {
+      m_DomainList[i]->SetSigma(m_WorkingImages[i]->GetSpacing()[0] * 2.0);
+      m_DomainList[i]->SetFieldCacheDirectory(m_DomainFieldCacheDirectory);
+      m_DomainList[i]->SetImage(m_WorkingImages[i]);
+      }
+    catch (ExceptionObject &e)
+      {
+#pragma omp critical
+      {
+      if (failed == false)
+        {
+        failed = true;
+        error = e;
+        }
+      }
+      }
+    }
+  if (failed == true) throw error;
 
+  // Everything else, including registration with the particle system, is
+  // done in input order.
+  for (unsigned int i = 0; i < num_inputs; i++)
+    {
     if (m_CuttingPlanes.size() > i)
       {        
       m_DomainList[i]->SetCuttingPlane(m_CuttingPlanes[i].a,
@@ -18,6 +18,7 @@
 #include "itkDataObject.h"
 #include "itkPoint.h"
 #include "itkWeakPointer.h"
+#include <vector>
 
 namespace itk
 {
@@ -54,6 +55,20 @@ public:
   virtual bool ApplyConstraints(PointType &p) const
   {  return false; }
 
+  /** Apply constraints to every point in a list, e.g. a newly split or newly
+      loaded set of particles.  Domains with expensive constraints may
+      override this to process the points together.  Returns true if any of
+      the points was modified. */
+  virtual bool ApplyConstraintsToList(std::vector<PointType> &points) const
+  {
+    bool flag = false;
+    for (unsigned int i = 0; i < points.size(); i++)
+      {
+      if (this->ApplyConstraints(points[i]) == true) flag = true;
+      }
+    return flag;
+  }
+
   /** A Domain may define a distance calculation.  This is useful in cases
       such as geodesic distance, where distance depends on some information
       contained in the Domain.  The default implementation is Euclidean
@@ -0,0 +1,92 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleDomainFieldCache.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleDomainFieldCache_h
+#define __itkParticleDomainFieldCache_h
+
+#include <string>
+
+namespace itk
+{
+
+/**
+ * \class ParticleDomainFieldCache
+ *
+ * Stores the fields that ParticleImageDomainWithCurvature derives from its
+ * distance transform (the gradient image and the mean curvature image) in a
+ * cache directory, so that later runs on the same inputs can skip the
+ * gradient, Gaussian and Hessian filters.
+ *
+ * Cache files are named after a 64-bit hash of the pixel data, the image
+ * geometry and the Hessian smoothing sigma, so edited or regroomed inputs
+ * never pick up stale fields.  Each file is a fixed header followed by the
+ * raw gradient and curvature buffers, each starting on a 4096 byte boundary
+ * so that the file may also be memory mapped.  Files are written to a
+ * temporary name and renamed into place, which makes concurrent writers of
+ * the same entry safe.
+ */
+template <class TImage, class TGradientImage>
+class ParticleDomainFieldCache
+{
+public:
+  typedef TImage ImageType;
+  typedef TGradientImage GradientImageType;
+
+  /** Path of the cache entry for image and sigma in directory dir. */
+  static std::string FileName(const std::string &dir, const ImageType *image,
+                              double sigma);
+
+  /** Reads the cached fields for image.  Returns false, leaving the outputs
+      untouched, if the file does not exist or does not match the image. */
+  static bool Read(const std::string &fn, const ImageType *image, double sigma,
+                   typename GradientImageType::Pointer &gradient,
+                   typename ImageType::Pointer &curvature);
+
+  /** Writes the fields computed for image.  Returns false if the fields do
+      not cover the image buffer or the file cannot be written. */
+  static bool Write(const std::string &fn, const ImageType *image, double sigma,
+                    const GradientImageType *gradient,
+                    const ImageType *curvature);
+
+protected:
+  /** Fixed size file header.  Geometry is stored for up to 3 dimensions. */
+  struct Header
+  {
+    char magic[8];
+    unsigned int dimension;
+    unsigned int pixelSize;
+    unsigned int gradientPixelSize;
+    unsigned int reserved;
+    long long index[3];
+    unsigned long long size[3];
+    double spacing[3];
+    double origin[3];
+    double direction[9];
+    double sigma;
+    unsigned long long gradientOffset;
+    unsigned long long curvatureOffset;
+  };
+
+  static void FillHeader(const ImageType *image, double sigma, Header &h);
+  static unsigned long long Align(unsigned long long offset);
+};
+
+} // end namespace itk
+
+#if ITK_TEMPLATE_EXPLICIT
+#include "Templates/itkParticleDomainFieldCache+-.h"
+#endif
+
+#if ITK_TEMPLATE_TXX
+#include "itkParticleDomainFieldCache.txx"
+#endif
+
+#endif
@@ -0,0 +1,203 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleDomainFieldCache.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleDomainFieldCache_txx
+#define __itkParticleDomainFieldCache_txx
+
+#include "itksys/SystemTools.hxx"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <vector>
+
+namespace itk
+{
+
+template <class TImage, class TGradientImage>
+unsigned long long
+ParticleDomainFieldCache<TImage, TGradientImage>
+::Align(unsigned long long offset)
+{
+  return (offset + 4095) & ~static_cast<unsigned long long>(4095);
+}
+
+template <class TImage, class TGradientImage>
+void
+ParticleDomainFieldCache<TImage, TGradientImage>
+::FillHeader(const ImageType *image, double sigma, Header &h)
+{
+  const unsigned int D = ImageType::ImageDimension;
+  memset(&h, 0, sizeof(Header));
+  memcpy(h.magic, "SWFIELD1", 8);
+  h.dimension = D;
+  h.pixelSize = sizeof(typename ImageType::PixelType);
+  h.gradientPixelSize = sizeof(typename GradientImageType::PixelType);
+
+  const typename ImageType::RegionType &region = image->GetBufferedRegion();
+  for (unsigned int i = 0; i < D && i < 3; i++)
+    {
+    h.index[i] = region.GetIndex()[i];
+    h.size[i] = region.GetSize()[i];
+    h.spacing[i] = image->GetSpacing()[i];
+    h.origin[i] = image->GetOrigin()[i];
+    for (unsigned int j = 0; j < D && j < 3; j++)
+      {
+      h.direction[i * 3 + j] = image->GetDirection()[i][j];
+      }
+    }
+  h.sigma = sigma;
+
+  const unsigned long long n = region.GetNumberOfPixels();
+  h.gradientOffset = Align(sizeof(Header));
+  h.curvatureOffset = Align(h.gradientOffset + n * h.gradientPixelSize);
+}
+
+template <class TImage, class TGradientImage>
+std::string
+ParticleDomainFieldCache<TImage, TGradientImage>
+::FileName(const std::string &dir, const ImageType *image, double sigma)
+{
+  Header h;
+  FillHeader(image, sigma, h);
+
+  // 64-bit FNV-1a over the header and the pixel data, taken a word at a
+  // time so that hashing stays cheap next to reading the image itself.  The
+  // extra shifts fold high bits back down, which FNV alone does not do for
+  // whole words.
+  const unsigned long long prime = 1099511628211ULL;
+  unsigned long long hash = 14695981039346656037ULL;
+
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&h);
+  for (unsigned int i = 0; i < sizeof(Header); i++)
+    {
+    hash = (hash ^ bytes[i]) * prime;
+    }
+
+  const size_t len = image->GetBufferedRegion().GetNumberOfPixels()
+    * sizeof(typename ImageType::PixelType);
+  bytes = reinterpret_cast<const unsigned char *>(image->GetBufferPointer());
+  const size_t words = len / sizeof(unsigned long long);
+  for (size_t i = 0; i < words; i++)
+    {
+    unsigned long long w;
+    memcpy(&w, bytes + i * sizeof(unsigned long long), sizeof(unsigned long long));
+    hash = (hash ^ w) * prime;
+    hash ^= hash >> 32;
+    }
+  for (size_t i = words * sizeof(unsigned long long); i < len; i++)
+    {
+    hash = (hash ^ bytes[i]) * prime;
+    }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+
+  char name[32];
+  sprintf(name, "%016llx.swfield", hash);
+  return dir + "/" + name;
+}
+
+template <class TImage, class TGradientImage>
+bool
+ParticleDomainFieldCache<TImage, TGradientImage>
+::Read(const std::string &fn, const ImageType *image, double sigma,
+       typename GradientImageType::Pointer &gradient,
+       typename ImageType::Pointer &curvature)
+{
+  FILE *fp = fopen(fn.c_str(), "rb");
+  if (fp == NULL) return false;
+
+  Header expected;
+  FillHeader(image, sigma, expected);
+  Header h;
+  if (fread(&h, sizeof(Header), 1, fp) != 1
+      || memcmp(&h, &expected, sizeof(Header)) != 0)
+    {
+    fclose(fp);
+    return false;
+    }
+
+  const typename ImageType::RegionType &region = image->GetBufferedRegion();
+  const size_t n = region.GetNumberOfPixels();
+
+  typename GradientImageType::Pointer g = GradientImageType::New();
+  g->CopyInformation(image);
+  g->SetRegions(region);
+  g->Allocate();
+
+  typename ImageType::Pointer c = ImageType::New();
+  c->CopyInformation(image);
+  c->SetRegions(region);
+  c->Allocate();
+
+  bool ok = fseek(fp, static_cast<long>(h.gradientOffset), SEEK_SET) == 0
+    && fread(g->GetBufferPointer(), h.gradientPixelSize, n, fp) == n
+    && fseek(fp, static_cast<long>(h.curvatureOffset), SEEK_SET) == 0
+    && fread(c->GetBufferPointer(), h.pixelSize, n, fp) == n;
+  fclose(fp);
+
+  if (ok == false) return false;
+
+  gradient = g;
+  curvature = c;
+  return true;
+}
+
+template <class TImage, class TGradientImage>
+bool
+ParticleDomainFieldCache<TImage, TGradientImage>
+::Write(const std::string &fn, const ImageType *image, double sigma,
+        const GradientImageType *gradient, const ImageType *curvature)
+{
+  const typename ImageType::RegionType &region = image->GetBufferedRegion();
+  if (gradient->GetBufferedRegion() != region
+      || curvature->GetBufferedRegion() != region)
+    {
+    return false;
+    }
+
+  Header h;
+  FillHeader(image, sigma, h);
+  const size_t n = region.GetNumberOfPixels();
+
+  itksys::SystemTools::MakeDirectory(itksys::SystemTools::GetFilenamePath(fn).c_str());
+
+  std::ostringstream tmp;
+  tmp << fn << "." << static_cast<const void *>(image) << "." << clock() << ".tmp";
+  FILE *fp = fopen(tmp.str().c_str(), "wb");
+  if (fp == NULL) return false;
+
+  std::vector<char> pad(4096, 0);
+  bool ok = fwrite(&h, sizeof(Header), 1, fp) == 1
+    && fwrite(&pad[0], 1, h.gradientOffset - sizeof(Header), fp)
+       == h.gradientOffset - sizeof(Header)
+    && fwrite(gradient->GetBufferPointer(), h.gradientPixelSize, n, fp) == n
+    && fwrite(&pad[0], 1, h.curvatureOffset - h.gradientOffset - n * h.gradientPixelSize, fp)
+       == h.curvatureOffset - h.gradientOffset - n * h.gradientPixelSize
+    && fwrite(curvature->GetBufferPointer(), h.pixelSize, n, fp) == n;
+  ok = (fclose(fp) == 0) && ok;
+
+  if (ok == true && rename(tmp.str().c_str(), fn.c_str()) == 0)
+    {
+    return true;
+    }
+
+  // Either the write failed, or another writer already put an identical
+  // entry in place.
+  remove(tmp.str().c_str());
+  return false;
+}
+
+} // end namespace itk
+
+#endif
@@ -19,7 +19,10 @@
 #include "itkObjectFactory.h"
 #include "itkWeakPointer.h"
 #include "itkParticleSystem.h"
+#include "itkParticleCurvatureEntropyGradientFunction.h"
+#include "itkParticleEnsembleEntropyFunction.h"
 #include "vnl/vnl_vector_fixed.h"
+#include <typeinfo>
 
 namespace itk
 {
@@ -31,6 +34,12 @@ namespace itk
  * presents the interface of a single function evaluation. Optionally, only the
  * first function can be used by calling SetLinkOff().
  *
+ * When A is a ParticleCurvatureEntropyGradientFunction and B a
+ * ParticleEnsembleEntropyFunction (the usual correspondence setup), they are
+ * called through their concrete types rather than through the virtual
+ * interface, so that the compiler can inline them.  Any other function is
+ * called through the virtual interface.
+ *
  */
 template <unsigned int VDimension>
 class ParticleDualVectorFunction : public ParticleVectorFunction<VDimension>
@@ -55,6 +64,11 @@ public:
   /** Dimensionality of the domain of the particle system. */
   itkStaticConstMacro(Dimension, unsigned int, VDimension);
 
+  /** Function types that are called directly rather than through the
+      virtual interface, see UpdateStaticFunctions. */
+  typedef ParticleCurvatureEntropyGradientFunction<float, VDimension> CurvatureFunctionType;
+  typedef ParticleEnsembleEntropyFunction<VDimension> EnsembleFunctionType;
+
   /** The first argument is a pointer to the particle system.  The second
       argument is the index of the domain within that particle system.  The
       third argument is the index of the particle location within the given
@@ -74,13 +88,13 @@ public:
     // evaluate individual functions: A = surface energy, B = correspondence, C = normal entropy
     if (m_AOn == true)
     {
-      ansA = m_FunctionA->Evaluate(idx, d, system, maxA);
+      ansA = this->EvaluateA(idx, d, system, maxA);
       const_cast<ParticleDualVectorFunction *>(this)->m_AverageGradMagA = m_AverageGradMagA + ansA.magnitude();
     }
     
     if (m_BOn == true)
     {
-      ansB = m_FunctionB->Evaluate(idx, d, system, maxB);
+      ansB = this->EvaluateB(idx, d, system, maxB);
       const_cast<ParticleDualVectorFunction *>(this)->m_AverageGradMagB = m_AverageGradMagB + ansB.magnitude();
     }
 
@@ -151,12 +165,12 @@ public:
     // evaluate individual functions: A = surface energy, B = correspondence, C = normal entropy
     if (m_AOn == true)
     {
-      ansA = m_FunctionA->Energy(idx, d, system);
+      ansA = this->EnergyA(idx, d, system);
     }
 
     if (m_BOn == true)
     {
-      ansB = m_FunctionB->Energy(idx, d, system);
+      ansB = this->EnergyB(idx, d, system);
     }
 
     if (m_COn == true)
@@ -221,7 +235,7 @@ public:
     // evaluate individual functions: A = surface energy, B = correspondence, C = normal entropy
     if (m_AOn == true)
     {
-      ansA = m_FunctionA->Evaluate(idx, d, system, maxA, energyA);
+      ansA = this->EvaluateA(idx, d, system, maxA, energyA);
 
       const_cast<ParticleDualVectorFunction *>(this)->m_AverageGradMagA = m_AverageGradMagA + ansA.magnitude();
       const_cast<ParticleDualVectorFunction *>(this)->m_AverageEnergyA = m_AverageEnergyA + energyA;
@@ -229,7 +243,7 @@ public:
 
     if (m_BOn == true)
     {
-      ansB = m_FunctionB->Evaluate(idx, d, system, maxB, energyB);
+      ansB = this->EvaluateB(idx, d, system, maxB, energyB);
 
       const_cast<ParticleDualVectorFunction *>(this)->m_AverageGradMagB = m_AverageGradMagB + ansB.magnitude();
       const_cast<ParticleDualVectorFunction *>(this)->m_AverageEnergyB = m_AverageEnergyB + energyB;
@@ -309,12 +323,16 @@ public:
   {
     if (m_AOn == true)
     {
-      m_FunctionA->BeforeEvaluate(idx, d, system);
+      if (m_CurvatureFunctionA != 0)
+        m_CurvatureFunctionA->CurvatureFunctionType::BeforeEvaluate(idx, d, system);
+      else m_FunctionA->BeforeEvaluate(idx, d, system);
     }
     
     if (m_BOn == true)
     {
-      m_FunctionB->BeforeEvaluate(idx, d, system);
+      if (m_EnsembleFunctionB != 0)
+        m_EnsembleFunctionB->EnsembleFunctionType::BeforeEvaluate(idx, d, system);
+      else m_FunctionB->BeforeEvaluate(idx, d, system);
       if (m_COn == true) m_FunctionC->BeforeEvaluate(idx, d, system);
     }
   }
@@ -373,6 +391,7 @@ public:
     m_FunctionA = o;
     m_FunctionA->SetDomainNumber(this->GetDomainNumber());
     m_FunctionA->SetParticleSystem(this->GetParticleSystem());
+    this->UpdateStaticFunctions();
   }
 
   void SetFunctionB( ParticleVectorFunction<VDimension> *o)
@@ -380,6 +399,7 @@ public:
     m_FunctionB = o;
     m_FunctionB->SetDomainNumber(this->GetDomainNumber());
     m_FunctionB->SetParticleSystem(this->GetParticleSystem());
+    this->UpdateStaticFunctions();
   }
 
   void SetFunctionC( ParticleVectorFunction<VDimension> *o)
@@ -499,6 +519,7 @@ public:
     if (!copy->m_FunctionA) copy->m_AOn = false;
     if (!copy->m_FunctionB) copy->m_BOn = false;
     if (!copy->m_FunctionC) copy->m_COn = false;
+    copy->UpdateStaticFunctions();
 
     copy->m_DomainNumber = this->m_DomainNumber;
     copy->m_ParticleSystem = this->m_ParticleSystem;
@@ -511,12 +532,79 @@ protected:
                                  m_RelativeGradientScaling(1.0),
                                  m_RelativeEnergyScaling(1.0),
                                  m_RelativeNormGradientScaling(0.0),
-                                 m_RelativeNormEnergyScaling(0.0)  {}
+                                 m_RelativeNormEnergyScaling(0.0),
+                                 m_CurvatureFunctionA(0), m_EnsembleFunctionB(0)  {}
 
   virtual ~ParticleDualVectorFunction() {}
   void operator=(const ParticleDualVectorFunction &);
   ParticleDualVectorFunction(const ParticleDualVectorFunction &);
 
+  /** Points m_CurvatureFunctionA and m_EnsembleFunctionB at functions A and B
+      if those are exactly of the directly called types, and at null
+      otherwise.  A subclass of either type may override its methods, so an
+      exact type match is required. */
+  void UpdateStaticFunctions()
+  {
+    m_CurvatureFunctionA = 0;
+    m_EnsembleFunctionB = 0;
+    if (m_FunctionA.GetPointer() != 0
+        && typeid(*m_FunctionA) == typeid(CurvatureFunctionType))
+      {
+      m_CurvatureFunctionA = static_cast<CurvatureFunctionType *>(m_FunctionA.GetPointer());
+      }
+    if (m_FunctionB.GetPointer() != 0
+        && typeid(*m_FunctionB) == typeid(EnsembleFunctionType))
+      {
+      m_EnsembleFunctionB = static_cast<EnsembleFunctionType *>(m_FunctionB.GetPointer());
+      }
+  }
+
+  /** Evaluate functions A and B, directly if their types are known. */
+  inline VectorType EvaluateA(unsigned int idx, unsigned int d,
+                              const ParticleSystemType *system,
+                              double &maxmove, double &energy) const
+  {
+    if (m_CurvatureFunctionA != 0)
+      return m_CurvatureFunctionA->CurvatureFunctionType::Evaluate(idx, d, system, maxmove, energy);
+    return m_FunctionA->Evaluate(idx, d, system, maxmove, energy);
+  }
+  inline VectorType EvaluateA(unsigned int idx, unsigned int d,
+                              const ParticleSystemType *system, double &maxmove) const
+  {
+    double energy;
+    if (m_CurvatureFunctionA != 0) return this->EvaluateA(idx, d, system, maxmove, energy);
+    return m_FunctionA->Evaluate(idx, d, system, maxmove);
+  }
+  inline double EnergyA(unsigned int idx, unsigned int d, const ParticleSystemType *system) const
+  {
+    double maxmove, energy;
+    if (m_CurvatureFunctionA == 0) return m_FunctionA->Energy(idx, d, system);
+    this->EvaluateA(idx, d, system, maxmove, energy);
+    return energy;
+  }
+  inline VectorType EvaluateB(unsigned int idx, unsigned int d,
+                              const ParticleSystemType *system,
+                              double &maxmove, double &energy) const
+  {
+    if (m_EnsembleFunctionB != 0)
+      return m_EnsembleFunctionB->EnsembleFunctionType::Evaluate(idx, d, system, maxmove, energy);
+    return m_FunctionB->Evaluate(idx, d, system, maxmove, energy);
+  }
+  inline VectorType EvaluateB(unsigned int idx, unsigned int d,
+                              const ParticleSystemType *system, double &maxmove) const
+  {
+    double energy;
+    if (m_EnsembleFunctionB != 0) return this->EvaluateB(idx, d, system, maxmove, energy);
+    return m_FunctionB->Evaluate(idx, d, system, maxmove);
+  }
+  inline double EnergyB(unsigned int idx, unsigned int d, const ParticleSystemType *system) const
+  {
+    double maxmove, energy;
+    if (m_EnsembleFunctionB == 0) return m_FunctionB->Energy(idx, d, system);
+    this->EvaluateB(idx, d, system, maxmove, energy);
+    return energy;
+  }
+
   bool m_AOn;
   bool m_BOn;
   bool m_COn;
@@ -535,6 +623,9 @@ protected:
   typename ParticleVectorFunction<VDimension>::Pointer m_FunctionA;
   typename ParticleVectorFunction<VDimension>::Pointer m_FunctionB;
   typename ParticleVectorFunction<VDimension>::Pointer m_FunctionC;
+
+  CurvatureFunctionType *m_CurvatureFunctionA;
+  EnsembleFunctionType *m_EnsembleFunctionB;
 };
 
 
@@ -15,6 +15,7 @@
 #ifndef __itkParticleEnsembleEntropyFunction_h
 #define __itkParticleEnsembleEntropyFunction_h
 
+#include "itkParticleLog.h"
 #include "itkParticleShapeMatrixAttribute.h"
 #include "itkParticleVectorFunction.h"
 #include <vector>
@@ -77,6 +78,17 @@ public:
     return e;
   }
   
+  /** The entropy of the shape distribution, as computed at the last
+      covariance update. */
+  double GetCurrentEnergy() const
+  { return m_CurrentEnergy; }
+
+  /** Number of covariance updates so far.  GetCurrentEnergy only changes
+      when this does, which with a recompute interval above one (or the
+      adaptive interval) is not every iteration. */
+  unsigned long GetNumberOfCovarianceUpdates() const
+  { return m_NumberOfCovarianceUpdates; }
+
   /** Write the first n modes to +- 3 std dev and the mean of the model
       described by the covariance matrix.  The string argument is a prefix to
       the file names. */
@@ -93,10 +105,14 @@ public:
   /** Called before each iteration of a solver. */
   virtual void BeforeIteration()
   {
-    std::cout << "BeforeIteration counter = " << m_Counter << std::endl;
+    itkParticleLogMacro(Debug, "BeforeIteration counter = " << m_Counter << "\n");
     m_ShapeMatrix->BeforeIteration();
     
-    if (m_Counter == 0)
+    if (m_RecomputeCovarianceTolerance > 0.0)
+      {
+      if (this->NeedsCovarianceUpdate() == true) this->ComputeCovarianceMatrix();
+      }
+    else if (m_Counter == 0)
       {
       this->ComputeCovarianceMatrix();
       }
@@ -106,8 +122,15 @@ public:
   virtual void AfterIteration()
   {
     m_ShapeMatrix->AfterIteration();
-    // Update the annealing parameter.
-    if (m_HoldMinimumVariance != true)
+    m_IterationsSinceCovarianceUpdate++;
+
+    // Update the annealing parameter.  With an adaptive recompute interval
+    // the decay is applied every iteration, independent of the solves.
+    if (m_HoldMinimumVariance != true && m_RecomputeCovarianceTolerance > 0.0)
+      {
+      m_MinimumVariance *= m_MinimumVarianceDecayConstant;
+      }
+    else if (m_HoldMinimumVariance != true)
       {
       m_Counter ++;
       if (m_Counter >=  m_RecomputeCovarianceInterval)
@@ -146,6 +169,30 @@ public:
   int GetRecomputeCovarianceInterval() const
   { return m_RecomputeCovarianceInterval; }
 
+  /** Set/Get the tolerance of the adaptive recompute interval.  If positive,
+      the covariance is recomputed only when the centered shape matrix has
+      changed by more than this fraction (Frobenius norm) since the last
+      solve, or the regularization by more than this fraction of the
+      smallest eigenvalue, and at most every RecomputeCovarianceInterval
+      and at least every MaximumRecomputeCovarianceInterval iterations.
+      Zero (the default) keeps the fixed interval. */
+  void SetRecomputeCovarianceTolerance(double t)
+  { m_RecomputeCovarianceTolerance = t; }
+  double GetRecomputeCovarianceTolerance() const
+  { return m_RecomputeCovarianceTolerance; }
+
+  void SetMaximumRecomputeCovarianceInterval(int i)
+  { m_MaximumRecomputeCovarianceInterval = i; }
+  int GetMaximumRecomputeCovarianceInterval() const
+  { return m_MaximumRecomputeCovarianceInterval; }
+
+  /** Relative change of the centered shape matrix since the last solve. */
+  double ComputeShapeMatrixChange() const;
+
+  /** Recomputes the covariance of the shape matrix and the gradient update
+      for every point.  Normally called from BeforeIteration. */
+  virtual void ComputeCovarianceMatrix();
+
   virtual typename ParticleVectorFunction<VDimension>::Pointer Clone()
   {
     typename ParticleEnsembleEntropyFunction<VDimension>::Pointer copy = ParticleEnsembleEntropyFunction<VDimension>::New();
@@ -158,6 +205,11 @@ public:
     copy->m_MinimumVarianceDecayConstant = this->m_MinimumVarianceDecayConstant;
     copy->m_RecomputeCovarianceInterval = this->m_RecomputeCovarianceInterval;
     copy->m_Counter = m_Counter;
+    copy->m_RecomputeCovarianceTolerance = this->m_RecomputeCovarianceTolerance;
+    copy->m_MaximumRecomputeCovarianceInterval = this->m_MaximumRecomputeCovarianceInterval;
+    copy->m_IterationsSinceCovarianceUpdate = this->m_IterationsSinceCovarianceUpdate;
+    copy->m_SolvedMinimumVariance = this->m_SolvedMinimumVariance;
+    copy->m_NumberOfCovarianceUpdates = this->m_NumberOfCovarianceUpdates;
 
     copy->m_DomainNumber = this->m_DomainNumber;
     copy->m_ParticleSystem = this->m_ParticleSystem;
@@ -177,13 +229,21 @@ protected:
     m_MinimumVarianceDecayConstant = 1.0;//log(2.0) / 50000.0;
     m_RecomputeCovarianceInterval = 1;
     m_Counter = 0;
+    m_RecomputeCovarianceTolerance = 0.0;
+    m_MaximumRecomputeCovarianceInterval = 10;
+    m_IterationsSinceCovarianceUpdate = 0;
+    m_SolvedMinimumVariance = 0.0;
+    m_NumberOfCovarianceUpdates = 0;
   }
   virtual ~ParticleEnsembleEntropyFunction() {}
   void operator=(const ParticleEnsembleEntropyFunction &);
   ParticleEnsembleEntropyFunction(const ParticleEnsembleEntropyFunction &);
+
+  /** Decides whether the adaptive schedule calls for a new solve. */
+  bool NeedsCovarianceUpdate() const;
+
   typename ShapeMatrixType::Pointer m_ShapeMatrix;
 
-  virtual void ComputeCovarianceMatrix();
   vnl_matrix_type m_PointsUpdate;
   double m_MinimumVariance;
   double m_MinimumEigenValue;
@@ -193,6 +253,15 @@ protected:
   int m_RecomputeCovarianceInterval;
   int m_Counter;
 
+  // Adaptive recompute state: the centered shape matrix and regularization
+  // of the last solve.
+  double m_RecomputeCovarianceTolerance;
+  int m_MaximumRecomputeCovarianceInterval;
+  int m_IterationsSinceCovarianceUpdate;
+  double m_SolvedMinimumVariance;
+  vnl_matrix_type m_SolvedPointsMinusMean;
+  unsigned long m_NumberOfCovarianceUpdates;
+
 };
 
 
@@ -18,6 +18,9 @@
 #include "itkParticleImageDomainWithGradients.h"
 #include "vnl/algo/vnl_symmetric_eigensystem.h"
 #include "itkParticleGaussianModeWriter.h"
+#include "itkParticleLog.h"
+#include <cmath>
+#include <sstream>
 #include <string>
 
 namespace itk
@@ -93,6 +96,15 @@ ParticleEnsembleEntropyFunction<VDimension>
   vnl_symmetric_eigensystem<double> symEigen(A);
   m_PointsUpdate = points_minus_mean * ((symEigen.pinverse()).transpose());
   m_MinimumEigenValue = symEigen.D(0, 0);
+
+  // Remember what was solved, for the adaptive recompute interval.
+  m_IterationsSinceCovarianceUpdate = 0;
+  m_NumberOfCovarianceUpdates++;
+  m_SolvedMinimumVariance = m_MinimumVariance;
+  if (m_RecomputeCovarianceTolerance > 0.0)
+    {
+    m_SolvedPointsMinusMean = points_minus_mean;
+    }
   
   // double energy = 0.0;
   m_CurrentEnergy = 0.0;
@@ -107,37 +119,100 @@ ParticleEnsembleEntropyFunction<VDimension>
     }
   m_CurrentEnergy /= num_samples;
   //    energy = 0.5*log(symEigen.determinant());
-  
-  for (unsigned int i =0; i < num_samples; i++)
+
+  // The eigenvalue and mode tables are only built when they will be logged.
+  if (ParticleLog::Enabled(ParticleLog::Debug))
+  {
+    std::ostringstream table;
+    for (unsigned int i =0; i < num_samples; i++)
+      {
+      table << i << ": "<< symEigen.D(i, i) - m_MinimumVariance << "\n";
+      }
+
+    table << "pca mode, variance, percent variance, sum percent\n";
+    double totalVariance = 0;
+    for ( int c = 0; c < num_samples; c++ )
     {
-    std::cout << i << ": "<< symEigen.D(i, i) - m_MinimumVariance << std::endl;
+      totalVariance += symEigen.D(c, c) - m_MinimumVariance;
     }
 
+    double sum_variance = 0;
+    for ( int c = num_samples-1; c >= 0; c-- )
+    {
+      double variance = symEigen.D(c, c) - m_MinimumVariance;
+      sum_variance += variance;
+      table << "mode " << num_samples-c-1 << " : ";
+      table << variance << ", ";
+      table << variance / totalVariance * 100.0 << "%, ";
+      table << sum_variance / totalVariance * 100.0 << "%";
+      table << "\n";
+    }
+    ParticleLog::Write(ParticleLog::Debug, table.str());
+  }
 
+  itkParticleLogMacro(Iterations, "ENERGY = " << m_CurrentEnergy << "\t MinimumVariance = "
+                      << m_MinimumVariance << "\n");
+}
 
-  std::cout << "pca mode, variance, percent variance, sum percent\n";
-  double totalVariance = 0;
-  for ( int c = 0; c < num_samples; c++ )
-  {
-    totalVariance += symEigen.D(c, c) - m_MinimumVariance;
-  }
+template <unsigned int VDimension>
+double
+ParticleEnsembleEntropyFunction<VDimension>
+::ComputeShapeMatrixChange() const
+{
+  const unsigned int num_samples = m_ShapeMatrix->cols();
+  const unsigned int num_dims    = m_ShapeMatrix->rows();
+  if (m_SolvedPointsMinusMean.rows() != num_dims
+      || m_SolvedPointsMinusMean.cols() != num_samples)
+    {
+    return 1.0e30;
+    }
 
-  double sum_variance = 0;
-  for ( int c = num_samples-1; c >= 0; c-- )
-  {
-    double variance = symEigen.D(c, c) - m_MinimumVariance;
-    sum_variance += variance;
-    std::cout << "mode " << num_samples-c-1 << " : ";
-    std::cout << variance << ", ";
-    std::cout << variance / totalVariance * 100.0 << "%, ";
-    std::cout << sum_variance / totalVariance * 100.0 << "%";
-    std::cout<< "\n";
-  }
+  // || (S - mean(S)) - (S0 - mean(S0)) ||_F / || S0 - mean(S0) ||_F, without
+  // forming the centered matrix.
+  double change = 0.0;
+  for (unsigned int j = 0; j < num_dims; j++)
+    {
+    double total = 0.0;
+    for (unsigned int i = 0; i < num_samples; i++)
+      {
+      total += m_ShapeMatrix->operator()(j, i);
+      }
+    const double mean = total / (double)num_samples;
+    for (unsigned int i = 0; i < num_samples; i++)
+      {
+      const double d = m_ShapeMatrix->operator()(j, i) - mean - m_SolvedPointsMinusMean(j, i);
+      change += d * d;
+      }
+    }
 
+  const double norm = m_SolvedPointsMinusMean.frobenius_norm();
+  if (norm <= 0.0) return (change > 0.0) ? 1.0e30 : 0.0;
+  return sqrt(change) / norm;
+}
 
+template <unsigned int VDimension>
+bool
+ParticleEnsembleEntropyFunction<VDimension>
+::NeedsCovarianceUpdate() const
+{
+  if (m_SolvedPointsMinusMean.rows() != m_ShapeMatrix->rows()
+      || m_SolvedPointsMinusMean.cols() != m_ShapeMatrix->cols())
+    {
+    return true;
+    }
+  if (m_IterationsSinceCovarianceUpdate >= m_MaximumRecomputeCovarianceInterval) return true;
+  if (m_IterationsSinceCovarianceUpdate < m_RecomputeCovarianceInterval) return false;
+
+  // The regularization shifts every eigenvalue of the covariance, so its
+  // change is relative to the smallest one.
+  if (m_MinimumEigenValue > 0.0
+      && fabs(m_MinimumVariance - m_SolvedMinimumVariance)
+      > m_RecomputeCovarianceTolerance * m_MinimumEigenValue)
+    {
+    return true;
+    }
 
-  std::cout << "ENERGY = " << m_CurrentEnergy << "\t MinimumVariance = "
-            << m_MinimumVariance <<  std::endl;
+  return this->ComputeShapeMatrixChange() > m_RecomputeCovarianceTolerance;
 }
 
 template <unsigned int VDimension>
@@ -163,9 +238,7 @@ ParticleEnsembleEntropyFunction<VDimension>
     }
 
 
-  return system->TransformVector(gradE,
-                   system->GetInversePrefixTransform(d) * 
-                                 system->GetInverseTransform(d));
+  return system->TransformVector(gradE, system->GetInverseComposedTransform(d));
 }
 
 
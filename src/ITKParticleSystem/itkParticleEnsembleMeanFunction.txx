@@ -68,8 +68,7 @@ ParticleEnsembleMeanFunction<VDimension>
   
   //  Transform the gradient according to the transform of the given domain and
   //  return.
-  return system->TransformVector(gradE, system->GetInversePrefixTransform(d)
-                                 * system->GetInverseTransform(d));
+  return system->TransformVector(gradE, system->GetInverseComposedTransform(d));
 }
 
 
@@ -150,7 +150,7 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
   
   // Get the neighborhood surrounding the point "pos".
   typename ParticleSystemType::PointVectorType neighborhood
-    = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
+    = system->FindNeighborhoodPoints(idx, neighborhood_radius, d);
   
   // Compute the weights based on angle between the neighbors and the center.
   std::vector<double> weights;
@@ -180,7 +180,7 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
       sigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
       }
     
-    neighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
+    neighborhood = system->FindNeighborhoodPoints(idx, neighborhood_radius, d);
     this->ComputeAngularWeights(pos,neighborhood,domain,weights);
     sigma = this->EstimateSigma(neighborhood, weights, pos, sigma, epsilon, err);
     } // done while err
@@ -191,7 +191,7 @@ ParticleEntropyGradientFunction<TGradientNumericType, VDimension>
     {
     sigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
     neighborhood_radius = this->GetMaximumNeighborhoodRadius();
-    neighborhood = system->FindNeighborhoodPoints(pos, neighborhood_radius, d);
+    neighborhood = system->FindNeighborhoodPoints(idx, neighborhood_radius, d);
     this->ComputeAngularWeights(pos,neighborhood,domain,weights);
     }
 
@@ -126,8 +126,7 @@ namespace itk
     //  maxmove = energy * 0.5;
 
     //  Transform the gradient according to the transform of the given domain and return.
-    return system->TransformVector(gradE_norm, system->GetInversePrefixTransform(d)
-                                               * system->GetInverseTransform(d));
+    return system->TransformVector(gradE_norm, system->GetInverseComposedTransform(d));
   }
 
 } // end namespace
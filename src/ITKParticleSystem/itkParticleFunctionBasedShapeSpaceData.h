@@ -31,8 +31,13 @@ namespace itk
 {
 /** \class ParticleFunctionBasedShapeSpaceData
  *
- * \brief
+ * \brief Samples a set of function (attribute) images at the particle
+ * positions of each domain.
  *
+ * Values and gradients are cached in dense per-domain arrays.  Position and
+ * transform events only mark the affected entries as stale; UpdateCache
+ * re-samples the stale entries, in parallel over domains, so that each
+ * particle is interpolated at most once per position.
  */
 template <class T, unsigned int VDimension>
 class ITK_EXPORT ParticleFunctionBasedShapeSpaceData
@@ -122,6 +127,11 @@ public:
     typename GradientInterpolatorType::Pointer gi = GradientInterpolatorType::New();
     gi->SetInputImage(filter->GetOutput());
     m_GradientInterpolators[d].push_back(gi);
+
+    // Cached samples no longer cover all functions.
+    m_Scalars[d].clear();
+    m_Gradients[d].clear();
+    m_DomainStale[d] = 1;
  
     
   }
@@ -130,32 +140,75 @@ public:
   unsigned int GetNumberOfFunctions() const
   { return m_NumberOfFunctions; }
 
+  /** Returns the value of function (dim % NumberOfFunctions) at particle
+      (dim / NumberOfFunctions) of the given sample. */
   DataType GetScalar(unsigned int sample, unsigned int dim)
   {
-   unsigned int f = dim % m_NumberOfFunctions;
-    unsigned int idx = dim / m_NumberOfFunctions;
-
-    //    std::cout << "shape=" << sample << " function=" << f << " idx=" << idx << " value=";
-
-    
-    //    std::cout << m_ScalarInterpolators[sample][f]->Evaluate(m_ParticleSystem->GetTransformedPosition(idx,sample)) << std::endl;
-
-    //    std::cout << "Transformed pos = " << m_ParticleSystem->GetTransformedPosition(idx, sample) << std::endl;
-    
-    return m_ScalarInterpolators[sample][f]->Evaluate(m_ParticleSystem->GetTransformedPosition(idx,sample));
+    this->UpdateCache(sample);
+    return m_Scalars[sample][dim];
   }
   
-//    inline VectorType SampleGradient(const PointType &p) const
-//   {   return  m_GradientInterpolator->Evaluate(p);  }
-//   inline VnlVectorType SampleGradientVnl(const PointType &p) const
-//   { return VnlVectorType( this->SampleGradient(p).GetDataPointer() ); }
+  /** Returns the gradient of function (dim % NumberOfFunctions) at particle
+      (dim / NumberOfFunctions) of the given sample. */
   typename Self::VectorType GetGradient(unsigned int sample, unsigned int dim)
   {
-    unsigned int f = dim % m_NumberOfFunctions;
-    unsigned int idx = dim / m_NumberOfFunctions;
-    
-    return m_GradientInterpolators[sample][f]->Evaluate(m_ParticleSystem->GetTransformedPosition(idx,sample));
+    this->UpdateCache(sample);
+    return m_Gradients[sample][dim];
+  }
+
+  /** Direct access to the cached values and gradients of one sample, laid
+      out as particle * NumberOfFunctions + function.  UpdateCache must be
+      called first. */
+  const DataType *GetScalars(unsigned int sample) const
+  { return &(m_Scalars[sample][0]); }
+  const VectorType *GetGradients(unsigned int sample) const
+  { return &(m_Gradients[sample][0]); }
+
+  /** Re-samples the stale entries of all samples, in parallel. */
+  void UpdateCache()
+  {
+    const int n = static_cast<int>(m_ScalarInterpolators.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int d = 0; d < n; d++)
+      {
+      this->UpdateCache(d);
+      }
   }
+
+  /** Re-samples the stale entries of one sample. */
+  void UpdateCache(unsigned int d)
+  {
+    if (m_DomainStale[d] == 0) return;
+
+    const unsigned int size = m_NumberOfParticles * m_NumberOfFunctions;
+    if (m_Scalars[d].size() != size)
+      {
+      m_Scalars[d].resize(size);
+      m_Gradients[d].resize(size);
+      m_Stale[d].assign(m_NumberOfParticles, 1);
+      }
+    if (m_Stale[d].size() < (unsigned int)m_NumberOfParticles)
+      {
+      m_Stale[d].resize(m_NumberOfParticles, 1);
+      }
+
+    for (unsigned int idx = 0; idx < (unsigned int)m_NumberOfParticles; idx++)
+      {
+      if (m_Stale[d][idx] == 0) continue;
+
+      const PointType pos = m_ParticleSystem->GetTransformedPosition(idx, d);
+      for (unsigned int f = 0; f < (unsigned int)m_NumberOfFunctions; f++)
+        {
+        m_Scalars[d][idx * m_NumberOfFunctions + f]
+          = m_ScalarInterpolators[d][f]->Evaluate(pos);
+        m_Gradients[d][idx * m_NumberOfFunctions + f]
+          = m_GradientInterpolators[d][f]->Evaluate(pos);
+        }
+      m_Stale[d][idx] = 0;
+      }
+    m_DomainStale[d] = 0;
+  }
+
   /** Callbacks that may be defined by a subclass.  If a subclass defines one
       of these callback methods, the corresponding flag in m_DefinedCallbacks
       should be set to true so that the ParticleSystem will know to register
@@ -189,19 +242,27 @@ public:
 
     // Assumes number of particles is equal in all domains
     if (d == 0) m_NumberOfParticles++;
+
+    this->MarkStale(d, idx);
   }
   
-//   virtual void PositionSetEventCallback(Object *o, const EventObject &e) 
-//   {
-//     const itk::ParticlePositionSetEvent &event = dynamic_cast<const itk::ParticlePositionSetEvent &>(e);
-//     const itk::ParticleSystem<VDimension> *ps= dynamic_cast<const itk::ParticleSystem<VDimension> *>(o);
-//     const int d = event.GetDomainIndex();
-//     const unsigned int idx = event.GetPositionIndex();
-//     const typename itk::ParticleSystem<VDimension>::PointType pos = ps->GetTransformedPosition(idx, d);
-
-//     // Find and set the values for the given particle position.
+  virtual void PositionSetEventCallback(Object *, const EventObject &e) 
+  {
+    const itk::ParticlePositionSetEvent &event = dynamic_cast<const itk::ParticlePositionSetEvent &>(e);
+    this->MarkStale(event.GetDomainIndex(), event.GetPositionIndex());
+  }
 
-//   }
+  /** A new transform moves every particle of the domain in world space. */
+  virtual void TransformSetEventCallback(Object *, const EventObject &e)
+  {
+    const itk::ParticleTransformSetEvent &event = dynamic_cast<const itk::ParticleTransformSetEvent &>(e);
+    this->MarkDomainStale(event.GetDomainIndex());
+  }
+  virtual void PrefixTransformSetEventCallback(Object *, const EventObject &e)
+  {
+    const itk::ParticlePrefixTransformSetEvent &event = dynamic_cast<const itk::ParticlePrefixTransformSetEvent &>(e);
+    this->MarkDomainStale(event.GetDomainIndex());
+  }
   
 //   virtual void PositionRemoveEventCallback(Object *, const EventObject &) 
 //   {
@@ -214,6 +275,10 @@ public:
   {
     m_ScalarInterpolators.push_back(std::vector<typename ScalarInterpolatorType::Pointer>());
     m_GradientInterpolators.push_back(std::vector<typename GradientInterpolatorType::Pointer>());
+    m_Scalars.push_back(std::vector<DataType>());
+    m_Gradients.push_back(std::vector<VectorType>());
+    m_Stale.push_back(std::vector<unsigned char>());
+    m_DomainStale.push_back(1);
     //    m_FunctionImages.push_back(std::vector<typename ImageType::Pointer>());
     //    m_GradientImages.push_back(std::vector<typename GradientImageType::Pointer>()); 
   }
@@ -227,7 +292,9 @@ public:
     m_ParticleSystem = 0;
     this->m_DefinedCallbacks.DomainAddEvent = true;
     this->m_DefinedCallbacks.PositionAddEvent = true;
-    //     this->m_DefinedCallbacks.PositionSetEvent = true;
+    this->m_DefinedCallbacks.PositionSetEvent = true;
+    this->m_DefinedCallbacks.TransformSetEvent = true;
+    this->m_DefinedCallbacks.PrefixTransformSetEvent = true;
     //     this->m_DefinedCallbacks.PositionRemoveEvent = true;
     }
   virtual ~ParticleFunctionBasedShapeSpaceData() {};
@@ -238,6 +305,22 @@ public:
  private:
   ParticleFunctionBasedShapeSpaceData(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
+
+  /** Position events for different domains may arrive from different
+      threads; each only touches the flags of its own domain. */
+  void MarkStale(unsigned int d, unsigned int idx)
+  {
+    if (d >= m_Stale.size()) return;
+    if (idx >= m_Stale[d].size()) m_Stale[d].resize(idx + 1, 1);
+    m_Stale[d][idx] = 1;
+    m_DomainStale[d] = 1;
+  }
+  void MarkDomainStale(unsigned int d)
+  {
+    if (d >= m_Stale.size()) return;
+    m_Stale[d].assign(m_Stale[d].size(), 1);
+    m_DomainStale[d] = 1;
+  }
   
   /** The number of samples corresponds to the number of domains in the
       particle system. */
@@ -260,6 +343,14 @@ public:
   std::vector<std::vector<typename GradientInterpolatorType::Pointer> > m_GradientInterpolators;
   std::vector<std::vector<typename ScalarInterpolatorType::Pointer> > m_ScalarInterpolators;
 
+  /** Cached samples, indexed [domain][particle * m_NumberOfFunctions + function]. */
+  std::vector<std::vector<DataType> > m_Scalars;
+  std::vector<std::vector<VectorType> > m_Gradients;
+
+  /** Per-particle and per-domain flags for entries that must be re-sampled. */
+  std::vector<std::vector<unsigned char> > m_Stale;
+  std::vector<unsigned char> m_DomainStale;
+
 };
 
 } // end namespace
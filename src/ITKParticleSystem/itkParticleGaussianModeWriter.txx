@@ -16,7 +16,7 @@
 #define __itkParticleGaussianModeWriter_txx
 
 #include "itkParticleImageDomainWithGradients.h"
-#include "vnl/algo/vnl_symmetric_eigensystem.h"
+#include "itkParticleTruncatedPCA.h"
 #include "itkParticlePositionWriter.h"
 #include <string>
 
@@ -54,25 +54,13 @@ ParticleGaussianModeWriter<VDimension>
       }
     }
   
-  vnl_matrix_type A = points_minus_mean.transpose()
-   * points_minus_mean * (1.0/((double)(num_samples-1)));
-  
-  vnl_symmetric_eigensystem<double> symEigen(A);
-  vnl_matrix_type vectors = points_minus_mean * symEigen.V;
-  
- // normalize those eigenvectors
-  for (int i = 0; i < num_samples; i++)
-    {
-    double total = 0.0f;
-    for (int j = 0; j < num_dims; j++)
-      {
-      total += vectors(j, i)*vectors(j, i);
-      }
-    total = sqrt(total);
-    
-    for (int j = 0; j < num_dims; j++)
-     {      vectors(j, i) = vectors(j, i) /  (total + 1.0e-15); }
-    }
+  // Only the modes that are written are computed.
+  ParticleTruncatedPCA<DataType> pca;
+  pca.SetNumberOfModes(m_NumberOfModes > 0 ? m_NumberOfModes : 0);
+  pca.Compute(points_minus_mean);
+  const vnl_matrix_type &vectors = pca.GetEigenvectors();
+  const vnl_vector_type &values = pca.GetEigenvalues();
+  const int num_modes = values.size();
 
   // Write each domain to a separate file.  ASSUMES EACH DOMAIN HAS THE SAME
   // NUMBER OF ROWS
@@ -109,9 +97,9 @@ ParticleGaussianModeWriter<VDimension>
     writer->Update();
     
     int modenum = 0;
-    for (int mode = num_samples-1; mode > num_samples-(m_NumberOfModes+1); mode--, modenum++)
+    for (int mode = num_modes-1; mode >= 0 && modenum < m_NumberOfModes; mode--, modenum++)
       {
-      double lambda = sqrt(symEigen.D(mode, mode));
+      double lambda = sqrt(values(mode));
       
       for (int s = -3; s < 4; s++)
         {
@@ -18,6 +18,9 @@
 #include "itkParticleImageDomainWithGradients.h"
 #include "vnl/algo/vnl_symmetric_eigensystem.h"
 #include "itkParticleGaussianModeWriter.h"
+#include "itkParticleLog.h"
+#include "itkParticleTruncatedPCA.h"
+#include <sstream>
 #include <string>
 
 namespace itk
@@ -43,35 +46,44 @@ ParticleGeneralEntropyGradientFunction<VDimension>
     m_PointsUpdate.set_size(VDimension * num_particles, num_samples);
     }
   
+  // Sample all attributes at the current particle positions once, in
+  // parallel over shapes.
+  m_ShapeData->UpdateCache();
+
   vnl_matrix_type points_minus_mean(num_dims, num_samples);
   vnl_vector_type means(num_dims);
   
   // Compute the mean shape vector. Y
-  for (unsigned int j = 0; j < num_dims; j++)
+#pragma omp parallel for
+  for (int i = 0; i < (int)num_samples; i++)
     {
-    double total = 0.0;
-    for (unsigned int i = 0; i < num_samples; i++)
+    const DataType *values = m_ShapeData->GetScalars(i);
+    for (unsigned int j = 0; j < num_dims; j++)
       {
-      points_minus_mean(j, i) = m_ShapeData->GetScalar(i, j)
-        * m_AttributeScales[j % num_functions];
-
-      total += points_minus_mean(j,i);
+      points_minus_mean(j, i) = values[j] * m_AttributeScales[j % num_functions];
       }
-    means(j) = total/(double)num_samples;
     }
 
-  
-  for (unsigned int j = 0; j < num_dims; j++)
+#pragma omp parallel for
+  for (int j = 0; j < (int)num_dims; j++)
     {
+    DataType *row = points_minus_mean[j];
+    double total = 0.0;
+    for (unsigned int i = 0; i < num_samples; i++)
+      {
+      total += row[i];
+      }
+    means(j) = total/(double)num_samples;
     for (unsigned int i = 0; i < num_samples; i++)
       {
-      points_minus_mean(j, i) -= means(j);
+      row[i] -= means(j);
       }
     }
-  //  std::cout << "points_minus_mean = " << points_minus_mean << std::endl;
+
   // Compute the covariance in the dual space (transposed shape matrix)
-  vnl_matrix_type A =  points_minus_mean.transpose()
-      * points_minus_mean * (1.0/((double)(num_samples-1)));
+  vnl_matrix_type A;
+  ParticleTruncatedPCA<DataType>::TransposeMultiply(points_minus_mean, points_minus_mean, A);
+  A *= (1.0/((double)(num_samples-1)));
 
   // Regularize A
   for (unsigned int i = 0; i < num_samples; i++)
@@ -81,53 +93,43 @@ ParticleGeneralEntropyGradientFunction<VDimension>
 
   // Find inverse of covariance matrix
   vnl_symmetric_eigensystem<float> symEigen(A);
-  vnl_matrix_type Q = points_minus_mean * (symEigen.pinverse());
+  vnl_matrix_type Q;
+  ParticleTruncatedPCA<DataType>::Multiply(points_minus_mean, symEigen.pinverse(), Q);
   
-  //  m_PointsUpdate = ;
   // Compute the update matrix in coordinate space by multiplication with the
   // Jacobian.  Each shape gradient must be transformed by a different Jacobian
-  // so we have to do this individually for each shape (sample).
-  vnl_matrix_type J(num_functions, VDimension);
-  vnl_vector_type v(num_functions);
- 
-  for (unsigned int i = 0; i < num_samples; i++) // go through all shapes
+  // so we have to do this individually for each shape (sample).  The Jacobian
+  // is applied directly from the cached gradients: dx = J^T v.
+#pragma omp parallel for
+  for (int i = 0; i < (int)num_samples; i++) // go through all shapes
     {
+    const typename ShapeDataType::VectorType *grads = m_ShapeData->GetGradients(i);
     unsigned int k = 0;
     for (unsigned int j = 0; j < num_particles; j++)  // go through particles
       {
-      // Construct the Jacobian submatrix
+      DataType dx[VDimension];
+      for (unsigned int kk = 0; kk < VDimension; kk++) dx[kk] = 0.0;
+
       for (unsigned int ii = 0; ii < num_functions; ii++, k++)
         {
-        typename ShapeDataType::VectorType grad =
-            m_ShapeData->GetGradient(i, k);
-          for (unsigned int jj = 0; jj < VDimension; jj++)
-            {
-            J(ii,jj) = grad[jj] * m_AttributeScales[ii];
-            
-            }
-
-          v[ii] = Q(k,i);  
+        const DataType v = Q(k,i) * m_AttributeScales[ii];
+        for (unsigned int jj = 0; jj < VDimension; jj++)
+          {
+          dx[jj] += grads[k][jj] * v;
+          }
         }
-      //      if (j == 0)
-      //        {
-        //        std::cout << "v = " << v << std::endl;
-        //        std::cout << "J = " << J << std::endl;
-      //        }
 
-      vnl_vector_type dx = J.transpose() * v;
       // Fill in appropriate rows/col of update matrix
       for (unsigned int kk = 0; kk < VDimension; kk++)
         {
         m_PointsUpdate[j*VDimension+kk][i] = dx[kk];   
         }
-
-      
       }// done particle
     }
 
   m_MinimumEigenValue = symEigen.D(0, 0);
   
-  // double energy = 0.0;
+  m_CurrentEnergy = 0.0;
   for (unsigned int i = 1; i < num_samples; i++)
     {
     if (symEigen.D(i, i) < m_MinimumEigenValue)
@@ -138,13 +140,18 @@ ParticleGeneralEntropyGradientFunction<VDimension>
     }
   m_CurrentEnergy /= num_samples;
   //    energy = 0.5*log(symEigen.determinant());
-  
-  for (unsigned int i =0; i < num_samples; i++)
+
+  if (ParticleLog::Enabled(ParticleLog::Debug))
     {
-    std::cout << i << ": "<< symEigen.D(i, i) - m_MinimumVariance << std::endl;
+    std::ostringstream table;
+    for (unsigned int i =0; i < num_samples; i++)
+      {
+      table << i << ": "<< symEigen.D(i, i) - m_MinimumVariance << "\n";
+      }
+    ParticleLog::Write(ParticleLog::Debug, table.str());
     }
-  std::cout << "ENERGY = " << m_CurrentEnergy << "\t MinimumVariance = "
-            << m_MinimumVariance <<  std::endl;
+  itkParticleLogMacro(Iterations, "ENERGY = " << m_CurrentEnergy << "\t MinimumVariance = "
+                      << m_MinimumVariance << "\n");
 }
 
 template <unsigned int VDimension>
@@ -166,7 +173,10 @@ ParticleGeneralEntropyGradientFunction<VDimension>
     gradE[i] = m_PointsUpdate(k + i, d ); 
     }
 
-  if (idx == 0 ) std::cout << "maxdt= " << maxdt << " idx = " << idx << "\t" << "GradE = " << gradE << std::endl;
+  if (idx == 0 )
+    {
+    itkParticleLogMacro(Debug, "maxdt= " << maxdt << " idx = " << idx << "\t" << "GradE = " << gradE << "\n");
+    }
   return system->TransformVector(gradE, system->GetInverseTransform(d));
 }
 
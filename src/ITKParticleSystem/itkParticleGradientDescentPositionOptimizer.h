@@ -24,6 +24,8 @@
 #include "vnl/vnl_vector_fixed.h"
 #include "itkParticleVectorFunction.h"
 #include "itkParticleImageDomainWithGradients.h"
+#include "itkParticleImplicitSurfaceDomain.h"
+#include <typeinfo>
 
 namespace itk
 {
@@ -38,6 +40,13 @@ namespace itk
  * updates (each particle position is changed as soon as its new position is
  * computed).
  *
+ * The adaptive Gauss-Seidel mode can optionally keep an active set (see
+ * SetActiveSetTolerance).  A particle whose last two moves were both shorter
+ * than the tolerance is frozen and skipped, until either a periodic recheck
+ * iteration finds it moving again or a neighbor moves by more than the wake
+ * threshold.  A domain with no active particles is converged, and the
+ * optimization stops when every domain has converged at a recheck.
+ *
  */
 template <class TGradientNumericType, unsigned int VDimension>
 class ParticleGradientDescentPositionOptimizer : public Object
@@ -55,6 +64,10 @@ public:
 
   /** Type of the domain. */
   typedef ParticleImageDomainWithGradients<TGradientNumericType, VDimension> DomainType;
+
+  /** Type of the domain that the samplers create, whose constraints are
+      called directly rather than through the virtual interface. */
+  typedef ParticleImplicitSurfaceDomain<TGradientNumericType, VDimension> SurfaceDomainType;
   
   /** Run-time type information (and related methods). */
   itkTypeMacro(ParticleGradientDescentPositionOptimizer, Object);
@@ -74,9 +87,12 @@ public:
   /** Point Type */
   typedef typename ParticleSystemType::PointType PointType;
 
-  /** Start the optimization. */
+  /** Start the optimization.  Observers of the StartEvent are called
+      first, so that they can tell the optimization apart from the work
+      done before it. */
   void StartOptimization()
   {
+    this->InvokeEvent(itk::StartEvent());
     if (m_OptimizationMode == 0) { this->StartJacobiOptimization(); }
     else if (m_OptimizationMode == 2) { this->StartAdaptiveGaussSeidelOptimization();}
     else { this->StartGaussSeidelOptimization(); }
@@ -108,9 +124,48 @@ public:
   itkGetMacro(MaximumNumberOfIterations, unsigned int);
   itkSetMacro(MaximumNumberOfIterations, unsigned int);
 
+  /** Longest particle move in the last iteration.  Valid in observers of
+      the IterationEvent. */
+  itkGetMacro(MaximumMove, double);
+
+  /** Mean particle energy in the last iteration, before the particles
+      moved.  With an active set, frozen particles count with the energy of
+      their last evaluation, so the mean is always over every particle.  Only
+      computed by the adaptive Gauss-Seidel mode. */
+  itkGetMacro(AverageEnergy, double);
+
   /** Get/Set the precision of the solution. */
   itkGetMacro(Tolerance, double);
   itkSetMacro(Tolerance, double);
+
+  /** Get/Set the move length below which particles are frozen in the
+      adaptive Gauss-Seidel mode.  Zero (the default) turns the active set
+      off. */
+  itkGetMacro(ActiveSetTolerance, double);
+  itkSetMacro(ActiveSetTolerance, double);
+
+  /** Get/Set how often, in iterations, frozen particles are evaluated
+      anyway.  The default is 10. */
+  itkGetMacro(ActiveSetRecheckInterval, unsigned int);
+  itkSetMacro(ActiveSetRecheckInterval, unsigned int);
+
+  /** Get/Set the move length above which a particle wakes its frozen
+      neighbors.  Zero (the default) means ten times the active set
+      tolerance. */
+  itkGetMacro(ActiveSetWakeThreshold, double);
+  itkSetMacro(ActiveSetWakeThreshold, double);
+
+  /** Get/Set the radius of the neighborhood woken by a moving particle, in
+      multiples of the maximum move that the gradient function allows it.
+      The entropy functions allow a tenth of the kernel width, so the default
+      of 30 covers their neighborhoods. */
+  itkGetMacro(ActiveSetNeighborhoodFactor, double);
+  itkSetMacro(ActiveSetNeighborhoodFactor, double);
+
+  /** Number of particles of domain d that were active in the last
+      iteration, or all of them if the active set is off. */
+  unsigned long GetNumberOfActiveParticles(unsigned int d) const
+  { return d < m_NumberOfActiveParticles.size() ? m_NumberOfActiveParticles[d] : 0; }
   
   /** Get/Set the ParticleSystem modified by this optimizer. */
   itkGetObjectMacro(ParticleSystem, ParticleSystemType);
@@ -130,6 +185,38 @@ protected:
   }
   virtual ~ParticleGradientDescentPositionOptimizer() {};
 
+  /** A domain of the particle system, resolved once per domain per
+      iteration.  If the domain is exactly a SurfaceDomainType its constraints
+      are called through that type, so that they may be inlined into the
+      update loops; otherwise through the DomainType interface. */
+  struct ResolvedDomain
+  {
+    const DomainType *domain;
+    const SurfaceDomainType *surface;
+
+    ResolvedDomain(const ParticleDomain<VDimension> *d)
+    {
+      domain = dynamic_cast<const DomainType *>(d);
+      surface = 0;
+      if (domain != 0 && typeid(*domain) == typeid(SurfaceDomainType))
+        { surface = static_cast<const SurfaceDomainType *>(domain); }
+    }
+
+    inline bool ApplyConstraints(PointType &p) const
+    {
+      if (surface != 0) return surface->SurfaceDomainType::ApplyConstraints(p);
+      return domain->ApplyConstraints(p);
+    }
+
+    inline bool ApplyVectorConstraints(VectorType &gradE, const PointType &pos,
+                                       double maxtimestep) const
+    {
+      if (surface != 0)
+        return surface->SurfaceDomainType::ApplyVectorConstraints(gradE, pos, maxtimestep);
+      return domain->ApplyVectorConstraints(gradE, pos, maxtimestep);
+    }
+  };
+
 private:
   typename ParticleSystemType::Pointer m_ParticleSystem;
   typename GradientFunctionType::Pointer m_GradientFunction;
@@ -139,8 +226,20 @@ private:
   double m_Tolerance;
   double m_TimeStep;
   int m_OptimizationMode;
+  double m_ActiveSetTolerance;
+  unsigned int m_ActiveSetRecheckInterval;
+  double m_ActiveSetWakeThreshold;
+  double m_ActiveSetNeighborhoodFactor;
+  double m_MaximumMove;
+  double m_AverageEnergy;
 
   std::vector< std::vector<double> > m_TimeSteps;
+
+  /** Active set state, indexed by domain and particle index. */
+  std::vector< std::vector<double> > m_LastMoves;
+  std::vector< std::vector<double> > m_LastEnergies;
+  std::vector< std::vector<unsigned char> > m_Frozen;
+  std::vector<unsigned long> m_NumberOfActiveParticles;
   
 };
 
@@ -34,6 +34,12 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
   m_Tolerance = 0.0;
   m_TimeStep = 1.0;
   m_OptimizationMode = 0;
+  m_ActiveSetTolerance = 0.0;
+  m_ActiveSetRecheckInterval = 10;
+  m_ActiveSetWakeThreshold = 0.0;
+  m_ActiveSetNeighborhoodFactor = 30.0;
+  m_MaximumMove = 0.0;
+  m_AverageEnergy = 0.0;
 }
 
 
@@ -77,6 +83,23 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
 
   //  if (reset == true) m_GradientFunction->ResetBuffers();
   
+  // Every particle starts out active, since the energy may have changed
+  // since the last call.
+  const bool activeSet = m_ActiveSetTolerance > 0.0;
+  const double wakeThreshold = (m_ActiveSetWakeThreshold > 0.0) ?
+    m_ActiveSetWakeThreshold : 10.0 * m_ActiveSetTolerance;
+  m_LastMoves.resize(m_ParticleSystem->GetNumberOfDomains());
+  m_LastEnergies.resize(m_ParticleSystem->GetNumberOfDomains());
+  m_Frozen.resize(m_ParticleSystem->GetNumberOfDomains());
+  m_NumberOfActiveParticles.resize(m_ParticleSystem->GetNumberOfDomains());
+  for (unsigned int i = 0; i < m_ParticleSystem->GetNumberOfDomains(); i++)
+    {
+    unsigned int np = m_ParticleSystem->GetPositions(i)->GetSize();
+    m_LastMoves[i].assign(np, 1.0e30);
+    m_LastEnergies[i].assign(np, 0.0);
+    m_Frozen[i].assign(np, 0);
+    m_NumberOfActiveParticles[i] = np;
+    }
 
   unsigned int numdomains = m_ParticleSystem->GetNumberOfDomains();
   std::vector<double> meantime(numdomains);
@@ -92,7 +115,10 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     mintime[q]  = 1.0;
     }
 
-  double maxchange = 0.0;
+  // Longest move in each domain in the current iteration.
+  std::vector<double> maxchanges(numdomains);
+  std::vector<double> energies(numdomains);
+  std::vector<unsigned int> energycounts(numdomains);
   while (m_StopOptimization == false)
     {
       if (counter % global_iteration == 0)
@@ -102,6 +128,10 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
       }
       counter++;
 
+      // Frozen particles are evaluated anyway on recheck iterations.
+      const bool recheck = (activeSet == false || m_ActiveSetRecheckInterval <= 1
+                            || m_NumberOfIterations % m_ActiveSetRecheckInterval == 0);
+
 #pragma omp parallel
 {
 
@@ -121,6 +151,9 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
 
         //std::cerr << "[thread " << tid << "/" << num_threads << "] iterating on domain " << dom << "\n";
       meantime[dom] = 0.0;
+      maxchanges[dom] = 0.0;
+      energies[dom] = 0.0;
+      energycounts[dom] = 0;
       // skip any flagged domains
       if (m_ParticleSystem->GetDomainFlag(dom) == false)
         {
@@ -141,15 +174,26 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
 
         // Tell function which domain we are working on.
         localGradientFunction->SetDomainNumber(dom);
+        const ResolvedDomain domain(m_ParticleSystem->GetDomain(dom));
      
         // Iterate over each particle position
         unsigned int k = 0;
-        maxchange = 0.0;
+        unsigned int evaluated = 0;
+        double maxchange = 0.0;
+        std::vector<unsigned char> &frozen = m_Frozen[dom];
+        std::vector<double> &lastmoves = m_LastMoves[dom];
+        std::vector<double> &lastenergies = m_LastEnergies[dom];
         typename ParticleSystemType::PointContainerType::ConstIterator endit =
           m_ParticleSystem->GetPositions(dom)->GetEnd();
         for (typename ParticleSystemType::PointContainerType::ConstIterator it
                = m_ParticleSystem->GetPositions(dom)->GetBegin(); it != endit; it++, k++)
           {
+          const unsigned long idx = it.GetIndex();
+          if (activeSet == true && recheck == false && idx < frozen.size() && frozen[idx])
+            {
+            continue;
+            }
+          evaluated++;
           bool done = false;
 
           // Compute gradient update.
@@ -158,15 +202,16 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
           original_gradient = localGradientFunction->Evaluate(it.GetIndex(), dom, m_ParticleSystem,
                                                            maxdt, energy);
           PointType pt = *it;
+          energies[dom] += energy;
+          if (activeSet == true && idx < lastenergies.size()) lastenergies[idx] = energy;
 
           double newenergy, gradmag;
           while ( !done )
             {
             gradient = original_gradient * m_TimeSteps[dom][k];
 
-            dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))
-              ->ApplyVectorConstraints(gradient,
-                                       m_ParticleSystem->GetPosition(it.GetIndex(), dom), maxdt);
+            domain.ApplyVectorConstraints(gradient,
+                                          m_ParticleSystem->GetPosition(it.GetIndex(), dom), maxdt);
             gradmag = gradient.magnitude();
             
             // Prevent a move which is too large
@@ -179,7 +224,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
               // Make a move and compute new energy
               for (unsigned int i = 0; i < VDimension; i++)
                 {  newpoint[i] = pt[i] - gradient[i]; }
-              dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))->ApplyConstraints(newpoint);
+              domain.ApplyConstraints(newpoint);
               m_ParticleSystem->SetPosition(newpoint, it.GetIndex(), dom);
               newenergy = localGradientFunction->Energy(it.GetIndex(), dom, m_ParticleSystem);
               
@@ -195,7 +240,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
                 {// bad move, reset point position and back off on timestep            
                 if (m_TimeSteps[dom][k] > mintime[dom])
                   {
-                  dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))->ApplyConstraints(pt);
+                  domain.ApplyConstraints(pt);
                   m_ParticleSystem->SetPosition(pt, it.GetIndex(), dom);
 
                   m_TimeSteps[dom][k] /= factor;
@@ -210,20 +255,88 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
                 }
               }
             } // end while not done
+
+          if (activeSet == true && idx < frozen.size())
+            {
+            // Freeze after two short moves in a row.
+            frozen[idx] = (gradmag < m_ActiveSetTolerance
+                           && lastmoves[idx] < m_ActiveSetTolerance) ? 1 : 0;
+            lastmoves[idx] = gradmag;
+
+            // A long move changes the energy of the neighbors.
+            if (gradmag > wakeThreshold)
+              {
+              typename ParticleSystemType::PointVectorType neighbors =
+                m_ParticleSystem->FindNeighborhoodPoints(m_ParticleSystem->GetPosition(idx, dom),
+                                                         m_ActiveSetNeighborhoodFactor * maxdt, dom);
+              for (unsigned int n = 0; n < neighbors.size(); n++)
+                {
+                const unsigned long j = neighbors[n].Index;
+                if (j < frozen.size() && frozen[j])
+                  {
+                  frozen[j] = 0;
+                  lastmoves[j] = 1.0e30;
+                  }
+                }
+              }
+            }
           } // for each particle
-        
-        // Compute mean time step
-        meantime[dom] /= static_cast<double>(k);
 
-        if (meantime[dom] < 1.0) meantime[dom] = 1.0;
-        //        std::cout << "meantime = " << meantime[dom] << std::endl;
-        maxtime[dom] = meantime[dom] + meantime[dom] * 0.2;
-        mintime[dom] = meantime[dom] - meantime[dom] * 0.1;
+        if (activeSet == true)
+          {
+          unsigned long active = 0;
+          for (unsigned int j = 0; j < frozen.size(); j++)
+            {
+            if (frozen[j] == 0) active++;
+            }
+          m_NumberOfActiveParticles[dom] = active;
+
+          // Frozen particles keep the energy of their last evaluation, so the
+          // average energy is over the same particles in every iteration.
+          energies[dom] = 0.0;
+          for (unsigned int j = 0; j < lastenergies.size(); j++)
+            {
+            energies[dom] += lastenergies[j];
+            }
+          energycounts[dom] = lastenergies.size();
+          }
+        else
+          {
+          energycounts[dom] = evaluated;
+          }
+        
+        // Compute mean time step over the particles that moved
+        if (evaluated > 0)
+          {
+          meantime[dom] /= static_cast<double>(evaluated);
+
+          if (meantime[dom] < 1.0) meantime[dom] = 1.0;
+          //        std::cout << "meantime = " << meantime[dom] << std::endl;
+          maxtime[dom] = meantime[dom] + meantime[dom] * 0.2;
+          mintime[dom] = meantime[dom] - meantime[dom] * 0.1;
+          }
+        maxchanges[dom] = maxchange;
         } // if not flagged
       }// for each domain
     
 }
 
+    double maxchange = 0.0;
+    for (unsigned int q = 0; q < numdomains; q++)
+      {
+      if (maxchanges[q] > maxchange) maxchange = maxchanges[q];
+      }
+    m_MaximumMove = maxchange;
+
+    double energysum = 0.0;
+    unsigned int energycount = 0;
+    for (unsigned int q = 0; q < numdomains; q++)
+      {
+      energysum += energies[q];
+      energycount += energycounts[q];
+      }
+    m_AverageEnergy = (energycount > 0) ? energysum / energycount : 0.0;
+
     m_NumberOfIterations++;
     m_GradientFunction->AfterIteration();
     this->InvokeEvent(itk::IterationEvent());
@@ -237,6 +350,18 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
       {
       m_StopOptimization = true;
       }
+
+    // With an active set, stop once a recheck leaves every domain converged.
+    if (activeSet == true && recheck == true)
+      {
+      bool converged = true;
+      for (unsigned int q = 0; q < numdomains; q++)
+        {
+        if (m_ParticleSystem->GetDomainFlag(q) == false && m_NumberOfActiveParticles[q] > 0)
+          { converged = false; }
+        }
+      if (converged == true) m_StopOptimization = true;
+      }
     
     } // end while stop optimization
   
@@ -260,6 +385,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     {
     m_GradientFunction->BeforeIteration();
     double maxdt;
+    m_MaximumMove = 0.0;
     
     // Iterate over each domain
     for (unsigned int dom = 0; dom < m_ParticleSystem->GetNumberOfDomains(); dom++)
@@ -269,6 +395,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
         {
         // Tell function which domain we are working on.
         m_GradientFunction->SetDomainNumber(dom);
+        const ResolvedDomain domain(m_ParticleSystem->GetDomain(dom));
         
         // Iterate over each particle position
         unsigned int k = 0;
@@ -283,13 +410,14 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
                                                   maxdt);
           
           // May modify gradient
-          dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))
-            ->ApplyVectorConstraints(gradient,
-                                     m_ParticleSystem->GetPosition(it.GetIndex(), dom), maxdt);
+          domain.ApplyVectorConstraints(gradient,
+                                        m_ParticleSystem->GetPosition(it.GetIndex(), dom), maxdt);
           
           // Hack to avoid blowing up under certain conditions.
           if (gradient.magnitude() > maxdt)
             { gradient = (gradient / gradient.magnitude()) * maxdt; }
+          if (gradient.magnitude() * m_TimeStep > m_MaximumMove)
+            { m_MaximumMove = gradient.magnitude() * m_TimeStep; }
           
           // Compute particle move based on update.
            for (unsigned int i = 0; i < VDimension; i++)
@@ -298,7 +426,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
              }
            
            // Apply update
-           dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))->ApplyConstraints(newpoint);
+           domain.ApplyConstraints(newpoint);
            m_ParticleSystem->SetPosition(newpoint, it.GetIndex(), dom);
            } // for each particle
          } // if not flagged
@@ -345,6 +473,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
     {
     m_GradientFunction->BeforeIteration();
     double maxdt;
+    m_MaximumMove = 0.0;
     
     // Iterate over each domain
     for (unsigned int dom = 0; dom < m_ParticleSystem->GetNumberOfDomains(); dom++)
@@ -354,6 +483,7 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
         {
         // Tell function which domain we are working on.
         m_GradientFunction->SetDomainNumber(dom);
+        const ResolvedDomain domain(m_ParticleSystem->GetDomain(dom));
         
         // Iterate over each particle position
         unsigned int k = 0;
@@ -367,14 +497,15 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
           gradient = m_GradientFunction->Evaluate(it.GetIndex(), dom, m_ParticleSystem,
                                                   maxdt);
           // May modify gradient
-          dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))
-            ->ApplyVectorConstraints(gradient, m_ParticleSystem->GetPosition(it.GetIndex(), dom), maxdt);
+          domain.ApplyVectorConstraints(gradient, m_ParticleSystem->GetPosition(it.GetIndex(), dom), maxdt);
           
           // Hack to avoid blowing up under certain conditions.
           if (gradient.magnitude() > maxdt)
             {
             gradient = (gradient / gradient.magnitude()) * maxdt;
             }
+          if (gradient.magnitude() * m_TimeStep > m_MaximumMove)
+            { m_MaximumMove = gradient.magnitude() * m_TimeStep; }
           
           // Compute particle move based on update.
           for (unsigned int i = 0; i < VDimension; i++)
@@ -393,13 +524,14 @@ ParticleGradientDescentPositionOptimizer<TGradientNumericType, VDimension>
       // skip any flagged domains
       if (m_ParticleSystem->GetDomainFlag(dom) == false)
         {
+        const ResolvedDomain domain(m_ParticleSystem->GetDomain(dom));
         unsigned int k = 0;
         typename ParticleSystemType::PointContainerType::ConstIterator endit =
           m_ParticleSystem->GetPositions(dom)->GetEnd();
         for (typename ParticleSystemType::PointContainerType::ConstIterator it
                = m_ParticleSystem->GetPositions(dom)->GetBegin();  it != endit; it++, k++)
           {
-          dynamic_cast<DomainType *>(m_ParticleSystem->GetDomain(dom))->ApplyConstraints(updates[dom][k]);
+          domain.ApplyConstraints(updates[dom][k]);
           m_ParticleSystem->SetPosition(updates[dom][k], it.GetIndex(), dom);
           } // for each particle
         } // if not flagged
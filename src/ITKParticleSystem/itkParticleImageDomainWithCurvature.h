@@ -19,6 +19,7 @@
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkImageRegionIterator.h"
 #include "itkDiscreteGaussianImageFilter.h"
+#include "itkParticleDomainFieldCache.h"
 
 namespace itk
 {
@@ -49,6 +50,8 @@ public:
   typedef typename Superclass::ImageType ImageType;
   typedef typename Superclass::ScalarInterpolatorType ScalarInterpolatorType;
   typedef typename Superclass::VnlMatrixType VnlMatrixType;
+  typedef typename Superclass::GradientImageType GradientImageType;
+  typedef ParticleDomainFieldCache<ImageType, GradientImageType> FieldCacheType;
   
   /** Method for creation through the object factory. */
   itkNewMacro(Self);
@@ -63,10 +66,37 @@ public:
       modifies the parent class LowerBound and UpperBound. */
   void SetImage(ImageType *I)
   {
-    // Computes partial derivatives in parent class
-    Superclass::SetImage(I);
+    // If the fields for this image were computed by an earlier run, install
+    // them directly and skip all of the filtering below.
+    std::string cachefile;
+    if (m_FieldCacheDirectory != "")
+      {
+      cachefile = FieldCacheType::FileName(m_FieldCacheDirectory, I, this->GetSigma());
+
+      typename GradientImageType::Pointer gradient;
+      typename ImageType::Pointer curvature;
+      if (FieldCacheType::Read(cachefile, I, this->GetSigma(), gradient, curvature))
+        {
+        ParticleImageDomain<T, VDimension>::SetImage(I);
+        this->SetGradientImage(gradient);
+        m_CurvatureImage = curvature;
+        m_CurvatureInterpolator->SetInputImage(m_CurvatureImage);
+        return;
+        }
+      }
+
+    // Only the gradient is set up by the parent classes.  The Hessian is
+    // evaluated below, and only where the curvature is needed, instead of as
+    // six full partial derivative images.
+    ParticleImageDomainWithGradients<T, VDimension>::SetImage(I);
 
     typedef itk::DiscreteGaussianImageFilter<ImageType, ImageType> DiscreteGaussianImageFilterType;
+    typename DiscreteGaussianImageFilterType::Pointer gaussian = DiscreteGaussianImageFilterType::New();
+    gaussian->SetVariance(this->GetSigma() * this->GetSigma());
+    gaussian->SetInput(this->GetImage());
+    gaussian->SetUseImageSpacingOn();
+    gaussian->Update();
+
     typename DiscreteGaussianImageFilterType::Pointer f = DiscreteGaussianImageFilterType::New();
 
     double sig =  this->GetImage()->GetSpacing()[0] * 0.5;
@@ -81,28 +111,25 @@ public:
     // positive value to smooth the curvature calculations.
     m_CurvatureImage = f->GetOutput();
     
-    // Loop through the image and compute all curvature values
-    itk::ImageRegionIteratorWithIndex<ImageType> it(f->GetOutput(),
-                                                    f->GetOutput()->GetRequestedRegion());
-    itk::ImageRegionIterator<ImageType> oit(m_CurvatureImage, f->GetOutput()->GetRequestedRegion());
+    // Compute all curvature values in a narrow band, in place.
+    this->ComputeNarrowBandCurvature(gaussian->GetOutput(), m_CurvatureImage);
     
-    for (; !it.IsAtEnd(); ++it, ++oit)
+    m_CurvatureInterpolator->SetInputImage(m_CurvatureImage);
+
+    if (cachefile != "")
       {
-      // Only compute in a narrow band.
-      if (it.Get() < 4.0 && it.Get() > -4.0)
-        {      
-         PointType pos;
-         this->GetImage()->TransformIndexToPhysicalPoint(it.GetIndex(), pos);
-         oit.Set(this->MeanCurvature(pos));
-        }
-      else oit.Set(1.0e-6);
+      FieldCacheType::Write(cachefile, I, this->GetSigma(),
+                            this->GetGradientImage(), m_CurvatureImage);
       }
-    
-    // Release the memory in the parent hessian images.
-    this->DeletePartialDerivativeImages();
-    
-    m_CurvatureInterpolator->SetInputImage(m_CurvatureImage);
   } // end setimage
+
+  /** Directory in which the gradient and curvature images are cached between
+      runs.  Empty (the default) disables the cache.  Must be set before
+      SetImage. */
+  void SetFieldCacheDirectory(const std::string &dir)
+  { m_FieldCacheDirectory = dir; }
+  const std::string &GetFieldCacheDirectory() const
+  { return m_FieldCacheDirectory; }
   
   double GetCurvature(const PointType &pos) const
   {
@@ -125,20 +152,97 @@ protected:
   }
   virtual ~ParticleImageDomainWithCurvature() {};
 
+  /** Replaces each voxel of band with its mean curvature if the voxel value
+      is inside the narrow band |phi| < 4, and with 1.0e-6 otherwise.  The
+      Hessian of each band voxel is taken directly from smoothed with the
+      central difference stencils that DerivativeImageFilter applies (indices
+      are clamped at the image boundary), and the normal from the gradient
+      image, so no partial derivative images or interpolators are needed. */
+  void ComputeNarrowBandCurvature(const ImageType *smoothed, ImageType *band)
+  {
+    const typename ImageType::RegionType region = band->GetBufferedRegion();
+    const typename ImageType::RegionType sregion = smoothed->GetBufferedRegion();
+    const OffsetValueType *strides = smoothed->GetOffsetTable();
+    const GradientImageType *gradient = this->GetGradientImage();
+    const T *s = smoothed->GetBufferPointer();
+    T *out = band->GetBufferPointer();
+
+    double h[VDimension];
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      h[i] = smoothed->GetSpacing()[i];
+      }
+
+    const long num_voxels = static_cast<long>(region.GetNumberOfPixels());
+#pragma omp parallel for schedule(dynamic, 4096)
+    for (long v = 0; v < num_voxels; v++)
+      {
+      const T phi = out[v];
+      if ( !(phi < 4.0 && phi > -4.0) )
+        {
+        out[v] = 1.0e-6;
+        continue;
+        }
+
+      typename ImageType::IndexType idx;
+      long r = v;
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        idx[i] = region.GetIndex()[i] + r % static_cast<long>(region.GetSize()[i]);
+        r /= static_cast<long>(region.GetSize()[i]);
+        }
+
+      // Offsets to the neighbors on either side along each axis.
+      const OffsetValueType c = smoothed->ComputeOffset(idx);
+      OffsetValueType lo[VDimension];
+      OffsetValueType hi[VDimension];
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        const IndexValueType first = sregion.GetIndex()[i];
+        const IndexValueType last = first + static_cast<IndexValueType>(sregion.GetSize()[i]) - 1;
+        lo[i] = (idx[i] > first) ? -strides[i] : 0;
+        hi[i] = (idx[i] < last) ? strides[i] : 0;
+        }
+
+      VnlMatrixType H;
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        H[i][i] = (s[c + hi[i]] - 2.0 * s[c] + s[c + lo[i]]) / (h[i] * h[i]);
+        for (unsigned int j = i + 1; j < VDimension; j++)
+          {
+          H[i][j] = H[j][i] = (s[c + hi[i] + hi[j]] - s[c + hi[i] + lo[j]]
+                               - s[c + lo[i] + hi[j]] + s[c + lo[i] + lo[j]])
+            / (4.0 * h[i] * h[j]);
+          }
+        }
+
+      // Same normalization as SampleNormalVnl(pos, 1.0e-6).
+      typename Superclass::VnlVectorType normal(gradient->GetPixel(idx).GetDataPointer());
+      const double q = 1.0 / (normal.magnitude() + 1.0e-6);
+      for (unsigned int i = 0; i < VDimension; i++) { normal[i] *= q; }
+
+      out[v] = this->MeanCurvature(normal, H);
+      }
+  }
+
+  /** The Hessian images are not computed (see ComputeNarrowBandCurvature),
+      so the curvature at an arbitrary position is interpolated from the
+      narrow band curvature image. */
   double MeanCurvature(const PointType& pos)
+  {
+    return this->GetCurvature(pos);
+  }
+
+  double MeanCurvature(const typename Superclass::VnlVectorType &posnormal,
+                       const VnlMatrixType &H) const
   {
     // See Kindlmann paper "Curvature-Based Transfer Functions for Direct Volume
     // Rendering..." for detailss
     
-    // Get the normal vector associated with this position.
-    //VnlVectorType posnormal = this->SampleNormalVnl(pos, 1.0e-10);
-    typename Superclass::VnlVectorType posnormal = this->SampleNormalVnl(pos, 1.0e-6);
-
-    // Sample the Hessian for this point and compute gradient of the normal.
+    // Compute gradient of the normal.
     typename Superclass::VnlMatrixType I;
     I.set_identity();
     
-    typename Superclass::VnlMatrixType H = this->SampleHessianVnl(pos);
     typename Superclass::VnlMatrixType P = I - outer_product(posnormal, posnormal);
     typename Superclass::VnlMatrixType G = P.transpose() * H * P;
   
@@ -180,6 +284,7 @@ private:
   // Curvature values are stored in an image
   typename ImageType::Pointer m_CurvatureImage;
   typename ScalarInterpolatorType::Pointer m_CurvatureInterpolator;
+  std::string m_FieldCacheDirectory;
 };
 
 } // end namespace itk
@@ -21,6 +21,8 @@
 #include "itkVectorLinearInterpolateImageFunction.h"
 #include "itkGradientImageFilter.h"
 #include "itkFixedArray.h"
+#include "itkContinuousIndex.h"
+#include "vnl/vnl_math.h"
 
 namespace itk
 {
@@ -78,9 +80,7 @@ public:
     filter->SetInput(I);
     filter->SetUseImageSpacingOn();
     filter->Update();
-    m_GradientImage = filter->GetOutput();
-    
-    m_GradientInterpolator->SetInputImage(m_GradientImage);
+    this->SetGradientImage(filter->GetOutput());
   }
   itkGetObjectMacro(GradientImage, GradientImageType);
 
@@ -100,6 +100,85 @@ public:
     for (unsigned int i = 0; i < VDimension; i++) { grad[i] *= q; }
     return grad;
   }
+
+  /** Sample the image value and gradient at a point in one pass.  The result
+      is the same as calling Sample(p) and SampleGradientVnl(p), but the
+      trilinear weights and the 2^VDimension voxel offsets are computed once
+      and used for both images, instead of once in each ITK interpolator.
+      This method performs no bounds checking. */
+  inline void SampleValueAndGradientVnl(const PointType &p, T &value,
+                                        VnlVectorType &grad) const
+  {
+    if (m_FusedSampling == false)
+      {
+      value = this->Sample(p);
+      grad = this->SampleGradientVnl(p);
+      return;
+      }
+
+    const ImageType *image = this->GetImage();
+    ContinuousIndex<double, VDimension> cidx;
+    image->TransformPhysicalPointToContinuousIndex(p, cidx);
+
+    // Lower and upper voxel offset and fractional weight along each axis.
+    // Indices are clamped to the buffer the same way LinearInterpolateImageFunction
+    // clamps them, so that samples on the last slice reuse that slice.
+    const typename ImageType::RegionType &region = image->GetBufferedRegion();
+    const OffsetValueType *strides = image->GetOffsetTable();
+    OffsetValueType lower[VDimension];
+    OffsetValueType upper[VDimension];
+    double frac[VDimension];
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      const IndexValueType last = static_cast<IndexValueType>(region.GetSize()[i]) - 1;
+      const double x = cidx[i] - static_cast<double>(region.GetIndex()[i]);
+      IndexValueType b = static_cast<IndexValueType>(vcl_floor(x));
+      if (b < 0)
+        {
+        b = 0;
+        frac[i] = 0.0;
+        }
+      else if (b >= last)
+        {
+        b = last;
+        frac[i] = 0.0;
+        }
+      else
+        {
+        frac[i] = x - static_cast<double>(b);
+        }
+      lower[i] = b * strides[i];
+      upper[i] = (b < last ? b + 1 : last) * strides[i];
+      }
+
+    const T *values = image->GetBufferPointer();
+    const typename GradientImageType::PixelType *grads = m_GradientImage->GetBufferPointer();
+
+    double v = 0.0;
+    double g[VDimension];
+    for (unsigned int i = 0; i < VDimension; i++) { g[i] = 0.0; }
+
+    for (unsigned int c = 0; c < (1u << VDimension); c++)
+      {
+      double w = 1.0;
+      OffsetValueType off = 0;
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        if (c & (1u << i)) { w *= frac[i];       off += upper[i]; }
+        else               { w *= 1.0 - frac[i]; off += lower[i]; }
+        }
+      if (w == 0.0) continue;
+
+      v += w * static_cast<double>(values[off]);
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        g[i] += w * static_cast<double>(grads[off][i]);
+        }
+      }
+
+    value = static_cast<T>(v);
+    for (unsigned int i = 0; i < VDimension; i++) { grad[i] = static_cast<T>(g[i]); }
+  }
   
   /** Allow public access to the scalar interpolator. */
   itkGetObjectMacro(GradientInterpolator, GradientInterpolatorType);
@@ -128,7 +207,7 @@ public:
   }
   
 protected:
-  ParticleImageDomainWithGradients()
+  ParticleImageDomainWithGradients() : m_FusedSampling(false)
   {
     m_GradientInterpolator = GradientInterpolatorType::New();
   }
@@ -140,6 +219,18 @@ protected:
     os << indent << "m_GradientInterpolator = " << m_GradientInterpolator << std::endl;
   }
   virtual ~ParticleImageDomainWithGradients() {};
+
+  /** Install the gradient of the current image, e.g. one computed earlier
+      and read back from a cache, in place of running the gradient filter. */
+  void SetGradientImage(GradientImageType *G)
+  {
+    m_GradientImage = G;
+    m_GradientInterpolator->SetInputImage(m_GradientImage);
+
+    // The fused sampler walks both buffers with the same offsets.
+    m_FusedSampling = (m_GradientImage->GetBufferedRegion()
+                       == this->GetImage()->GetBufferedRegion());
+  }
   
 private:
   ParticleImageDomainWithGradients(const Self&); //purposely not implemented
@@ -147,6 +238,7 @@ private:
 
   typename GradientImageType::Pointer m_GradientImage;
   typename GradientInterpolatorType::Pointer m_GradientInterpolator;
+  bool m_FusedSampling;
 };
 
 } // end namespace itk
@@ -72,6 +72,11 @@ public:
       differences in the input and output points. */
   virtual bool ApplyConstraints(PointType &p) const;
 
+  /** Project a list of points onto the surface.  Each point is treated
+      exactly as in ApplyConstraints(p); the projections are independent, so
+      the list is processed in parallel when built with SW_USE_OPENMP. */
+  virtual bool ApplyConstraintsToList(std::vector<PointType> &points) const;
+
   /** Optionally add a repulsion from a planar boundar specified in
       m_CuttingPlane */
   virtual bool ApplyVectorConstraints(vnl_vector_fixed<double, VDimension> &gradE,
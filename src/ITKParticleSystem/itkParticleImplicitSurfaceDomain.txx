@@ -143,14 +143,18 @@ ParticleImplicitSurfaceDomain<T, VDimension>::ApplyConstraints(PointType &p) con
     double mult = 1.0;
     
     const T epsilon = m_Tolerance * 0.001;
-    T f = this->Sample(p);
+
+    // Value and gradient come from one trilinear stencil.  The gradient is
+    // only used if the loop is entered, and is then the gradient at the
+    // current p, exactly as if it had been sampled at the top of the loop.
+    T f;
+    typename Superclass::VnlVectorType grad;
+    this->SampleValueAndGradientVnl(p, f, grad);
     
     T gradmag = 1.0;
     while ( fabs(f) > (m_Tolerance * mult) || gradmag < epsilon)
       //  while ( fabs(f) > m_Tolerance || gradmag < epsilon)
       {
-      vnl_vector_fixed<T, VDimension> grad = this->SampleGradientVnl(p);
-      
       gradmag = grad.magnitude();
       vnl_vector_fixed<T, VDimension> vec   =  grad  * ( f / (gradmag + epsilon) );
       for (unsigned int i = 0; i < VDimension; i++)
@@ -165,7 +169,7 @@ ParticleImplicitSurfaceDomain<T, VDimension>::ApplyConstraints(PointType &p) con
         }
 #endif  
       
-      f = this->Sample(p);
+      this->SampleValueAndGradientVnl(p, f, grad);
       
 #ifdef  PARTICLE_DEBUG_FLAG
       if ( gradmag < epsilon && fabs(f) > m_Tolerance)
@@ -187,6 +191,43 @@ ParticleImplicitSurfaceDomain<T, VDimension>::ApplyConstraints(PointType &p) con
   return flag; 
 }
 
+template<class T, unsigned int VDimension>
+bool
+ParticleImplicitSurfaceDomain<T, VDimension>
+::ApplyConstraintsToList(std::vector<PointType> &points) const
+{
+  const int n = static_cast<int>(points.size());
+  int modified = 0;
+
+  // Exceptions may not leave an OpenMP region, so the first one is held and
+  // rethrown once all threads are done.
+  bool failed = false;
+  ExceptionObject error;
+
+#pragma omp parallel for schedule(dynamic, 16) reduction(+:modified)
+  for (int i = 0; i < n; i++)
+    {
+    try
+      {
+      if (this->ApplyConstraints(points[i]) == true) modified++;
+      }
+    catch (ExceptionObject &e)
+      {
+#pragma omp critical
+      {
+      if (failed == false)
+        {
+        failed = true;
+        error = e;
+        }
+      }
+      }
+    }
+
+  if (failed == true) throw error;
+  return modified > 0;
+}
+
 template <class T, unsigned int VDimension>
 double
 ParticleImplicitSurfaceDomain<T, VDimension>::Distance(const PointType &a, const PointType &b) const
@@ -0,0 +1,210 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleLog.cxx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#include "itkParticleLog.h"
+#include "itkConditionVariable.h"
+#include "itkMutexLock.h"
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace itk {
+
+int ParticleLog::m_Level = ParticleLog::Iterations;
+
+namespace {
+
+typedef std::vector< std::pair<int, std::string> > MessageQueue;
+
+/** State shared by the logging threads and the writer.  All members but the
+    thread objects are guarded by the mutex.  The destructor stops a writer
+    that is still running at exit, so nothing queued is lost. */
+struct ParticleLogState
+{
+  ParticleLogState() : Running(false), Stop(false), Busy(false), ThreadID(0) {}
+  ~ParticleLogState();
+
+  SimpleMutexLock Mutex;
+  ConditionVariable::Pointer Pending;  // the queue is not empty, or Stop
+  ConditionVariable::Pointer Drained;  // the writer finished a batch
+  MultiThreader::Pointer Threader;
+  MessageQueue Queue;
+  bool Running;
+  bool Stop;
+  bool Busy;
+  ThreadIdType ThreadID;
+};
+
+ParticleLogState g_State;
+
+void WriteMessages(const MessageQueue &messages)
+{
+  bool out = false;
+  bool err = false;
+  for (unsigned int i = 0; i < messages.size(); i++)
+    {
+    if (messages[i].first == ParticleLog::Errors)
+      {
+      std::cerr << messages[i].second;
+      err = true;
+      }
+    else
+      {
+      std::cout << messages[i].second;
+      out = true;
+      }
+    }
+  if (out) std::cout.flush();
+  if (err) std::cerr.flush();
+}
+
+ParticleLogState::~ParticleLogState()
+{
+  ParticleLog::SetAsynchronous(false);
+}
+
+} // end anonymous namespace
+
+void ParticleLog::SetLevel(int level)
+{
+  if (level < Quiet) level = Quiet;
+  if (level > Debug) level = Debug;
+  m_Level = level;
+}
+
+void ParticleLog::Write(int level, const std::string &message)
+{
+  g_State.Mutex.Lock();
+  if (g_State.Running && g_State.Stop == false && level == ParticleLog::Errors)
+    {
+    // Errors are written before returning, as they often precede an
+    // exception or exit, but still after everything queued before them.
+    while (g_State.Queue.empty() == false || g_State.Busy)
+      {
+      g_State.Drained->Wait(&g_State.Mutex);
+      }
+    WriteMessages(MessageQueue(1, std::make_pair(level, message)));
+    }
+  else if (g_State.Running)
+    {
+    g_State.Queue.push_back(std::make_pair(level, message));
+    g_State.Pending->Signal();
+    }
+  else
+    {
+    // Written under the lock so that messages from different threads do not
+    // interleave.
+    WriteMessages(MessageQueue(1, std::make_pair(level, message)));
+    }
+  g_State.Mutex.Unlock();
+}
+
+ITK_THREAD_RETURN_TYPE ParticleLog::WriterThread(void *)
+{
+  MessageQueue batch;
+  g_State.Mutex.Lock();
+  while (true)
+    {
+    while (g_State.Queue.empty() && g_State.Stop == false)
+      {
+      g_State.Pending->Wait(&g_State.Mutex);
+      }
+    if (g_State.Queue.empty()) break; // Stop, and nothing left to write
+
+    // Take the whole queue, so that loggers are only held up for a swap.
+    batch.swap(g_State.Queue);
+    g_State.Busy = true;
+    g_State.Mutex.Unlock();
+
+    WriteMessages(batch);
+    batch.clear();
+
+    g_State.Mutex.Lock();
+    g_State.Busy = false;
+    g_State.Drained->Broadcast();
+    }
+  g_State.Mutex.Unlock();
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+void ParticleLog::SetAsynchronous(bool a)
+{
+  if (a == true)
+    {
+    g_State.Mutex.Lock();
+    const bool running = g_State.Running;
+    if (running == false)
+      {
+      if (g_State.Threader.IsNull())
+        {
+        g_State.Pending = ConditionVariable::New();
+        g_State.Drained = ConditionVariable::New();
+        g_State.Threader = MultiThreader::New();
+        }
+      g_State.Stop = false;
+      g_State.Running = true;
+      }
+    g_State.Mutex.Unlock();
+
+    if (running == false)
+      {
+      g_State.ThreadID = g_State.Threader->SpawnThread(&ParticleLog::WriterThread, 0);
+      }
+    }
+  else
+    {
+    g_State.Mutex.Lock();
+    const bool running = g_State.Running;
+    if (running == true)
+      {
+      g_State.Stop = true;
+      g_State.Pending->Signal();
+      }
+    g_State.Mutex.Unlock();
+
+    if (running == true)
+      {
+      // The writer drains the queue before it returns.  Anything logged
+      // between its last batch and the join is written here.
+      g_State.Threader->TerminateThread(g_State.ThreadID);
+      g_State.Mutex.Lock();
+      WriteMessages(g_State.Queue);
+      g_State.Queue.clear();
+      g_State.Running = false;
+      g_State.Stop = false;
+      g_State.Drained->Broadcast();
+      g_State.Mutex.Unlock();
+      }
+    }
+}
+
+bool ParticleLog::GetAsynchronous()
+{
+  g_State.Mutex.Lock();
+  const bool running = g_State.Running;
+  g_State.Mutex.Unlock();
+  return running;
+}
+
+void ParticleLog::Flush()
+{
+  g_State.Mutex.Lock();
+  while (g_State.Running && (g_State.Queue.empty() == false || g_State.Busy))
+    {
+    g_State.Drained->Wait(&g_State.Mutex);
+    }
+  std::cout.flush();
+  std::cerr.flush();
+  g_State.Mutex.Unlock();
+}
+
+} // end namespace itk
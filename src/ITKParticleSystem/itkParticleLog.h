@@ -0,0 +1,91 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleLog.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleLog_h
+#define __itkParticleLog_h
+
+#include "itkMultiThreader.h"
+#include <sstream>
+#include <string>
+
+namespace itk
+{
+/** \class ParticleLog
+ *
+ * Process-wide diagnostic output for the particle system and the
+ * applications built on it.  Every message has a level, and only messages at
+ * or below the current level are formatted at all (see itkParticleLogMacro),
+ * so disabled output costs one integer comparison.  Errors go to std::cerr,
+ * everything else to std::cout.
+ *
+ *   Quiet       nothing
+ *   Errors      failures only
+ *   Info        setup and stage summaries
+ *   Iterations  one line (or progress mark) per optimizer iteration (default)
+ *   Debug       per-recompute detail such as covariance eigenvalue dumps
+ *
+ * By default messages are written (and flushed) as they are logged, by the
+ * calling thread.  With SetAsynchronous(true) they are queued instead and a
+ * background thread writes them in batches, flushing once per batch, so the
+ * optimizer never waits on the terminal.  Message order is preserved, and
+ * Errors are still written before Write returns.  Call Flush before mixing
+ * in direct writes to the streams, and SetAsynchronous(false) before exit to
+ * drain the queue and stop the writer.
+ */
+class ParticleLog
+{
+public:
+  enum Level { Quiet = 0, Errors = 1, Info = 2, Iterations = 3, Debug = 4 };
+
+  /** Messages with a level above this one are dropped. */
+  static void SetLevel(int level);
+  static int GetLevel()
+  { return m_Level; }
+
+  /** True if messages of the given level would be written. */
+  static bool Enabled(int level)
+  { return level <= m_Level && level > Quiet; }
+
+  /** Writes (or queues) a message.  The message is written as is, so it
+      should carry its own line break. */
+  static void Write(int level, const std::string &message);
+
+  /** Starts or stops the background writer.  Stopping it writes out anything
+      still queued first. */
+  static void SetAsynchronous(bool a);
+  static bool GetAsynchronous();
+
+  /** Blocks until every message logged so far has been written and flushed. */
+  static void Flush();
+
+private:
+  static ITK_THREAD_RETURN_TYPE WriterThread(void *);
+
+  static int m_Level;
+};
+
+} // end namespace itk
+
+/** Logs the streamed expression x at the given ParticleLog level, e.g.
+      itkParticleLogMacro(Debug, "mode " << i << " : " << v << std::endl);
+    The expression is only evaluated if the level is enabled. */
+#define itkParticleLogMacro(level, x)                                   \
+  {                                                                     \
+  if (::itk::ParticleLog::Enabled(::itk::ParticleLog::level))           \
+    {                                                                   \
+    std::ostringstream itkParticleLogStream;                            \
+    itkParticleLogStream << x;                                          \
+    ::itk::ParticleLog::Write(::itk::ParticleLog::level,                \
+                              itkParticleLogStream.str());              \
+    }                                                                   \
+  }
+
+#endif
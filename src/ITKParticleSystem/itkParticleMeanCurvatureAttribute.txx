@@ -14,6 +14,7 @@
 =========================================================================*/
 #include "itkZeroCrossingImageFilter.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkParticleLog.h"
 
 namespace itk
 {
@@ -77,8 +78,8 @@ ComputeCurvatureStatistics(const ParticleSystemType *system, unsigned int d)
     }
   m_CurvatureStandardDeviationList[d] = sqrt(m_CurvatureStandardDeviationList[d] / (n-1));
   
-  std::cout << "Mean curvature magnitude = " << m_MeanCurvatureList[d] << std::endl;
-  std::cout << "Std deviation = " << m_CurvatureStandardDeviationList[d] << std::endl;
+  itkParticleLogMacro(Info, "Mean curvature magnitude = " << m_MeanCurvatureList[d] << "\n"
+                      << "Std deviation = " << m_CurvatureStandardDeviationList[d] << "\n");
 }
 
 } // end namespace itk
@@ -92,6 +92,22 @@ public:
     return 0;
   }
 
+  /** These methods find the neighbors of the particle with index idx, whose
+      current position is center.  Subclasses may use the index to cache
+      neighbor lists between calls; the default implementation simply finds
+      the neighbors of center. */
+  virtual PointVectorType FindNeighborhoodPoints(unsigned int, const PointType &center,
+                                                 double radius) const
+  {
+    return this->FindNeighborhoodPoints(center, radius);
+  }
+  virtual PointVectorType FindNeighborhoodPoints(unsigned int, const PointType &center,
+                                                 std::vector<double> &weights,
+                                                 double radius) const
+  {
+    return this->FindNeighborhoodPoints(center, weights, radius);
+  }
+
   /** Set the Domain that this neighborhood will use.  The Domain object is
       important because it defines bounds and distance measures. */
   itkSetObjectMacro(Domain, DomainType);
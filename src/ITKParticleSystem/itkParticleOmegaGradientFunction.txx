@@ -204,7 +204,7 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
   }
 
   // Get the neighborhood surrounding the point "pos".
-  m_CurrentNeighborhood = system->FindNeighborhoodPoints(pos, m_CurrentWeights,
+  m_CurrentNeighborhood = system->FindNeighborhoodPoints(idx, m_CurrentWeights,
                                                          neighborhood_radius, d);
   // Add the closest point on the plane as another neighbor.
   // See http://mathworld.wolfram.com/Point-PlaneDistance.html, for example
@@ -282,7 +282,7 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
       m_CurrentSigma = neighborhood_radius / this->GetNeighborhoodToSigmaRatio();
     }
 
-    m_CurrentNeighborhood = system->FindNeighborhoodPoints( pos, m_CurrentWeights,
+    m_CurrentNeighborhood = system->FindNeighborhoodPoints( idx, m_CurrentWeights,
                                                             neighborhood_radius, d );
 
 
@@ -311,7 +311,7 @@ ParticleOmegaGradientFunction<TGradientNumericType, VDimension>
   {
     m_CurrentSigma = this->GetMaximumNeighborhoodRadius() / this->GetNeighborhoodToSigmaRatio();
     neighborhood_radius = this->GetMaximumNeighborhoodRadius();
-    m_CurrentNeighborhood = system->FindNeighborhoodPoints( pos, m_CurrentWeights,
+    m_CurrentNeighborhood = system->FindNeighborhoodPoints( idx, m_CurrentWeights,
                                                             neighborhood_radius, d );
 
     // AKM : Cutting Plane Disabled
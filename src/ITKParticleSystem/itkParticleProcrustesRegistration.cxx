@@ -13,7 +13,10 @@
      PURPOSE.  See the above copyright notices for more information.
 =========================================================================*/
 #include "itkParticleProcrustesRegistration.h"
+#include "itkParticleLog.h"
 #include "Procrustes3D.h"
+#include "vnl/algo/vnl_determinant.h"
+#include <cmath>
 
 namespace itk {
 
@@ -45,8 +48,39 @@ ParticleProcrustesRegistration<3>::RunRegistration(int d)
     shapelist.push_back(shapevector);
     }
 
+  // Warm start from the rotations and scales currently in the particle
+  // system, i.e. the previous registration, if they are valid similarities.
+  Procrustes3D::SimilarityTransformListType transforms(numShapes);
+  for (int i = 0, k = d % m_DomainsPerShape; i < numShapes; i++, k += m_DomainsPerShape)
+    {
+    const ParticleSystemType::TransformType &T = m_ParticleSystem->GetTransform(k);
+    vnl_matrix_fixed<double, 3, 3> M;
+    for (unsigned int r = 0; r < 3; r++)
+      {
+      for (unsigned int c = 0; c < 3; c++)
+        {
+        M(r, c) = T(r, c);
+        }
+      }
+
+    const double det = vnl_determinant(M);
+    transforms[i].translation.fill(0.0);
+    transforms[i].rotation.set_identity();
+    transforms[i].scale = 1.0;
+    if (det > 1.0e-12)
+      {
+      const double s = pow(det, 1.0 / 3.0);
+      const vnl_matrix_fixed<double, 3, 3> R = M / s;
+      if ((R.transpose() * R - vnl_matrix_fixed<double, 3, 3>().set_identity())
+          .frobenius_norm() < 1.0e-6)
+        {
+        transforms[i].rotation = R;
+        transforms[i].scale = s;
+        }
+      }
+    }
+
   // Run alignment
-  Procrustes3D::SimilarityTransformListType transforms;
   Procrustes3D procrustes;
   procrustes.AlignShapes(transforms, shapelist);
 
@@ -63,7 +97,7 @@ ParticleProcrustesRegistration<3>::RunRegistration(int d)
       if (m_FixedScales.size() != 0)
         {
         transforms[i].scale = m_FixedScales[i];
-        std::cout << "Fixed scale " << i << " = " << m_FixedScales[i] << std::endl;
+        itkParticleLogMacro(Debug, "Fixed scale " << i << " = " << m_FixedScales[i] << "\n");
         }
       else // otherwise do not scale at all
         {
@@ -132,8 +166,7 @@ ParticleProcrustesRegistration<3>::RunRegistration(int d)
     m_ParticleSystem->SetTransform(k, R);
 
 
-    std::cout << R << std::endl;
-    std::cout << std::endl;
+    itkParticleLogMacro(Debug, R << "\n\n");
     
     }  
 }
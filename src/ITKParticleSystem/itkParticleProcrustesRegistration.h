@@ -19,6 +19,7 @@
 #include "itkWeakPointer.h"
 #include "vnl/vnl_matrix.h"
 #include "itkParticleSystem.h"
+#include "itkParticleLog.h"
 
 namespace itk
 {
@@ -71,7 +72,7 @@ public:
   void RunRegistration(int i);
   void RunRegistration()
   {
-    std::cerr << "\nRunning Procrustes Registration\n";
+    itkParticleLogMacro(Iterations, "\nRunning Procrustes Registration\n");
     for (int i =0; i < m_DomainsPerShape; i++)
       {
       this->RunRegistration(i);
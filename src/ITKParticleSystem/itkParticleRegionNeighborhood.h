@@ -17,6 +17,7 @@
 
 #include "itkParticleNeighborhood.h"
 #include "itkPowerOfTwoPointTree.h"
+#include <vector>
 
 namespace itk
 {
@@ -27,6 +28,18 @@ namespace itk
  * that provides bounds information and a distance metric.  This class uses a
  * PowerOfTwoPointTree to cache point and index values so that
  * FindNeighborhoodPoints is somewhat optimized. 
+ *
+ * With a positive VerletSkin, the particle-indexed FindNeighborhoodPoints
+ * also keeps a Verlet neighbor list for each particle: the particles within
+ * radius + skin of it, found in the tree once and then only scanned with a
+ * distance filter.  Distances for the lists are measured between reference
+ * positions, which are taken for all particles at once.  As long as no
+ * particle has moved more than half the skin from its reference position, a
+ * list of radius R holds every current neighbor within R - skin, so it serves
+ * any query radius up to that.  A larger query radius rebuilds the
+ * list, and a longer move, or any added or removed particle (e.g. a split),
+ * drops all lists and retakes the reference positions.  The cached lists are
+ * not thread safe, so one neighborhood must not be queried concurrently.
  */
 template <unsigned int VDimension=3>
 class ITK_EXPORT ParticleRegionNeighborhood : public ParticleNeighborhood<VDimension>
@@ -63,6 +76,21 @@ public:
   virtual PointVectorType FindNeighborhoodPoints(const PointType &, double) const;
   //  virtual unsigned int  FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
 
+  /** Compile a list of the points within a specified radius of the particle
+      with index idx, whose current position is center.  This uses the Verlet
+      list of the particle if VerletSkin is positive. */
+  virtual PointVectorType FindNeighborhoodPoints(unsigned int idx, const PointType &center,
+                                                 double radius) const;
+
+  /** Set/Get the skin added to the query radius for the Verlet neighbor
+      lists.  0 (the default) disables the lists. */
+  void SetVerletSkin(double s)
+  {
+    m_VerletSkin = s;
+    m_VerletStale = true;
+  }
+  itkGetConstMacro(VerletSkin, double);
+
   /** Override SetDomain so that we can grab the region extent info and
       construct our tree. */
   virtual void SetDomain( DomainType *p);
@@ -74,6 +102,7 @@ public:
   void PrintSelf(std::ostream& os, Indent indent) const
   {
     os << indent << "m_TreeLevels = " << m_TreeLevels << std::endl;
+    os << indent << "m_VerletSkin = " << m_VerletSkin << std::endl;
     m_Tree->PrintSelf(os, indent);
     Superclass::PrintSelf(os, indent);
   }
@@ -88,7 +117,7 @@ public:
   virtual void RemovePosition(unsigned int idx, int threadId = 0);
 
 protected:
-  ParticleRegionNeighborhood() : m_TreeLevels(3)
+  ParticleRegionNeighborhood() : m_TreeLevels(3), m_VerletSkin(0.0), m_VerletStale(true)
   {
     m_Tree = PointTreeType::New();
     m_IteratorMap = IteratorMapType::New();
@@ -126,11 +155,42 @@ protected:
   
   typedef ParticleContainer<IteratorNodePair> IteratorMapType;
 
+  /** Verlet neighbor list of one particle.  Radius is the distance, between
+      reference positions, within which all neighbors are listed, or 0 if the
+      list has not been built since the last reset. */
+  struct VerletList
+  {
+    VerletList() : Radius(0.0) {}
+    double Radius;
+    std::vector<unsigned int> Indices;
+  };
+
+  /** Tree updates without invalidating the Verlet lists, for moves. */
+  void AddToTree(const PointType &p, unsigned int idx);
+  void RemoveFromTree(unsigned int idx);
+
+  /** Takes the current positions as reference positions and drops all
+      Verlet lists. */
+  void ResetVerletLists() const;
+
+  /** Builds the Verlet list of particle idx for query radius radius. */
+  void BuildVerletList(unsigned int idx, const PointType &center, double radius) const;
+
 protected:
   typename PointTreeType::Pointer m_Tree;
   typename IteratorMapType::Pointer m_IteratorMap;
   unsigned int m_TreeLevels;
 
+  double m_VerletSkin;
+  mutable bool m_VerletStale;
+  mutable std::vector<VerletList> m_VerletLists;
+
+  /** Reference position of each particle, and a pointer to its current
+      position in the point container, both indexed by particle index. */
+  mutable std::vector<PointType> m_VerletReference;
+  mutable std::vector<const PointType *> m_VerletPositions;
+  mutable typename PointTreeType::PointIteratorListType m_VerletCandidates;
+
  
 private:
   ParticleRegionNeighborhood(const Self&); //purposely not implemented
@@ -112,9 +112,132 @@ ParticleRegionNeighborhood<VDimension>
   return ret;
 }
 
+template <unsigned int VDimension>
+typename ParticleRegionNeighborhood<VDimension>::PointVectorType
+ParticleRegionNeighborhood<VDimension>
+::FindNeighborhoodPoints(unsigned int idx, const PointType &center, double radius) const
+{
+  if (m_VerletSkin <= 0.0 || this->GetPointContainer() == 0)
+    {
+    return this->FindNeighborhoodPoints(center, radius);
+    }
+
+  if (m_VerletStale) this->ResetVerletLists();
+  if (idx >= m_VerletLists.size()) m_VerletLists.resize(idx + 1);
+
+  // Rebuild the list if it is too short for this radius, or much longer than
+  // needed (sigma, and with it the radius, shrinks during the optimization).
+  const double needed = radius + m_VerletSkin;
+  if (m_VerletLists[idx].Radius < needed || m_VerletLists[idx].Radius > 2.0 * needed)
+    {
+    this->BuildVerletList(idx, center, radius);
+    }
+  const VerletList &list = m_VerletLists[idx];
+
+  PointVectorType ret;
+  ret.reserve(list.Indices.size());
+  for (unsigned int n = 0; n < list.Indices.size(); n++)
+    {
+    const PointType &p = *m_VerletPositions[list.Indices[n]];
+    double sum = 0.0;
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      double q = center[i] - p[i];
+      sum += q*q;
+      }
+    sum = sqrt(sum);
+
+    if ( sum < radius && sum >0 )
+      {
+      ret.push_back( ParticlePointIndexPair<VDimension>(p, list.Indices[n]) );
+      }
+    }
+
+  return ret;
+}
+
+template <unsigned int VDimension>
+void ParticleRegionNeighborhood<VDimension>
+::ResetVerletLists() const
+{
+  const PointContainerType *points = this->GetPointContainer();
+  unsigned int n = 0;
+  for (typename PointContainerType::ConstIterator it = points->GetBegin();
+       it != points->GetEnd(); it++)
+    {
+    if (it.GetIndex() >= n) n = it.GetIndex() + 1;
+    }
+
+  m_VerletReference.resize(n);
+  m_VerletPositions.assign(n, 0);
+  for (typename PointContainerType::ConstIterator it = points->GetBegin();
+       it != points->GetEnd(); it++)
+    {
+    // Container entries are map nodes, so the pointers stay valid until a
+    // particle is removed, which resets the lists again.
+    m_VerletReference[it.GetIndex()] = *it;
+    m_VerletPositions[it.GetIndex()] = &(*it);
+    }
+
+  // Keep the allocated lists, only mark them as not built.
+  for (unsigned int i = 0; i < m_VerletLists.size(); i++)
+    {
+    m_VerletLists[i].Radius = 0.0;
+    m_VerletLists[i].Indices.clear();
+    }
+  m_VerletStale = false;
+}
+
+template <unsigned int VDimension>
+void ParticleRegionNeighborhood<VDimension>
+::BuildVerletList(unsigned int idx, const PointType &center, double radius) const
+{
+  VerletList &list = m_VerletLists[idx];
+  list.Radius = radius + m_VerletSkin;
+  list.Indices.clear();
+
+  // Every particle within list.Radius of the reference position of idx, by
+  // reference positions, is within list.Radius + skin of center now.
+  const double extent = list.Radius + m_VerletSkin;
+  PointType l, u;
+  for (unsigned int i = 0; i < VDimension; i++)
+    {
+    l[i] = center[i] - extent;
+    u[i] = center[i] + extent;
+    }
+  m_VerletCandidates.clear();
+  m_Tree->FindPointsInRegion(l, u, m_VerletCandidates);
+
+  const PointType &ref = m_VerletReference[idx];
+  const double r2 = list.Radius * list.Radius;
+  for (typename PointTreeType::PointIteratorListType::const_iterator it = m_VerletCandidates.begin();
+       it != m_VerletCandidates.end(); it++)
+    {
+    const unsigned int j = (*it)->Index;
+    if (j == idx || j >= m_VerletPositions.size() || m_VerletPositions[j] == 0) continue;
+
+    const PointType &q = m_VerletReference[j];
+    double sum = 0.0;
+    for (unsigned int i = 0; i < VDimension; i++)
+      {
+      double dq = ref[i] - q[i];
+      sum += dq*dq;
+      }
+    if (sum <= r2) list.Indices.push_back(j);
+    }
+}
+
 template <unsigned int VDimension>
 void ParticleRegionNeighborhood<VDimension>
 ::AddPosition(const PointType &p, unsigned int idx, int)
+{
+  this->AddToTree(p, idx);
+  m_VerletStale = true;
+}
+
+template <unsigned int VDimension>
+void ParticleRegionNeighborhood<VDimension>
+::AddToTree(const PointType &p, unsigned int idx)
 {
   // Cache this point and index into the tree.  AddPoint returns a pointer
   // to the cached values and the node in which the point resides.  This info
@@ -128,18 +251,38 @@ void ParticleRegionNeighborhood<VDimension>
 
 template <unsigned int VDimension>
 void ParticleRegionNeighborhood<VDimension>
-::SetPosition(const PointType &p, unsigned int idx, int threadId)
+::SetPosition(const PointType &p, unsigned int idx, int)
 {
   // Check whether the given index has moved outside its current bin.  If it
   // has moved outside its current bin, delete and reinsert into the tree.
   IteratorNodePair pr = m_IteratorMap->operator[](idx);
 
+  // A particle that has strayed more than half the skin from its reference
+  // position may have new neighbors that no Verlet list holds.
+  if (m_VerletSkin > 0.0 && m_VerletStale == false)
+    {
+    if (idx >= m_VerletReference.size())
+      {
+      m_VerletStale = true;
+      }
+    else
+      {
+      double sum = 0.0;
+      for (unsigned int i = 0; i < VDimension; i++)
+        {
+        double q = p[i] - m_VerletReference[idx][i];
+        sum += q*q;
+        }
+      if (4.0 * sum > m_VerletSkin * m_VerletSkin) m_VerletStale = true;
+      }
+    }
+
   for (unsigned int i = 0; i < VDimension; i++)
     {
     if (p[i] < pr.NodePointer->GetLowerBound()[i] || p[i] > pr.NodePointer->GetUpperBound()[i])
       {
-      this->RemovePosition(idx, threadId);
-      this->AddPosition(p, idx, threadId);
+      this->RemoveFromTree(idx);
+      this->AddToTree(p, idx);
       return;
       }
     }
@@ -151,6 +294,14 @@ void ParticleRegionNeighborhood<VDimension>
 template <unsigned int VDimension>
 void ParticleRegionNeighborhood<VDimension>
 ::RemovePosition(unsigned int idx, int)
+{
+  this->RemoveFromTree(idx);
+  m_VerletStale = true;
+}
+
+template <unsigned int VDimension>
+void ParticleRegionNeighborhood<VDimension>
+::RemoveFromTree(unsigned int idx)
 {
   IteratorNodePair pr = m_IteratorMap->operator[](idx);
   m_IteratorMap->Erase(idx);
@@ -66,6 +66,11 @@ public:
   virtual PointVectorType FindNeighborhoodPoints(const PointType &, std::vector<double> &, double) const;
   //  virtual unsigned int  FindNeighborhoodPoints(const PointType &, double, PointVectorType &) const;
 
+  /** As above, for the particle with index idx at center, using its Verlet
+      list if the VerletSkin is positive (see ParticleRegionNeighborhood). */
+  virtual PointVectorType FindNeighborhoodPoints(unsigned int idx, const PointType &center,
+                                                 std::vector<double> &weights, double radius) const;
+
   void PrintSelf(std::ostream& os, Indent indent) const
   {
     Superclass::PrintSelf(os, indent);
@@ -75,6 +80,11 @@ protected:
   ParticleSurfaceNeighborhood() : m_FlatCutoff(0.30)  {  }
   virtual ~ParticleSurfaceNeighborhood() {};
 
+  /** Computes the weight of each neighbor of center from the angle between
+      its surface normal and that of center. */
+  void ComputeWeights(const PointType &center, const PointVectorType &neighbors,
+                      std::vector<double> &weights) const;
+
 private:
   ParticleSurfaceNeighborhood(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
@@ -155,8 +155,29 @@ public:
   const PointType &GetPosition(unsigned long int k, unsigned int d=0) const
   {    return m_Positions[d]->operator[](k);  }
   PointType GetTransformedPosition(unsigned long int k, unsigned int d=0) const
-  {    return this->TransformPoint(m_Positions[d]->operator[](k),
-                                  m_Transforms[d] * m_PrefixTransforms[d]);  }
+  {
+    if (m_WorldPositionsOn == true) return m_WorldPositions[d][k];
+    return this->TransformPoint(m_Positions[d]->operator[](k), m_ComposedTransforms[d]);
+  }
+
+  /** Turns on/off the world space copy of the particle positions.  When on,
+      the transformed position of every particle is kept in a contiguous
+      array per domain, updated as particles are added or moved and as
+      transforms are set, and GetTransformedPosition reads from it. */
+  void SetWorldPositionsOn();
+  void SetWorldPositionsOff()
+  {
+    m_WorldPositionsOn = false;
+    for (unsigned int d = 0; d < m_WorldPositions.size(); d++)
+      { std::vector<PointType>().swap(m_WorldPositions[d]); }
+  }
+  bool GetWorldPositionsOn() const
+  { return m_WorldPositionsOn; }
+
+  /** The world space positions of domain d, indexed by particle index.  Only
+      valid if world positions are on. */
+  const std::vector<PointType> &GetWorldPositions(unsigned int d) const
+  { return m_WorldPositions[d]; }
 
   /** Doubles the number of particles of the system by
       splitting each particle into 2 particles.  Each new particle position is
@@ -179,7 +200,8 @@ public:
       k.  This is just a convenience method to avoid exposing the underlying
       Neighborhood objects. FindTransformedNeighborhoodPoints returns the list
       with all points transformed by the transform associated with the given
-      domain.*/
+      domain.  The versions taking a particle index let the neighborhood reuse
+      a cached neighbor list for that particle.*/
   inline PointVectorType FindNeighborhoodPoints(const PointType &p,
                                                 double r, unsigned int d = 0) const
   {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p, r); }
@@ -189,11 +211,11 @@ public:
   {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p,w,r); }
   inline PointVectorType FindNeighborhoodPoints(unsigned int idx,
                                                 double r, unsigned int d = 0) const
-  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(this->GetPosition(idx,d), r); }
+  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(idx, this->GetPosition(idx,d), r); }
   inline PointVectorType FindNeighborhoodPoints(unsigned int idx,
                                                 std::vector<double> &w,
                                                 double r, unsigned int d = 0) const
-  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(this->GetPosition(idx,d),w, r); }
+  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(idx, this->GetPosition(idx,d),w, r); }
 
   //  inline int FindNeighborhoodPoints(const PointType &p,  double r, PointVectorType &vec, unsigned int d = 0) const
   //  {  return m_Neighborhoods[d]->FindNeighborhoodPoints(p, r, vec); }
@@ -328,6 +350,16 @@ public:
   const TransformType &GetInversePrefixTransform() const
   {return m_InversePrefixTransforms[0]; }
 
+  /** Return the composed transform of domain i, GetTransform(i) *
+      GetPrefixTransform(i), which maps positions to world space. */
+  const TransformType &GetComposedTransform(unsigned int i) const
+  { return m_ComposedTransforms[i]; }
+
+  /** Return the inverse of the composed transform of domain i,
+      GetInversePrefixTransform(i) * GetInverseTransform(i). */
+  const TransformType &GetInverseComposedTransform(unsigned int i) const
+  { return m_InverseComposedTransforms[i]; }
+
   /** Return the array of particle positions. */
   const  std::vector<typename  PointContainerType::Pointer> &  GetPositions() const
   { return m_Positions; }
@@ -475,6 +507,28 @@ private:
   /** The set of domain transform objects */
   std::vector< TransformType > m_InversePrefixTransforms;
 
+  /** Products of the transforms and prefix transforms and their inverses,
+      updated whenever either is set. */
+  std::vector< TransformType > m_ComposedTransforms;
+  std::vector< TransformType > m_InverseComposedTransforms;
+
+  /** World space copy of the positions, see SetWorldPositionsOn. */
+  bool m_WorldPositionsOn;
+  std::vector< std::vector<PointType> > m_WorldPositions;
+
+  /** Recomputes the composed transforms of domain i and, if they are kept,
+      its world space positions. */
+  void UpdateComposedTransform(unsigned int i);
+
+  /** Updates the world space copy of particle k in domain d. */
+  void UpdateWorldPosition(unsigned long int k, unsigned int d)
+  {
+    if (m_WorldPositionsOn == false) return;
+    if (k >= m_WorldPositions[d].size()) m_WorldPositions[d].resize(k + 1);
+    m_WorldPositions[d][k] = this->TransformPoint(m_Positions[d]->operator[](k),
+                                                  m_ComposedTransforms[d]);
+  }
+
   /** A counter used to assign indicies for new particle locations. */
   std::vector< unsigned long int> m_IndexCounters;
 
@@ -23,6 +23,7 @@ namespace itk
 template <unsigned int VDimension>
 ParticleSystem<VDimension>::ParticleSystem()
 {
+  m_WorldPositionsOn = false;
 }
 
 template <unsigned int VDimension>
@@ -40,6 +41,9 @@ ParticleSystem<VDimension>
   m_InverseTransforms.resize(num);
   m_PrefixTransforms.resize(num);
   m_InversePrefixTransforms.resize(num);
+  m_ComposedTransforms.resize(num);
+  m_InverseComposedTransforms.resize(num);
+  m_WorldPositions.resize(num);
   m_Positions.resize(num);
   m_IndexCounters.resize(num);
   m_Neighborhoods.resize(num);
@@ -72,6 +76,8 @@ void ParticleSystem<VDimension>::AddDomain( DomainType *input, int threadId)
   m_InverseTransforms[static_cast<int>( m_Domains.size() -1)].set_identity();
   m_PrefixTransforms[static_cast<int>( m_Domains.size() -1)].set_identity();
   m_InversePrefixTransforms[static_cast<int>( m_Domains.size() -1)].set_identity();
+  m_ComposedTransforms[static_cast<int>( m_Domains.size() -1)].set_identity();
+  m_InverseComposedTransforms[static_cast<int>( m_Domains.size() -1)].set_identity();
   m_DomainFlags[static_cast<int>( m_Domains.size() -1)] = false;
   
   // Notify any observers.
@@ -99,6 +105,7 @@ void ParticleSystem<VDimension>
 {
   m_Transforms[i] = T;
   m_InverseTransforms[i] = this->InvertTransform(T);
+  this->UpdateComposedTransform(i);
 
   // Notify any observers.
   ParticleTransformSetEvent e;
@@ -113,6 +120,7 @@ void ParticleSystem<VDimension>
 {
   m_PrefixTransforms[i] = T;
   m_InversePrefixTransforms[i] = this->InvertTransform(T);
+  this->UpdateComposedTransform(i);
 
   // Notify any observers.
   ParticlePrefixTransformSetEvent e;
@@ -121,6 +129,36 @@ void ParticleSystem<VDimension>
   this->InvokeEvent(e);
 }
 
+template <unsigned int VDimension>
+void ParticleSystem<VDimension>
+::UpdateComposedTransform(unsigned int i)
+{
+  m_ComposedTransforms[i] = m_Transforms[i] * m_PrefixTransforms[i];
+  m_InverseComposedTransforms[i] = m_InversePrefixTransforms[i] * m_InverseTransforms[i];
+
+  if (m_WorldPositionsOn == true && m_Positions[i])
+    {
+    m_WorldPositions[i].resize(m_IndexCounters[i]);
+    for (unsigned long int k = 0; k < m_IndexCounters[i]; k++)
+      {
+      // Skip removed particles rather than recreate them.
+      if (m_Positions[i]->HasIndex(k)) this->UpdateWorldPosition(k, i);
+      }
+    }
+}
+
+template <unsigned int VDimension>
+void ParticleSystem<VDimension>
+::SetWorldPositionsOn()
+{
+  if (m_WorldPositionsOn == true) return;
+  m_WorldPositionsOn = true;
+  for (unsigned int i = 0; i < m_Domains.size(); i++)
+    {
+    this->UpdateComposedTransform(i);
+    }
+}
+
 template <unsigned int VDimension>
 void ParticleSystem<VDimension>
 ::SetNeighborhood(unsigned int i, NeighborhoodType* N, int threadId)
@@ -147,6 +185,7 @@ ParticleSystem<VDimension>::AddPosition( const PointType &p, unsigned int d, int
 
   m_Neighborhoods[d]->AddPosition( m_Positions[d]->operator[](m_IndexCounters[d]),
                                    m_IndexCounters[d], threadId);
+  this->UpdateWorldPosition(m_IndexCounters[d], d);
 
   // Increase the FixedParticleFlag list size if necessary.
   if (m_IndexCounters[0] >= m_FixedParticleFlags.size())
@@ -181,6 +220,7 @@ ParticleSystem<VDimension>::SetPosition(const PointType &p,  unsigned long int k
     
     m_Neighborhoods[d]->SetPosition( m_Positions[d]->operator[](k), k,
                                      threadId);
+    this->UpdateWorldPosition(k, d);
 
      }
 
@@ -218,9 +258,15 @@ void
 ParticleSystem<VDimension>::AddPositionList(const std::vector<PointType> &p,
                                             unsigned int d, int threadId )
 {
+  // Project the whole list onto the domain first, so that the domain can
+  // process the points together.  AddPosition then finds each point already
+  // satisfying the constraints.
+  std::vector<PointType> list(p);
+  this->GetDomain(d)->ApplyConstraintsToList(list);
+
   // Traverse the list and add each point to the domain.
-  for (typename std::vector<PointType>::const_iterator it= p.begin();
-       it != p.end(); it++)
+  for (typename std::vector<PointType>::const_iterator it= list.begin();
+       it != list.end(); it++)
     {
     this->AddPosition(*it, d, threadId);    
     }
@@ -268,18 +314,23 @@ ParticleSystem<VDimension>::SplitAllParticlesInDomain(const vnl_vector_fixed<dou
        it != endIt; it++)
     {    list.push_back(*it);    }
 
-  for (typename std::vector<PointType>::const_iterator it = list.begin();
+  // Add epsilon times random direction to each existing point and apply
+  // domain constraints to the whole list to generate the new particle
+  // positions.  Then add the new positions.
+  for (typename std::vector<PointType>::iterator it = list.begin();
        it != list.end(); it++)
     {
-    // Add epsilon times random direction to existing point and apply domain
-    // constraints to generate a new particle position.  Add the new position.
-    PointType newpos;
     for (unsigned int i = 0; i < VDimension; i++)
       {
-      newpos[i] = (*it)[i] + epsilon * random[i];
+      (*it)[i] += epsilon * random[i];
       }
-    this->GetDomain(domain)->ApplyConstraints(newpos);
-    this->AddPosition(newpos, domain, threadId);
+    }
+  this->GetDomain(domain)->ApplyConstraintsToList(list);
+
+  for (typename std::vector<PointType>::const_iterator it = list.begin();
+       it != list.end(); it++)
+    {
+    this->AddPosition(*it, domain, threadId);
     } // end for std::vector::iterator
 }
 
@@ -0,0 +1,126 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleTruncatedPCA.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleTruncatedPCA_h
+#define __itkParticleTruncatedPCA_h
+
+#include "vnl/vnl_matrix.h"
+#include "vnl/vnl_vector.h"
+
+namespace itk
+{
+
+/**
+ * \class ParticleTruncatedPCA
+ *
+ * Computes principal modes of a centered shape matrix (one shape per column,
+ * one coordinate per row).  If the number of modes is 0, all modes are
+ * computed from the dense samples x samples Gram matrix, as
+ * ParticleShapeStatistics and ParticleGaussianModeWriter have always done.
+ * Otherwise only the leading modes are estimated with a randomized range
+ * finder (Halko, Martinsson & Tropp 2011) followed by a small dense
+ * eigenproblem, so that the cost is linear in the number of samples.
+ *
+ * Eigenvalues and eigenvectors are returned in ascending order, matching
+ * vnl_symmetric_eigensystem, so callers that index the largest mode as the
+ * last column do not need to change.  The matrix products are multithreaded
+ * when built with SW_USE_OPENMP.
+ */
+template <class T>
+class ParticleTruncatedPCA
+{
+public:
+  typedef vnl_matrix<T> MatrixType;
+  typedef vnl_vector<T> VectorType;
+
+  ParticleTruncatedPCA()
+    : m_NumberOfModes(0), m_Oversampling(10), m_PowerIterations(2),
+      m_Seed(9667566), m_TotalVariance(0.0) {}
+  ~ParticleTruncatedPCA() {}
+
+  /** Number of leading modes to compute.  0 means all modes (exact). */
+  void SetNumberOfModes(unsigned int n)
+  { m_NumberOfModes = n; }
+  unsigned int GetNumberOfModes() const
+  { return m_NumberOfModes; }
+
+  /** Extra random directions sampled beyond the number of modes.  Larger
+      values improve the accuracy of the trailing computed modes. */
+  void SetOversampling(unsigned int n)
+  { m_Oversampling = n; }
+  unsigned int GetOversampling() const
+  { return m_Oversampling; }
+
+  /** Number of subspace (power) iterations.  Each iteration sharpens the
+      separation of the leading modes from the spectrum tail. */
+  void SetPowerIterations(unsigned int n)
+  { m_PowerIterations = n; }
+  unsigned int GetPowerIterations() const
+  { return m_PowerIterations; }
+
+  /** Seed of the random test matrix.  Fixed by default so that repeated runs
+      produce identical modes. */
+  void SetSeed(unsigned long s)
+  { m_Seed = s; }
+
+  /** Computes the modes of the covariance of points_minus_mean, which must
+      already have the mean shape subtracted from each column. */
+  void Compute(const MatrixType &points_minus_mean);
+
+  /** Unit length eigenvectors, one per column, in ascending eigenvalue
+      order. */
+  const MatrixType &GetEigenvectors() const
+  { return m_Eigenvectors; }
+
+  /** Eigenvalues of the sample covariance, in ascending order. */
+  const VectorType &GetEigenvalues() const
+  { return m_Eigenvalues; }
+
+  /** Trace of the sample covariance, i.e. the sum of ALL eigenvalues, also
+      when only the leading modes were computed. */
+  T GetTotalVariance() const
+  { return m_TotalVariance; }
+
+  /** C = A * B, parallel over the rows of A. */
+  static void Multiply(const MatrixType &A, const MatrixType &B, MatrixType &C);
+
+  /** C = A^T * B without forming A^T, parallel over the rows of A. */
+  static void TransposeMultiply(const MatrixType &A, const MatrixType &B,
+                                MatrixType &C);
+
+protected:
+  void ComputeExact(const MatrixType &);
+  void ComputeRandomized(const MatrixType &, unsigned int);
+
+  /** Modified Gram-Schmidt orthonormalization of the columns of Q. */
+  static void Orthonormalize(MatrixType &Q);
+
+  unsigned int m_NumberOfModes;
+  unsigned int m_Oversampling;
+  unsigned int m_PowerIterations;
+  unsigned long m_Seed;
+
+  MatrixType m_Eigenvectors;
+  VectorType m_Eigenvalues;
+  T m_TotalVariance;
+};
+
+} // end namespace itk
+
+#if ITK_TEMPLATE_EXPLICIT
+#include "Templates/itkParticleTruncatedPCA+-.h"
+#endif
+
+#if ITK_TEMPLATE_TXX
+#include "itkParticleTruncatedPCA.txx"
+#endif
+
+#endif
@@ -0,0 +1,262 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: itkParticleTruncatedPCA.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __itkParticleTruncatedPCA_txx
+#define __itkParticleTruncatedPCA_txx
+
+#include "vnl/algo/vnl_symmetric_eigensystem.h"
+#include "vnl/vnl_random.h"
+#include <cmath>
+
+namespace itk
+{
+
+template <class T>
+void
+ParticleTruncatedPCA<T>
+::Multiply(const MatrixType &A, const MatrixType &B, MatrixType &C)
+{
+  const int rows  = static_cast<int>(A.rows());
+  const unsigned int inner = A.cols();
+  const unsigned int cols  = B.cols();
+  C.set_size(rows, cols);
+
+#pragma omp parallel for
+  for (int i = 0; i < rows; i++)
+    {
+    const T *a = A[i];
+    T *c = C[i];
+    for (unsigned int m = 0; m < cols; m++) c[m] = 0.0;
+    for (unsigned int j = 0; j < inner; j++)
+      {
+      const T aij = a[j];
+      if (aij == 0.0) continue;
+      const T *b = B[j];
+      for (unsigned int m = 0; m < cols; m++)
+        {
+        c[m] += aij * b[m];
+        }
+      }
+    }
+}
+
+template <class T>
+void
+ParticleTruncatedPCA<T>
+::TransposeMultiply(const MatrixType &A, const MatrixType &B, MatrixType &C)
+{
+  const int rows = static_cast<int>(A.rows());
+  const unsigned int acols = A.cols();
+  const unsigned int bcols = B.cols();
+  C.set_size(acols, bcols);
+  C.fill(0.0);
+
+  // Each thread accumulates the contribution of a band of rows into its own
+  // (small) output, so that both A and B are read along contiguous rows.
+#pragma omp parallel
+  {
+  MatrixType local(acols, bcols, 0.0);
+
+#pragma omp for
+  for (int i = 0; i < rows; i++)
+    {
+    const T *a = A[i];
+    const T *b = B[i];
+    for (unsigned int j = 0; j < acols; j++)
+      {
+      const T aij = a[j];
+      T *c = local[j];
+      for (unsigned int m = 0; m < bcols; m++)
+        {
+        c[m] += aij * b[m];
+        }
+      }
+    }
+
+#pragma omp critical
+  C += local;
+  }
+}
+
+template <class T>
+void
+ParticleTruncatedPCA<T>
+::Orthonormalize(MatrixType &Q)
+{
+  const int rows = static_cast<int>(Q.rows());
+  const unsigned int cols = Q.cols();
+
+  // Two passes of modified Gram-Schmidt are enough to restore orthogonality
+  // to working precision.
+  for (unsigned int pass = 0; pass < 2; pass++)
+    {
+    for (unsigned int c = 0; c < cols; c++)
+      {
+      for (unsigned int p = 0; p < c; p++)
+        {
+        T dot = 0.0;
+#pragma omp parallel for reduction(+:dot)
+        for (int i = 0; i < rows; i++)
+          {
+          dot += Q(i, c) * Q(i, p);
+          }
+#pragma omp parallel for
+        for (int i = 0; i < rows; i++)
+          {
+          Q(i, c) -= dot * Q(i, p);
+          }
+        }
+
+      T norm = 0.0;
+#pragma omp parallel for reduction(+:norm)
+      for (int i = 0; i < rows; i++)
+        {
+        norm += Q(i, c) * Q(i, c);
+        }
+      norm = sqrt(norm) + 1.0e-15;
+#pragma omp parallel for
+      for (int i = 0; i < rows; i++)
+        {
+        Q(i, c) /= norm;
+        }
+      }
+    }
+}
+
+template <class T>
+void
+ParticleTruncatedPCA<T>
+::Compute(const MatrixType &points_minus_mean)
+{
+  const unsigned int num_samples = points_minus_mean.cols();
+  const unsigned int num_dims = points_minus_mean.rows();
+
+  // The trace of the covariance is needed to report percent variance when
+  // only the leading modes are computed.
+  T total = 0.0;
+  const T *data = points_minus_mean.data_block();
+  const long size = static_cast<long>(num_dims) * num_samples;
+  for (long i = 0; i < size; i++)
+    {
+    total += data[i] * data[i];
+    }
+  m_TotalVariance = total / static_cast<T>(num_samples - 1);
+
+  if (m_NumberOfModes == 0 || m_NumberOfModes + m_Oversampling >= num_samples)
+    {
+    this->ComputeExact(points_minus_mean);
+    }
+  else
+    {
+    this->ComputeRandomized(points_minus_mean, m_NumberOfModes);
+    }
+}
+
+template <class T>
+void
+ParticleTruncatedPCA<T>
+::ComputeExact(const MatrixType &points_minus_mean)
+{
+  const unsigned int num_samples = points_minus_mean.cols();
+  const int num_dims = static_cast<int>(points_minus_mean.rows());
+
+  MatrixType A;
+  TransposeMultiply(points_minus_mean, points_minus_mean, A);
+  A *= 1.0 / static_cast<T>(num_samples - 1);
+
+  vnl_symmetric_eigensystem<T> symEigen(A);
+  Multiply(points_minus_mean, symEigen.V, m_Eigenvectors);
+
+  // Normalize the eigenvectors.  Column norms are accumulated row by row.
+  VectorType norms(num_samples, 0.0);
+  for (int j = 0; j < num_dims; j++)
+    {
+    const T *v = m_Eigenvectors[j];
+    for (unsigned int i = 0; i < num_samples; i++)
+      {
+      norms[i] += v[i] * v[i];
+      }
+    }
+  for (unsigned int i = 0; i < num_samples; i++)
+    {
+    norms[i] = 1.0 / (sqrt(norms[i]) + 1.0e-15);
+    }
+
+#pragma omp parallel for
+  for (int j = 0; j < num_dims; j++)
+    {
+    T *v = m_Eigenvectors[j];
+    for (unsigned int i = 0; i < num_samples; i++)
+      {
+      v[i] *= norms[i];
+      }
+    }
+
+  m_Eigenvalues.set_size(num_samples);
+  for (unsigned int i = 0; i < num_samples; i++)
+    {
+    m_Eigenvalues[i] = symEigen.D(i, i);
+    }
+}
+
+template <class T>
+void
+ParticleTruncatedPCA<T>
+::ComputeRandomized(const MatrixType &points_minus_mean, unsigned int k)
+{
+  const unsigned int num_samples = points_minus_mean.cols();
+  const unsigned int l = k + m_Oversampling;
+
+  // Gaussian test matrix.
+  vnl_random rng(m_Seed);
+  MatrixType omega(num_samples, l);
+  for (unsigned int i = 0; i < num_samples; i++)
+    {
+    for (unsigned int j = 0; j < l; j++)
+      {
+      omega(i, j) = rng.normal64();
+      }
+    }
+
+  // Orthonormal basis Q for the range of X * omega, refined by subspace
+  // iteration with X X^T.
+  MatrixType Q;
+  Multiply(points_minus_mean, omega, Q);
+  Orthonormalize(Q);
+  for (unsigned int q = 0; q < m_PowerIterations; q++)
+    {
+    TransposeMultiply(points_minus_mean, Q, omega);
+    Orthonormalize(omega);
+    Multiply(points_minus_mean, omega, Q);
+    Orthonormalize(Q);
+    }
+
+  // Project onto the basis:  B^T = X^T Q is samples x l, and the eigenvectors
+  // of the l x l matrix B B^T rotate Q into the principal directions.
+  MatrixType Bt;
+  TransposeMultiply(points_minus_mean, Q, Bt);
+  MatrixType S = Bt.transpose() * Bt;
+  vnl_symmetric_eigensystem<T> symEigen(S);
+
+  MatrixType U = symEigen.V.extract(l, k, 0, l - k);
+  Multiply(Q, U, m_Eigenvectors);
+
+  m_Eigenvalues.set_size(k);
+  for (unsigned int i = 0; i < k; i++)
+    {
+    m_Eigenvalues[i] = symEigen.D(l - k + i, l - k + i)
+      / static_cast<T>(num_samples - 1);
+    }
+}
+
+} // end namespace itk
+
+#endif
@@ -40,7 +40,8 @@
 #include "scale_principal.h"
 #include "metaCommand.h"
 #include "isotropic.h"
-//#include "icp.h"
+#include "icp.h"
+#include "synthetic_cohort.h"
 
 #define ST_DIM 3 // change to 2 for a 2D build
 
@@ -60,7 +61,7 @@ int main(int argc, char *argv[])
               << std::endl;
     std::cerr << "Tools: relabel hole_fill isolate center extract_centers align_principal blur" <<
 		" antialias fastmarching surface point auto_pad split_segmentations extract_label" << 
-		" group scale_principal simple_morphometrics icp"  << std::endl;
+		" group scale_principal simple_morphometrics icp synthetic_cohort"  << std::endl;
     return 3;
     }
   try
@@ -122,8 +123,8 @@ int main(int argc, char *argv[])
 	  // try to fix the parameter file's input data names to match the parameter file's path
 	  std::string pname(argv[1]);
 	  std::string path = pname.substr(0,pname.find_last_of("/") + 1);
-	  std::ifstream test(inputs[0].c_str());
-	  if (!test.is_open()) {
+	  std::ifstream test(inputs.size() > 0 ? inputs[0].c_str() : "");
+	  if (inputs.size() > 0 && !test.is_open()) {
 		  for (int i = 0; i < inputs.size(); i++) {
 			  inputs[i] = path + inputs[i];
 			  original_inputs[i] = path + original_inputs[i];
@@ -380,6 +381,25 @@ int main(int argc, char *argv[])
           filter.output_filenames() = outputs;
           filter();
           }
+        else if (std::string(argv[i]) == "icp")
+          {
+          if (verbose == 1) std::cout << "icp" << std::endl;
+          // Aligns the distance maps in inputs to the first one, and writes
+          // the correspondingly aligned original segmentations to outputs.
+          shapetools::icp<float, ST_DIM> filter(argv[1]);
+          filter.input_filenames()  = inputs;
+          filter.output_filenames() = outputs;
+          filter.input_seg_filenames()  = original_inputs;
+          filter.output_seg_filenames() = outputs;
+          filter();
+          }
+        else if (std::string(argv[i]) == "synthetic_cohort")
+          {
+          if (verbose == 1) std::cout << "synthetic_cohort" << std::endl;
+          // Writes a new cohort; the inputs and outputs are not used.
+          shapetools::synthetic_cohort<float, ST_DIM> filter(argv[1]);
+          filter();
+          }
         else if (std::string(argv[i]) == "extract_centers")
           {
           if (verbose == 1) std::cout << "extract_centers" << std::endl;
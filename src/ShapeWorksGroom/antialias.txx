@@ -18,6 +18,7 @@
 #include "antialias.h"
 #include "itkImageRegionIterator.h"
 #include "itkAntiAliasBinaryImageFilter.h"
+#include "boundary_region.h"
 
 namespace shapetools
 {
@@ -47,17 +48,32 @@ void antialias<T,D>::operator()(typename image_type::Pointer img)
 {
   typename itk::AntiAliasBinaryImageFilter<image_type, image_type>::Pointer anti
     = itk::AntiAliasBinaryImageFilter<image_type, image_type>::New();
-  anti->SetInput(img);
   anti->SetNumberOfIterations(m_iterations);
   anti->SetMaximumRMSError(0.0);
+
+  // The level set only evolves in a few layers around the object boundary,
+  // so filter just the object's bounding box grown past those layers.
+  typename image_type::RegionType region;
+  typename image_type::IndexType far;
+  const bool crop = boundary_region<T, D>(img, anti->GetNumberOfLayers() + 2,
+                                          region, far);
+  if (crop == false)
+  {
+    anti->SetInput(img);
+    anti->Update();
+    paste_region<T, D>(anti->GetOutput(), img, img->GetBufferedRegion());
+    return;
+  }
+
+  anti->SetInput(extract_region<T, D>(img, region));
   anti->Update();
 
-  // Copy resampled image back to the original image (probably can do this
-  // more efficiently --jc).
-  itk::ImageRegionIterator<image_type> oit(img, img->GetBufferedRegion());
-  itk::ImageRegionIterator<image_type> it(anti->GetOutput(),
-                                          img->GetBufferedRegion());
-  for ( ; ! it.IsAtEnd(); ++it, ++oit)  { oit.Set(it.Get()); }
+  // Beyond the layers the output is constant, and every voxel outside the
+  // subregion is background at least that far from the object.
+  typename image_type::IndexType far_sub = anti->GetOutput()->GetBufferedRegion().GetIndex();
+  for (unsigned int i = 0; i < D; i++) { far_sub[i] += far[i] - region.GetIndex()[i]; }
+  img->FillBuffer(anti->GetOutput()->GetPixel(far_sub));
+  paste_region<T, D>(anti->GetOutput(), img, region);
 }
 
 } // end namespace
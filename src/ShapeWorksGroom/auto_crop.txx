@@ -18,6 +18,7 @@
 #include "itkExtractImageFilter.h"
 #include "itkConstantPadImageFilter.h"
 #include "bounding_box.h"
+#include "image_metadata.h"
 
 namespace shapetools
 {
@@ -67,16 +68,17 @@ void auto_crop<T, D>::operator() () {
   for (; it != this->input_filenames().end(); it++ )
   {
 
-    typename itk::ImageFileReader<image_type>::Pointer reader =
-      itk::ImageFileReader<image_type>::New();
-
-    reader->SetFileName( ( *it ).c_str() );
-    reader->UpdateLargestPossibleRegion();
+    image_metadata<T, D> meta;
+    if ( meta.read_header( *it ) == false )
+    {
+      throw 1;
+    }
 
-    // Compute the bounding boxes.
+    // Compute the bounding boxes.  These are cached next to each input, so
+    // only the first run over a set of images has to read the pixel data
+    // here.
     bounding_box<T, D> bb_tool;
-    bb_tool.background() = m_background;
-    bb_tool( reader->GetOutput() );
+    bb_tool.region() = image_metadata<T, D>::foreground_bounding_box( *it, m_background );
 
     std::cout << "reading " << *it << std::endl;
     std::cout << bb_tool.region() << std::endl;
@@ -84,8 +86,8 @@ void auto_crop<T, D>::operator() () {
     typename image_type::IndexType mycenter;
     for ( unsigned i = 0; i < D; i++ )
     {
-      mycenter[i] = reader->GetOutput()->GetRequestedRegion().GetIndex()[i]
-                    + ( reader->GetOutput()->GetRequestedRegion().GetSize()[i] / 2 );
+      mycenter[i] = meta.region().GetIndex()[i]
+                    + ( meta.region().GetSize()[i] / 2 );
     }
 
     if ( first == true ) // save the first bounding box size
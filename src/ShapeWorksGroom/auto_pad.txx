@@ -16,6 +16,7 @@
 #define __st__auto_pad_txx
 
 #include "bounding_box.h"
+#include "image_metadata.h"
 #include "itkConstantPadImageFilter.h"
 #include "itkChangeInformationImageFilter.h"
 
@@ -78,24 +79,26 @@ void auto_pad<T, D>::operator() () {
   bool first = true;
   for (; it != this->input_filenames().end(); it++ )
   {
-    typename itk::ImageFileReader<image_type>::Pointer reader =
-      itk::ImageFileReader<image_type>::New();
-    reader->SetFileName( ( *it ).c_str() );
-    reader->Update();
+    // Only the image extents are needed here, so read just the header.
+    image_metadata<T, D> meta;
+    if ( meta.read_header( *it ) == false )
+    {
+      throw 1;
+    }
 
     if ( first == true ) // save the first bounding box
     {
       first = false;
-      lower = reader->GetOutput()->GetLargestPossibleRegion().GetIndex();
-      upper = lower + reader->GetOutput()->GetLargestPossibleRegion().GetSize();
+      lower = meta.region().GetIndex();
+      upper = lower + meta.region().GetSize();
     }
     else
     {
       // Keep the largest bounding box.
       typename image_type::RegionType::IndexType lowerTmp
-        = reader->GetOutput()->GetLargestPossibleRegion().GetIndex();
+        = meta.region().GetIndex();
       typename image_type::RegionType::IndexType upperTmp
-        = lowerTmp + reader->GetOutput()->GetLargestPossibleRegion().GetSize();
+        = lowerTmp + meta.region().GetSize();
 
       for ( unsigned int i = 0; i < D; i++ )
       {
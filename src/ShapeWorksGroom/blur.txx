@@ -18,6 +18,8 @@
 #include "blur.h"
 #include "itkImageRegionIterator.h"
 #include "itkDiscreteGaussianImageFilter.h"
+#include "itkGaussianOperator.h"
+#include "boundary_region.h"
 
 namespace shapetools
 {
@@ -46,17 +48,33 @@ void blur<T,D>::operator()(typename image_type::Pointer img)
 {
   typename itk::DiscreteGaussianImageFilter<image_type, image_type>::Pointer blur
     = itk::DiscreteGaussianImageFilter<image_type, image_type>::New();
-  blur->SetInput(img);
   blur->SetVariance(m_sigma * m_sigma);
   blur->SetUseImageSpacingOff();
+
+  // Blurring leaves a constant background unchanged, so only the object's
+  // bounding box grown by the kernel radius needs filtering.  The radius is
+  // the one the filter itself will choose.
+  itk::GaussianOperator<double, D> op;
+  op.SetVariance(m_sigma * m_sigma);
+  op.SetMaximumError(blur->GetMaximumError()[0]);
+  op.SetMaximumKernelWidth(blur->GetMaximumKernelWidth());
+  op.SetDirection(0);
+  op.CreateDirectional();
+
+  typename image_type::RegionType region;
+  typename image_type::IndexType far;
+  if (boundary_region<T, D>(img, op.GetRadius(0) + 1, region, far) == false)
+  {
+    region = img->GetBufferedRegion();
+    blur->SetInput(img);
+  }
+  else
+  {
+    blur->SetInput(extract_region<T, D>(img, region));
+  }
   blur->Update();
-  
-  // Copy resampled image back to the original image (probably can do this
-  // more efficiently --jc).
-  itk::ImageRegionIterator<image_type> oit(img, img->GetBufferedRegion());
-  itk::ImageRegionIterator<image_type> it(blur->GetOutput(),
-                                          img->GetBufferedRegion());
-  for ( ; ! it.IsAtEnd(); ++it, ++oit)  { oit.Set(it.Get()); }
+
+  paste_region<T, D>(blur->GetOutput(), img, region);
 }
 
 } // end namespace
@@ -0,0 +1,106 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: boundary_region.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even 
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __st_boundary_region_h
+#define __st_boundary_region_h
+
+#include "itkImage.h"
+#include "itkExtractImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "bounding_box.h"
+#include <algorithm>
+
+namespace shapetools
+{
+/**
+ * Finds the part of img that a neighborhood filter of the given radius can
+ * change.  The background value is taken from the first voxel, and region is
+ * set to the bounding box of all other voxels grown by margin (clipped to
+ * the image).  Every voxel outside region therefore has the background value
+ * and lies at least margin voxels from the object.
+ *
+ * far is set to a voxel of region that is also at least margin voxels from
+ * the object along every axis, so a filter's output there is its response to
+ * plain background.  Returns false when there is nothing to gain from a
+ * subregion: the image is constant, or the object comes within margin of
+ * both ends of some axis.
+ */
+template <class T, unsigned int D>
+bool boundary_region(const itk::Image<T, D> *img, unsigned int margin,
+                     typename itk::Image<T, D>::RegionType &region,
+                     typename itk::Image<T, D>::IndexType &far)
+{
+  typedef itk::Image<T, D> image_type;
+  const typename image_type::RegionType &whole = img->GetBufferedRegion();
+
+  bounding_box<T, D> bb_tool;
+  bb_tool.background() = img->GetPixel(whole.GetIndex());
+  bb_tool(const_cast<image_type *>(img));
+
+  typename image_type::IndexType lower;
+  typename image_type::SizeType size;
+  for (unsigned int i = 0; i < D; i++)
+  {
+    const long wlo = whole.GetIndex()[i];
+    const long whi = wlo + static_cast<long>(whole.GetSize()[i]) - 1;
+
+    // bounding_box excludes its upper voxel, and reports an empty image as
+    // an inverted box.
+    const long lo = bb_tool.region().GetIndex()[i];
+    const long hi = lo + static_cast<long>(bb_tool.region().GetSize()[i]);
+    if (hi < lo || hi > whi) return false;
+
+    const long glo = lo - static_cast<long>(margin);
+    const long ghi = hi + static_cast<long>(margin);
+    if (glo >= wlo) { far[i] = glo; }
+    else if (ghi <= whi) { far[i] = ghi; }
+    else { return false; }
+
+    lower[i] = std::max(glo, wlo);
+    size[i] = std::min(ghi, whi) - lower[i] + 1;
+  }
+
+  region.SetIndex(lower);
+  region.SetSize(size);
+  return true;
+}
+
+/** Crops region out of img into a new image, for filtering on its own. */
+template <class T, unsigned int D>
+typename itk::Image<T, D>::Pointer
+extract_region(typename itk::Image<T, D>::Pointer img,
+               const typename itk::Image<T, D>::RegionType &region)
+{
+  typedef itk::Image<T, D> image_type;
+  typename itk::ExtractImageFilter<image_type, image_type>::Pointer extractor
+    = itk::ExtractImageFilter<image_type, image_type>::New();
+  extractor->SetInput(img);
+  extractor->SetExtractionRegion(region);
+  extractor->Update();
+  typename image_type::Pointer sub = extractor->GetOutput();
+  sub->DisconnectPipeline();
+  return sub;
+}
+
+/** Copies the filtered subregion sub back into region of img. */
+template <class T, unsigned int D>
+void paste_region(const itk::Image<T, D> *sub, itk::Image<T, D> *img,
+                  const typename itk::Image<T, D>::RegionType &region)
+{
+  typedef itk::Image<T, D> image_type;
+  itk::ImageRegionConstIterator<image_type> it(sub, sub->GetBufferedRegion());
+  itk::ImageRegionIterator<image_type> oit(img, region);
+  for ( ; ! it.IsAtEnd(); ++it, ++oit)  { oit.Set(it.Get()); }
+}
+
+} // end namespace 
+#endif
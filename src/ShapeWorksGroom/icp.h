@@ -20,64 +20,44 @@
 #include "tinyxml.h"
 #include <sstream>
 #include <string>
-#include "tool.h"
+#include "vnl/vnl_matrix_fixed.h"
+#include <vector>
+#include "batchtool.h"
+#include "point_kdtree.h"
 
 namespace shapetools
 {
 /**
  * \class icp
  *
+ * Rigidly aligns a set of distance maps to the first one with iterative
+ * closest points, and resamples the corresponding segmentations into the
+ * space of the first.  The zero level set of each distance map is sampled
+ * natively (linear interpolation along voxel edges that cross it).  The
+ * target surface is sampled once into a k-d tree, and the shapes are aligned
+ * concurrently, each from a subsample of icp_source_points surface points.
+ * Iteration stops after icp_iterations steps or once the mean squared
+ * distance changes by less than icp_tolerance (relative).
  *
+ * NOTE: THIS ASSUMES 3D
  */
-
-template <typename ITK_Exporter, typename VTK_Importer>
-void ConnectPipelines(ITK_Exporter exporter, VTK_Importer* importer)
-{
-  importer->SetUpdateInformationCallback(exporter->GetUpdateInformationCallback());
-  importer->SetPipelineModifiedCallback(exporter->GetPipelineModifiedCallback());
-  importer->SetWholeExtentCallback(exporter->GetWholeExtentCallback());
-  importer->SetSpacingCallback(exporter->GetSpacingCallback());
-  importer->SetOriginCallback(exporter->GetOriginCallback());
-  importer->SetScalarTypeCallback(exporter->GetScalarTypeCallback());
-  importer->SetNumberOfComponentsCallback(exporter->GetNumberOfComponentsCallback());
-  importer->SetPropagateUpdateExtentCallback(exporter->GetPropagateUpdateExtentCallback());
-  importer->SetUpdateDataCallback(exporter->GetUpdateDataCallback());
-  importer->SetDataExtentCallback(exporter->GetDataExtentCallback());
-  importer->SetBufferPointerCallback(exporter->GetBufferPointerCallback());
-  importer->SetCallbackUserData(exporter->GetCallbackUserData());
-}
-
-/**
- * This function will connect the given vtkImageExport filter to
- * the given itk::VTKImageImport filter.
- */
-template <typename VTK_Exporter, typename ITK_Importer>
-void ConnectPipelines(VTK_Exporter* exporter, ITK_Importer importer)
-{
-  importer->SetUpdateInformationCallback(exporter->GetUpdateInformationCallback());
-  importer->SetPipelineModifiedCallback(exporter->GetPipelineModifiedCallback());
-  importer->SetWholeExtentCallback(exporter->GetWholeExtentCallback());
-  importer->SetSpacingCallback(exporter->GetSpacingCallback());
-  importer->SetOriginCallback(exporter->GetOriginCallback());
-  importer->SetScalarTypeCallback(exporter->GetScalarTypeCallback());
-  importer->SetNumberOfComponentsCallback(exporter->GetNumberOfComponentsCallback());
-  importer->SetPropagateUpdateExtentCallback(exporter->GetPropagateUpdateExtentCallback());
-  importer->SetUpdateDataCallback(exporter->GetUpdateDataCallback());
-  importer->SetDataExtentCallback(exporter->GetDataExtentCallback());
-  importer->SetBufferPointerCallback(exporter->GetBufferPointerCallback());
-  importer->SetCallbackUserData(exporter->GetCallbackUserData());
-}
-
 template <class T, unsigned int D> 
 class icp : public batchtool<T, D>
 {
 public:
   typedef T pixel_type;
   typedef itk::Image<T, D> image_type;
+  typedef point_kdtree<3> kdtree_type;
+  typedef kdtree_type::point_type point_type;
   
   icp(const char *fname);
 
-  icp() { m_iterations = 50; }
+  icp()
+  {
+    m_iterations = 50;
+    m_source_points = 1000;
+    m_tolerance = 1.0e-5;
+  }
   virtual ~icp() {}
   
   virtual void operator()();
@@ -87,10 +67,33 @@ public:
   { return m_iterations; }
   int &iterations()
   { return m_iterations; }
+
+  /** */
+  int source_points() const
+  { return m_source_points; }
+  int &source_points()
+  { return m_source_points; }
+
+  /** */
+  double tolerance() const
+  { return m_tolerance; }
+  double &tolerance()
+  { return m_tolerance; }
   
 private: 
-  int m_iterations;
+  /** Points (in physical coordinates) where the distance map crosses isovalue. */
+  static void extract_surface(const image_type *img, T isovalue,
+                              std::vector<point_type> &pts);
 
+  /** Finds the rotation R and translation t that take the source points
+      closest to the target surface, x_target = R x_source + t. */
+  void align(const std::vector<point_type> &source, const kdtree_type &target,
+             const point_type &target_centroid,
+             vnl_matrix_fixed<double, 3, 3> &R, point_type &t) const;
+
+  int m_iterations;
+  int m_source_points;
+  double m_tolerance;
 
   template <class TScalarType>
   class Rigid3DTransformSurrogate : public itk::Rigid3DTransform < TScalarType >
@@ -108,15 +111,6 @@ private:
 	  Rigid3DTransformSurrogate() {}
 	  ~Rigid3DTransformSurrogate() {}
   };
-
-
-  //template <typename ITK_Exporter, typename VTK_Importer>
-  //void ConnectPipelines(ITK_Exporter exporter, VTK_Importer* importer);
-
-  //template <typename VTK_Exporter, typename ITK_Importer>
-  //void ConnectPipelines(VTK_Exporter* exporter, ITK_Importer importer);
-
-  
 };
 
  
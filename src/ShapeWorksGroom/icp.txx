@@ -17,25 +17,18 @@
 
 #include "icp.h"
 
+#ifdef SW_USE_OPENMP
+#include <omp.h>
+#endif /* SW_USE_OPENMP */
+
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
-#include "itkVTKImageExport.h"
-#include "itkVTKImageImport.h"
-#include "itkImageRegionIterator.h"
+#include "itkContinuousIndex.h"
 #include "itkResampleImageFilter.h"
 #include "itkNearestNeighborInterpolateImageFunction.h"
-
-#include "vtkImageImport.h"
-#include "vtkImageExport.h"
-#include "vtkSmartPointer.h"
-#include "vtkIterativeClosestPointTransform.h"
-#include "vtkTransform.h"
-#include "vtkLandmarkTransform.h"
-#include "vtkMath.h"
-#include "vtkPolyData.h"
-#include "vtkContourFilter.h"
-#include "vtkImageData.h"
-
+#include "vnl/algo/vnl_determinant.h"
+#include "vnl/algo/vnl_svd.h"
+#include <cmath>
 
 namespace shapetools
 {
@@ -55,159 +48,264 @@ icp<T,D>::icp(const char *fname)
     this->m_iterations = 50;
     elem = docHandle.FirstChild( "icp_iterations" ).Element();
     if (elem) this->m_iterations = atoi(elem->GetText());
+
+    this->m_source_points = 1000;
+    elem = docHandle.FirstChild( "icp_source_points" ).Element();
+    if (elem) this->m_source_points = atoi(elem->GetText());
+
+    this->m_tolerance = 1.0e-5;
+    elem = docHandle.FirstChild( "icp_tolerance" ).Element();
+    if (elem) this->m_tolerance = atof(elem->GetText());
   }
 }
 
-
-template <class T, unsigned int D> 
-void icp<T,D>::operator()()
+template <class T, unsigned int D>
+void icp<T,D>::extract_surface(const image_type *img, T isovalue,
+                               std::vector<point_type> &pts)
 {
-	float isovalue = 0.0;
+  pts.clear();
 
-	typename itk::ImageFileReader<image_type>::Pointer reader =
-			itk::ImageFileReader<image_type>::New();
+  const typename image_type::RegionType &region = img->GetBufferedRegion();
+  const typename image_type::SizeType &size = region.GetSize();
+  const T *buffer = img->GetBufferPointer();
+  const unsigned long n = region.GetNumberOfPixels();
 
-	typename std::vector<std::string>::const_iterator it
-		= this->input_filenames().begin();		//Here is the target distance map
+  unsigned long stride[3];
+  stride[0] = 1;
+  stride[1] = size[0];
+  stride[2] = size[0] * size[1];
 
-	//std::cout << "in icp filter: " << "target file: " << (*it).c_str() << std::endl;
-	reader->SetFileName( (*it).c_str() );
-	reader->Update();
+  typename image_type::IndexType idx;
+  for (unsigned long k = 0; k < n; k++)
+  {
+    idx[0] = region.GetIndex()[0] + static_cast<long>(k % size[0]);
+    idx[1] = region.GetIndex()[1] + static_cast<long>((k / size[0]) % size[1]);
+    idx[2] = region.GetIndex()[2] + static_cast<long>(k / (size[0] * size[1]));
+
+    const double a = buffer[k] - isovalue;
+    for (unsigned int d = 0; d < 3; d++)
+    {
+      // Each voxel edge is visited once, from its lower end.
+      if (idx[d] + 1 >= region.GetIndex()[d] + static_cast<long>(size[d])) continue;
+      const double b = buffer[k + stride[d]] - isovalue;
+      if ((a <= 0.0) == (b <= 0.0)) continue;
+
+      itk::ContinuousIndex<double, D> cidx;
+      for (unsigned int i = 0; i < 3; i++) cidx[i] = idx[i];
+      cidx[d] += a / (a - b);
+
+      typename image_type::PointType p;
+      img->TransformContinuousIndexToPhysicalPoint(cidx, p);
+      pts.push_back(point_type(p[0], p[1], p[2]));
+    }
+  }
+}
 
-	typename image_type::Pointer targetImage = reader->GetOutput();
-	typename image_type::SizeType  size  =
-		targetImage->GetBufferedRegion().GetSize();
+template <class T, unsigned int D>
+void icp<T,D>::align(const std::vector<point_type> &source,
+                     const kdtree_type &target, const point_type &target_centroid,
+                     vnl_matrix_fixed<double, 3, 3> &R, point_type &t) const
+{
+  const unsigned int n = source.size();
 
-	typedef itk::VTKImageExport<image_type> ExportFilterType;
-	typename ExportFilterType::Pointer itkTargetExporter = ExportFilterType::New();
-	itkTargetExporter->SetInput( reader->GetOutput() );
-	vtkImageImport* vtkTargetImporter = vtkImageImport::New();  
-	ConnectPipelines(itkTargetExporter, vtkTargetImporter);
+  // Start by matching centroids.
+  point_type source_centroid(0.0, 0.0, 0.0);
+  for (unsigned int i = 0; i < n; i++) source_centroid += source[i];
+  source_centroid /= static_cast<double>(n);
 
-	vtkTargetImporter->Update();
-	 
-	vtkContourFilter * targetContour = vtkContourFilter::New();
-	targetContour->SetInput( vtkTargetImporter->GetOutput() );
-	targetContour->SetValue( 0, isovalue  );
-	targetContour->Update();
+  R.set_identity();
+  t = target_centroid - source_centroid;
 
-	typename std::vector<std::string>::const_iterator oit
-		= this->output_filenames().begin();		//Here is distance map
+  std::vector<point_type> matched(n);
+  double last_error = -1.0;
+  for (int iter = 0; iter < m_iterations; iter++)
+  {
+    double error = 0.0;
+    point_type matched_centroid(0.0, 0.0, 0.0);
+    for (unsigned int i = 0; i < n; i++)
+    {
+      double d2;
+      matched[i] = target.nearest(R * source[i] + t, d2);
+      matched_centroid += matched[i];
+      error += d2;
+    }
+    error /= static_cast<double>(n);
+    matched_centroid /= static_cast<double>(n);
+
+    if (last_error >= 0.0 && std::fabs(last_error - error) <= m_tolerance * last_error)
+    {
+      break;
+    }
+    last_error = error;
+
+    // Closed form rigid fit of the source points to their matches (Arun et
+    // al.), from the SVD of the cross covariance.
+    vnl_matrix<double> H(3, 3, 0.0);
+    for (unsigned int i = 0; i < n; i++)
+    {
+      const point_type s = source[i] - source_centroid;
+      const point_type m = matched[i] - matched_centroid;
+      for (unsigned int r = 0; r < 3; r++)
+        for (unsigned int c = 0; c < 3; c++)
+          H(r, c) += s[r] * m[c];
+    }
+
+    vnl_svd<double> svd(H);
+    vnl_matrix<double> V = svd.V();
+    const vnl_matrix<double> &U = svd.U();
+    if (vnl_determinant(V * U.transpose()) < 0.0)
+    {
+      // A reflection; flip the axis of the smallest singular value.
+      V.set_column(2, -V.get_column(2));
+    }
+    const vnl_matrix<double> rotation = V * U.transpose();
+    for (unsigned int r = 0; r < 3; r++)
+      for (unsigned int c = 0; c < 3; c++)
+        R(r, c) = rotation(r, c);
+    t = matched_centroid - R * source_centroid;
+  }
+}
 
-	typename std::vector<std::string>::const_iterator segit
-		= this->input_seg_filenames().begin();		//Here is binary segmentation
+template <class T, unsigned int D> 
+void icp<T,D>::operator()()
+{
+	const T isovalue = 0.0;
+	const int n = this->input_filenames().size();
+	if (n == 0) return;
 
-	typename std::vector<std::string>::const_iterator segoit
-		= this->output_seg_filenames().begin();		//Here is binary segmentation
+	// The target (the first distance map) is read on its own, which also
+	// registers the ImageIO factories before the concurrent reads below.
+	typename itk::ImageFileReader<image_type>::Pointer reader =
+		itk::ImageFileReader<image_type>::New();
+	reader->SetFileName( this->input_filenames()[0].c_str() );
+	reader->Update();
 
-	it++;
-	oit++;
-	segit++;
-	segoit++;
+	typename image_type::SizeType size =
+		reader->GetOutput()->GetBufferedRegion().GetSize();
 
-	for (; it != this->input_filenames().end(); it++, oit++, segit++, segoit++)
+	std::vector<point_type> target_points;
+	extract_surface(reader->GetOutput(), isovalue, target_points);
+	if (target_points.size() == 0)
 	{
-		//std::cout << "in icp filter: " << "source file: " << (*it).c_str() << std::endl;
-		reader->SetFileName( (*it).c_str() );
-		reader->Update();
-		
-		typename ExportFilterType::Pointer itkSourceExporter = ExportFilterType::New();
-		itkSourceExporter->SetInput( reader->GetOutput() );
-
-		vtkImageImport* vtkSourceImporter = vtkImageImport::New();  
-		ConnectPipelines(itkSourceExporter, vtkSourceImporter);
-
-		vtkSourceImporter->Update();
-
-		vtkContourFilter * sourceContour = vtkContourFilter::New();
-		sourceContour->SetInput( vtkSourceImporter->GetOutput() );
-		sourceContour->SetValue( 0, isovalue );
-		sourceContour->Update();
-
-		//image_type::Pointer sourceInputImage = reader->GetOutput();
-
-		vtkSmartPointer<vtkPolyData> target = targetContour->GetOutput();
-		vtkSmartPointer<vtkPolyData> source = sourceContour->GetOutput();
+		std::cerr << "icp:: no surface in " << this->input_filenames()[0] << std::endl;
+		throw 1;
+	}
 
-		vtkSmartPointer<vtkIterativeClosestPointTransform> icp =
-				vtkSmartPointer<vtkIterativeClosestPointTransform>::New();		
+	point_type target_centroid(0.0, 0.0, 0.0);
+	for (unsigned int i = 0; i < target_points.size(); i++) target_centroid += target_points[i];
+	target_centroid /= static_cast<double>(target_points.size());
 
-		icp->SetSource(source);
-		icp->SetTarget(target);
-		icp->GetLandmarkTransform()->SetModeToRigidBody();
-		icp->SetMaximumNumberOfIterations(m_iterations);
-		icp->StartByMatchingCentroidsOn();
+	kdtree_type target;
+	target.build(target_points);
+	target_points.clear();
 
-		icp->Modified();
-		icp->Update();
+	bool failed = false;
+	itk::ExceptionObject error;
 
-		vtkSmartPointer<vtkMatrix4x4> m1 = icp->GetMatrix();
-		vtkSmartPointer<vtkMatrix4x4> m  = vtkMatrix4x4::New();
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int j = 0; j < n; j++)
+	{
+		try
+		{
+			// The target segmentation is written back unchanged.
+			vnl_matrix_fixed<double, 3, 3> R;
+			point_type t(0.0, 0.0, 0.0);
+			R.set_identity();
 
-		vtkMatrix4x4::Invert(m1, m);
+			if (j > 0)
+			{
+				typename itk::ImageFileReader<image_type>::Pointer source_reader =
+					itk::ImageFileReader<image_type>::New();
+				source_reader->SetFileName( this->input_filenames()[j].c_str() );
+				source_reader->Update();
+
+				std::vector<point_type> surface;
+				extract_surface(source_reader->GetOutput(), isovalue, surface);
+				if (surface.size() == 0)
+				{
+					itkGenericExceptionMacro(<< "icp:: no surface in " << this->input_filenames()[j]);
+				}
+
+				// An evenly strided subsample of the source surface.
+				const unsigned int step = (m_source_points > 0)
+					? (surface.size() + m_source_points - 1) / m_source_points : 1;
+				std::vector<point_type> source;
+				for (unsigned int i = 0; i < surface.size(); i += step) source.push_back(surface[i]);
+
+				this->align(source, target, target_centroid, R, t);
+			}
 
-		//std::cout << "The resulting matrix is: " << *m << std::endl;
+			// The resampler maps output (target) points to input (source)
+			// points, which is the inverse of the alignment.
+			const vnl_matrix_fixed<double, 3, 3> Rinv = R.transpose();
+			const point_type tinv = -(Rinv * t);
 
-		typedef Rigid3DTransformSurrogate<double>  TransformType;
+			typedef Rigid3DTransformSurrogate<double>  TransformType;
 
-		typename TransformType::Pointer transform = TransformType::New();
-		typename TransformType::ParametersType p;
-		p.set_size(12);
-		for(int r=0;r<3;r++)
+			typename TransformType::Pointer transform = TransformType::New();
+			typename TransformType::ParametersType p;
+			p.set_size(12);
+			for(int r=0;r<3;r++)
+			{
+				for(int c=0;c<3;c++)
+				{
+					p[r*3+c]=Rinv(r,c);
+				}
+			}
+			p[ 9]=tinv[0];
+			p[10]=tinv[1];
+			p[11]=tinv[2];
+
+			transform->SetParameters( p );
+
+			typename itk::ImageFileReader<image_type>::Pointer source_seg_reader =
+				itk::ImageFileReader<image_type>::New();
+
+			source_seg_reader->SetFileName( this->input_seg_filenames()[j].c_str() );
+			source_seg_reader->Update();
+			
+			typename image_type::Pointer source_seg_img = 
+				source_seg_reader->GetOutput();
+
+			typedef itk::ResampleImageFilter< image_type
+				, image_type > ResampleFilterType;
+			typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
+			resampler->SetTransform( transform );
+
+			typedef itk::NearestNeighborInterpolateImageFunction<
+				image_type, double > InterpolatorType;
+			typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
+
+			resampler->SetInterpolator( interpolator );
+			resampler->SetOutputSpacing( source_seg_img->GetSpacing() );
+			resampler->SetSize( size );
+			resampler->SetOutputOrigin( source_seg_img->GetOrigin() );
+			resampler->SetOutputDirection( source_seg_img->GetDirection() );
+			resampler->SetInput( source_seg_img );
+			resampler->Update();
+
+			typename itk::ImageFileWriter< image_type >::Pointer writer
+				= itk::ImageFileWriter< image_type >::New();
+
+			writer->SetInput( resampler->GetOutput() );
+			writer->SetFileName( this->output_seg_filenames()[j].c_str()  );
+			writer->Update();
+		}
+		catch (itk::ExceptionObject &e)
 		{
-			for(int c=0;c<3;c++)
+#pragma omp critical
 			{
-				p[r*3+c]=m->GetElement(r,c);
+				if (failed == false)
+				{
+					failed = true;
+					error = e;
+				}
 			}
 		}
-		p[ 9]=m->GetElement(0,3);
-		p[10]=m->GetElement(1,3);
-		p[11]=m->GetElement(2,3);
-
-		transform->SetParameters( p );
-
-		//std::cout << "parameters:" << std::endl;
-		//for(int r=0;r<12;r++)
-		//{
-		//	std::cout << p[r] << " ";
-		//}
-		//std::cout << std::endl;
-
-		typename itk::ImageFileReader<image_type>::Pointer source_seg_reader =
-			itk::ImageFileReader<image_type>::New();
-
-		//std::cout << "in icp filter: " << "input source seg file: " << (*segit).c_str() << std::endl;
-		source_seg_reader->SetFileName( (*segit).c_str() );
-		source_seg_reader->Update();
-		
-		typename image_type::Pointer source_seg_img = 
-			source_seg_reader->GetOutput();
-
-		typedef itk::ResampleImageFilter< image_type
-			, image_type > ResampleFilterType;
-		typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
-		resampler->SetTransform( transform );
-
-		typedef itk::NearestNeighborInterpolateImageFunction<
-			image_type, double > InterpolatorType;
-		typename InterpolatorType::Pointer interpolator = InterpolatorType::New();
-
-		resampler->SetInterpolator( interpolator );
-		resampler->SetOutputSpacing( source_seg_img->GetSpacing() );
-		resampler->SetSize( size );
-		resampler->SetOutputOrigin( source_seg_img->GetOrigin() );
-		resampler->SetOutputDirection( source_seg_img->GetDirection() );
-		resampler->SetInput( source_seg_img );
-		resampler->Update();
-
-		typename itk::ImageFileWriter< image_type >::Pointer writer
-			= itk::ImageFileWriter< image_type >::New();
-
-		//std::cout << "in icp filter: " << "result source seg file: " << (*segoit).c_str() << std::endl;
-		writer->SetInput( resampler->GetOutput() );
-		writer->SetFileName( (*segoit).c_str()  );
-		writer->Update();
 	}
+
+	// Exceptions may not leave the parallel loop; report the first one here.
+	if (failed == true) throw error;
 }
 
 } // end namespace
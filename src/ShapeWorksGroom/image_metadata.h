@@ -0,0 +1,87 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: image_metadata.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even 
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __st_image_metadata_h
+#define __st_image_metadata_h
+
+#include "itkImage.h"
+#include "itkImageRegion.h"
+#include <string>
+#include <vector>
+
+namespace shapetools
+{
+/**
+ * \class image_metadata
+ *
+ * Geometry and per-file statistics of an input volume, obtained without
+ * decoding the pixel data where possible.  read_header() reads only the image
+ * header, which is all that the first pass of isotropic or auto_pad needs.
+ *
+ * Statistics that do require a full read (e.g. the foreground bounding box)
+ * are kept in a small text sidecar next to the volume, "<file>.stats".  The
+ * sidecar records the modification time and length of the volume and is
+ * ignored once either changes, so a regroomed input is always recomputed.
+ */
+template <class T, unsigned int D>
+class image_metadata
+{
+public:
+  typedef T pixel_type;
+  typedef itk::Image<T, D> image_type;
+  typedef typename image_type::RegionType region_type;
+  typedef typename image_type::SpacingType spacing_type;
+  typedef typename image_type::PointType point_type;
+
+  image_metadata() {}
+
+  /** Reads the header of fname.  Returns false if no ImageIO can read it. */
+  bool read_header(const std::string &fname);
+
+  /** Largest possible region, spacing and origin from the last read_header. */
+  const region_type &region() const
+  { return m_region; }
+  const spacing_type &spacing() const
+  { return m_spacing; }
+  const point_type &origin() const
+  { return m_origin; }
+
+  /** Looks up a cached statistic of fname.  Returns false if there is no
+      valid sidecar or it does not contain key. */
+  static bool get_stat(const std::string &fname, const std::string &key,
+                       std::vector<double> &values);
+
+  /** Stores a statistic of fname in its sidecar, replacing any earlier value
+      of key.  Failure to write (e.g. a read-only input directory) is not an
+      error; the value is simply recomputed next time. */
+  static void put_stat(const std::string &fname, const std::string &key,
+                       const std::vector<double> &values);
+
+  /** Smallest region around the pixels of fname that differ from background,
+      taken from the sidecar or computed with bounding_box and cached. */
+  static region_type foreground_bounding_box(const std::string &fname,
+                                             pixel_type background);
+
+private:
+  static std::string stats_filename(const std::string &fname);
+  static std::string source_stamp(const std::string &fname);
+
+  region_type m_region;
+  spacing_type m_spacing;
+  point_type m_origin;
+};
+
+} // end namespace 
+#endif
+
+#ifndef ST_MANUAL_INSTANTIATION
+#include "image_metadata.txx"
+#endif
@@ -0,0 +1,192 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: image_metadata.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even 
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __st__image_metadata_txx
+#define __st__image_metadata_txx
+
+#include "itkImageIOBase.h"
+#include "itkImageIOFactory.h"
+#include "itkImageFileReader.h"
+#include "itksys/SystemTools.hxx"
+#include "bounding_box.h"
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace shapetools
+{
+
+template <class T, unsigned int D>
+bool image_metadata<T, D>::read_header(const std::string &fname)
+{
+  itk::ImageIOBase::Pointer io = itk::ImageIOFactory::CreateImageIO(
+    fname.c_str(), itk::ImageIOFactory::ReadMode);
+  if ( io.IsNull() )
+  {
+    std::cerr << "image_metadata:: cannot read " << fname << std::endl;
+    return false;
+  }
+  io->SetFileName(fname.c_str());
+  io->ReadImageInformation();
+
+  // Same convention as ImageFileReader: the region starts at index 0 and
+  // missing dimensions have size 1 and unit spacing.
+  typename region_type::IndexType index;
+  typename region_type::SizeType size;
+  for ( unsigned int i = 0; i < D; i++ )
+  {
+    index[i] = 0;
+    if ( i < io->GetNumberOfDimensions() )
+    {
+      size[i] = io->GetDimensions(i);
+      m_spacing[i] = io->GetSpacing(i);
+      m_origin[i] = io->GetOrigin(i);
+    }
+    else
+    {
+      size[i] = 1;
+      m_spacing[i] = 1.0;
+      m_origin[i] = 0.0;
+    }
+  }
+  m_region.SetIndex(index);
+  m_region.SetSize(size);
+  return true;
+}
+
+template <class T, unsigned int D>
+std::string image_metadata<T, D>::stats_filename(const std::string &fname)
+{
+  return fname + ".stats";
+}
+
+template <class T, unsigned int D>
+std::string image_metadata<T, D>::source_stamp(const std::string &fname)
+{
+  std::ostringstream s;
+  s << "source " << itksys::SystemTools::ModifiedTime(fname.c_str())
+    << " " << itksys::SystemTools::FileLength(fname.c_str());
+  return s.str();
+}
+
+template <class T, unsigned int D>
+bool image_metadata<T, D>::get_stat(const std::string &fname,
+                                    const std::string &key,
+                                    std::vector<double> &values)
+{
+  std::ifstream in(stats_filename(fname).c_str());
+  if ( !in ) { return false; }
+
+  std::string line;
+  if ( !std::getline(in, line) || line != source_stamp(fname) ) { return false; }
+
+  while ( std::getline(in, line) )
+  {
+    std::istringstream s(line);
+    std::string k;
+    if ( !( s >> k ) || k != key ) { continue; }
+
+    values.clear();
+    double v;
+    while ( s >> v ) { values.push_back(v); }
+    return true;
+  }
+  return false;
+}
+
+template <class T, unsigned int D>
+void image_metadata<T, D>::put_stat(const std::string &fname,
+                                    const std::string &key,
+                                    const std::vector<double> &values)
+{
+  const std::string stamp = source_stamp(fname);
+
+  // Keep the other entries of a still valid sidecar.
+  std::vector<std::string> lines;
+  {
+    std::ifstream in(stats_filename(fname).c_str());
+    std::string line;
+    if ( in && std::getline(in, line) && line == stamp )
+    {
+      while ( std::getline(in, line) )
+      {
+        std::istringstream s(line);
+        std::string k;
+        if ( ( s >> k ) && k != key ) { lines.push_back(line); }
+      }
+    }
+  }
+
+  std::ostringstream entry;
+  entry.precision(17);
+  entry << key;
+  for ( unsigned int i = 0; i < values.size(); i++ ) { entry << " " << values[i]; }
+  lines.push_back(entry.str());
+
+  const std::string tmp = stats_filename(fname) + ".tmp";
+  {
+    std::ofstream out(tmp.c_str());
+    if ( !out ) { return; }
+    out << stamp << "\n";
+    for ( unsigned int i = 0; i < lines.size(); i++ ) { out << lines[i] << "\n"; }
+    if ( !out ) { out.close(); remove(tmp.c_str()); return; }
+  }
+  if ( rename(tmp.c_str(), stats_filename(fname).c_str()) != 0 ) { remove(tmp.c_str()); }
+}
+
+template <class T, unsigned int D>
+typename image_metadata<T, D>::region_type
+image_metadata<T, D>::foreground_bounding_box(const std::string &fname,
+                                              pixel_type background)
+{
+  std::ostringstream key;
+  key.precision(17);
+  key << "bounding_box(" << static_cast<double>( background ) << ")";
+
+  region_type region;
+  std::vector<double> values;
+  if ( get_stat(fname, key.str(), values) && values.size() == 2 * D )
+  {
+    typename region_type::IndexType index;
+    typename region_type::SizeType size;
+    for ( unsigned int i = 0; i < D; i++ )
+    {
+      index[i] = static_cast<typename region_type::IndexValueType>( values[i] );
+      size[i] = static_cast<typename region_type::SizeValueType>( values[D + i] );
+    }
+    region.SetIndex(index);
+    region.SetSize(size);
+    return region;
+  }
+
+  typename itk::ImageFileReader<image_type>::Pointer reader =
+    itk::ImageFileReader<image_type>::New();
+  reader->SetFileName( fname.c_str() );
+  reader->UpdateLargestPossibleRegion();
+
+  bounding_box<T, D> bb_tool;
+  bb_tool.background() = background;
+  bb_tool( reader->GetOutput() );
+  region = bb_tool.region();
+
+  values.resize(2 * D);
+  for ( unsigned int i = 0; i < D; i++ )
+  {
+    values[i] = static_cast<double>( region.GetIndex()[i] );
+    values[D + i] = static_cast<double>( region.GetSize()[i] );
+  }
+  put_stat(fname, key.str(), values);
+  return region;
+}
+
+} // end namespace 
+
+#endif
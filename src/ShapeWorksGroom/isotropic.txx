@@ -24,6 +24,7 @@
 #include "itkNearestNeighborInterpolateImageFunction.h"
 #include "itkResampleImageFilter.h"
 #include "bounding_box.h"
+#include "image_metadata.h"
 
 namespace shapetools
 {
@@ -44,19 +45,19 @@ isotropic<T, D>::isotropic( const char* fname )
 template <class T, unsigned int D>
 void isotropic<T, D>::operator() () {
 
-  // first find the minimim spacing in all the images
+  // first find the minimim spacing in all the images; only the headers
+  // are needed for this
   double min_spacing = 1.0;
   std::cerr << "Finding the minimum spacing\n";
   for (int i=0; i < this->input_filenames().size(); i++)
   {
     std::cerr << "Checking " << this->input_filenames()[i] << "...\n";
-    typename itk::ImageFileReader<image_type>::Pointer reader =
-      itk::ImageFileReader<image_type>::New();
-    reader->SetFileName( this->input_filenames()[i].c_str() );
-    reader->Update();
-    reader->UpdateLargestPossibleRegion();
-    typename image_type::Pointer img = reader->GetOutput();
-    const typename image_type::SpacingType& input_spacing = img->GetSpacing();
+    image_metadata<T, D> meta;
+    if ( meta.read_header( this->input_filenames()[i] ) == false )
+    {
+      throw 1;
+    }
+    const typename image_type::SpacingType& input_spacing = meta.spacing();
     for ( unsigned int i = 0; i < D; i++ )
     {
       min_spacing = std::min( min_spacing, input_spacing[i] );
@@ -0,0 +1,115 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: point_kdtree.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even 
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR 
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __st_point_kdtree_h
+#define __st_point_kdtree_h
+
+#include "vnl/vnl_vector_fixed.h"
+#include <algorithm>
+#include <vector>
+
+namespace shapetools
+{
+/**
+ * \class point_kdtree
+ *
+ * A static k-d tree over a point set for nearest neighbor queries.  The tree
+ * is stored implicitly: the points are reordered so that every range
+ * [lo, hi) is split at its median on the axis (depth mod D), and ranges of
+ * leaf_size points or fewer are searched exhaustively.  Queries do not
+ * modify the tree and may be run from several threads at once.
+ */
+template <unsigned int D>
+class point_kdtree
+{
+public:
+  typedef vnl_vector_fixed<double, D> point_type;
+
+  point_kdtree() {}
+
+  /** Builds the tree over a copy of pts. */
+  void build(const std::vector<point_type> &pts)
+  {
+    m_points = pts;
+    if (m_points.size() > 0) { this->build(0, m_points.size(), 0); }
+  }
+
+  unsigned int size() const
+  { return m_points.size(); }
+
+  /** Returns the point nearest to q and its squared distance.  The tree must
+      not be empty. */
+  const point_type &nearest(const point_type &q, double &dist2) const
+  {
+    unsigned int best = 0;
+    dist2 = vnl_vector_ssd(q, m_points[0]);
+    this->nearest(q, 0, m_points.size(), 0, best, dist2);
+    return m_points[best];
+  }
+
+private:
+  enum { leaf_size = 8 };
+
+  struct axis_less
+  {
+    unsigned int axis;
+    axis_less(unsigned int a) : axis(a) {}
+    bool operator()(const point_type &a, const point_type &b) const
+    { return a[axis] < b[axis]; }
+  };
+
+  void build(unsigned int lo, unsigned int hi, unsigned int depth)
+  {
+    if (hi - lo <= leaf_size) { return; }
+    const unsigned int mid = lo + (hi - lo) / 2;
+    std::nth_element(m_points.begin() + lo, m_points.begin() + mid,
+                     m_points.begin() + hi, axis_less(depth % D));
+    this->build(lo, mid, depth + 1);
+    this->build(mid + 1, hi, depth + 1);
+  }
+
+  void nearest(const point_type &q, unsigned int lo, unsigned int hi,
+               unsigned int depth, unsigned int &best, double &dist2) const
+  {
+    if (hi - lo <= leaf_size)
+    {
+      for (unsigned int i = lo; i < hi; i++)
+      {
+        const double d = vnl_vector_ssd(q, m_points[i]);
+        if (d < dist2) { dist2 = d; best = i; }
+      }
+      return;
+    }
+
+    const unsigned int mid = lo + (hi - lo) / 2;
+    const double d = vnl_vector_ssd(q, m_points[mid]);
+    if (d < dist2) { dist2 = d; best = mid; }
+
+    // Descend on the query's side of the split first, and visit the other
+    // side only if the splitting plane is closer than the best match.
+    const double diff = q[depth % D] - m_points[mid][depth % D];
+    if (diff < 0.0)
+    {
+      this->nearest(q, lo, mid, depth + 1, best, dist2);
+      if (diff * diff < dist2) { this->nearest(q, mid + 1, hi, depth + 1, best, dist2); }
+    }
+    else
+    {
+      this->nearest(q, mid + 1, hi, depth + 1, best, dist2);
+      if (diff * diff < dist2) { this->nearest(q, lo, mid, depth + 1, best, dist2); }
+    }
+  }
+
+  std::vector<point_type> m_points;
+};
+
+} // end namespace 
+#endif
@@ -0,0 +1,144 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: synthetic_cohort.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __st_synthetic_cohort_h
+#define __st_synthetic_cohort_h
+
+#include "itkImage.h"
+#include "tinyxml.h"
+#include <string>
+#include <vector>
+
+namespace shapetools
+{
+/**
+ * \class synthetic_cohort
+ *
+ * Writes a cohort of synthetic signed distance maps (negative inside) with
+ * known modes of variation, together with a ShapeWorksRun parameter file for
+ * them, for scaling and regression tests of the optimizer.  No inputs are
+ * read.  The shape family is one of
+ *
+ *   ellipsoid     semi-axes 30, 20, 15;  modes scale each semi-axis
+ *   torus         radii 25, 10;  modes scale the major and minor radius
+ *   bumpy_sphere  radius 25 with fixed 4-fold bumps;  modes add the
+ *                 elongation, saddle, 3-lobed and twist harmonics
+ *
+ * Mode coefficients are drawn independently from N(0, synthetic_variation^2)
+ * and written to <prefix>.modes, one line per shape, so a model built from
+ * the cohort can be checked against them.  The distance maps are exact for
+ * the torus and approximate (exact zero level set) for the others.  They are
+ * synthetic_resolution voxels on a side and written to <prefix>.NNN_DT.nrrd,
+ * and <prefix>.run.xml asks for synthetic_particles particles (rounded up to
+ * a power of two, as the optimizer splits particles).
+ *
+ * NOTE: THIS ASSUMES 3D
+ */
+template <class T, unsigned int D>
+class synthetic_cohort
+{
+public:
+  typedef T pixel_type;
+  typedef itk::Image<T, D> image_type;
+
+  synthetic_cohort(const char *fname);
+  synthetic_cohort()
+  {
+    m_shape = "ellipsoid";
+    m_shapes = 20;
+    m_resolution = 64;
+    m_particles = 256;
+    m_modes = 2;
+    m_variation = 0.1;
+    m_seed = 0;
+    m_prefix = "synthetic";
+  }
+  virtual ~synthetic_cohort() {}
+
+  virtual void operator()();
+
+  /** Distance from physical point p to the surface of a shape with the
+      given mode coefficients. */
+  double distance(const double *p, const std::vector<double> &modes) const;
+
+  /** Number of modes that the shape family supports. */
+  unsigned int max_modes() const;
+
+  /** Half the side of the (cubic) physical extent of the images. */
+  double extent() const;
+
+  /** */
+  const std::string &shape() const
+  { return m_shape; }
+  std::string &shape()
+  { return m_shape; }
+
+  /** */
+  int shapes() const
+  { return m_shapes; }
+  int &shapes()
+  { return m_shapes; }
+
+  /** */
+  int resolution() const
+  { return m_resolution; }
+  int &resolution()
+  { return m_resolution; }
+
+  /** */
+  int particles() const
+  { return m_particles; }
+  int &particles()
+  { return m_particles; }
+
+  /** */
+  int modes() const
+  { return m_modes; }
+  int &modes()
+  { return m_modes; }
+
+  /** */
+  double variation() const
+  { return m_variation; }
+  double &variation()
+  { return m_variation; }
+
+  /** */
+  int seed() const
+  { return m_seed; }
+  int &seed()
+  { return m_seed; }
+
+  /** */
+  const std::string &prefix() const
+  { return m_prefix; }
+  std::string &prefix()
+  { return m_prefix; }
+
+private:
+  void write_parameters(const std::vector<std::string> &files) const;
+
+  std::string m_shape;
+  int m_shapes;
+  int m_resolution;
+  int m_particles;
+  int m_modes;
+  double m_variation;
+  int m_seed;
+  std::string m_prefix;
+};
+
+} // end namespace
+#endif
+
+#ifndef ST_MANUAL_INSTANTIATION
+#include "synthetic_cohort.txx"
+#endif
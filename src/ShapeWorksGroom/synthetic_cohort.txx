@@ -0,0 +1,326 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: synthetic_cohort.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __st_synthetic_cohort_txx
+#define __st_synthetic_cohort_txx
+
+#include "synthetic_cohort.h"
+
+#ifdef SW_USE_OPENMP
+#include <omp.h>
+#endif /* SW_USE_OPENMP */
+
+#include "itkImageFileWriter.h"
+#include "vnl/vnl_random.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace shapetools
+{
+
+template <class T, unsigned int D>
+synthetic_cohort<T,D>::synthetic_cohort(const char *fname)
+{
+  this->m_shape = "ellipsoid";
+  this->m_shapes = 20;
+  this->m_resolution = 64;
+  this->m_particles = 256;
+  this->m_modes = 2;
+  this->m_variation = 0.1;
+  this->m_seed = 0;
+  this->m_prefix = "synthetic";
+
+  TiXmlDocument doc(fname);
+  bool loadOkay = doc.LoadFile();
+
+  if (loadOkay)
+  {
+    TiXmlHandle docHandle( &doc );
+    TiXmlElement *elem;
+    std::istringstream buffer;
+
+    elem = docHandle.FirstChild( "synthetic_shape" ).Element();
+    if (elem)
+    {
+      buffer.str(elem->GetText());
+      buffer >> this->m_shape;
+    }
+
+    elem = docHandle.FirstChild( "synthetic_shapes" ).Element();
+    if (elem) this->m_shapes = atoi(elem->GetText());
+
+    elem = docHandle.FirstChild( "synthetic_resolution" ).Element();
+    if (elem) this->m_resolution = atoi(elem->GetText());
+
+    elem = docHandle.FirstChild( "synthetic_particles" ).Element();
+    if (elem) this->m_particles = atoi(elem->GetText());
+
+    elem = docHandle.FirstChild( "synthetic_modes" ).Element();
+    if (elem) this->m_modes = atoi(elem->GetText());
+
+    elem = docHandle.FirstChild( "synthetic_variation" ).Element();
+    if (elem) this->m_variation = atof(elem->GetText());
+
+    elem = docHandle.FirstChild( "synthetic_seed" ).Element();
+    if (elem) this->m_seed = atoi(elem->GetText());
+
+    elem = docHandle.FirstChild( "synthetic_prefix" ).Element();
+    if (elem)
+    {
+      buffer.clear();
+      buffer.str(elem->GetText());
+      buffer >> this->m_prefix;
+    }
+  }
+}
+
+template <class T, unsigned int D>
+unsigned int synthetic_cohort<T,D>::max_modes() const
+{
+  if (m_shape == "ellipsoid") return 3;
+  if (m_shape == "torus") return 2;
+  if (m_shape == "bumpy_sphere") return 4;
+  return 0;
+}
+
+template <class T, unsigned int D>
+double synthetic_cohort<T,D>::extent() const
+{
+  double r = 30.0;
+  if (m_shape == "torus") r = 35.0;
+  else if (m_shape == "bumpy_sphere") r = 25.0 * 1.15;
+
+  // Room for four standard deviations of every mode, plus a margin for the
+  // distance map around the surface.
+  return 1.2 * r * (1.0 + 4.0 * m_variation * m_modes);
+}
+
+template <class T, unsigned int D>
+double synthetic_cohort<T,D>::distance(const double *p, const std::vector<double> &c) const
+{
+  double scale[4] = { 1.0, 1.0, 1.0, 1.0 };
+  for (unsigned int i = 0; i < c.size() && i < 4; i++)
+  {
+    scale[i] = 1.0 + c[i];
+  }
+
+  if (m_shape == "torus")
+  {
+    const double R = 25.0 * scale[0];
+    const double r = 10.0 * scale[1];
+    const double q = sqrt(p[0] * p[0] + p[1] * p[1]) - R;
+    return sqrt(q * q + p[2] * p[2]) - r;
+  }
+  else if (m_shape == "bumpy_sphere")
+  {
+    const double rho = sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+    if (rho < 1.0e-9) return -25.0;
+    const double x = p[0] / rho;
+    const double y = p[1] / rho;
+    const double z = p[2] / rho;
+
+    // Fixed bumps: cos(4 phi) sin^4(theta).
+    double r = 1.0 + 0.15 * (x * x * x * x - 6.0 * x * x * y * y + y * y * y * y);
+    double f[4];
+    f[0] = 0.5 * (3.0 * z * z - 1.0);
+    f[1] = x * x - y * y;
+    f[2] = 0.5 * (5.0 * z * z * z - 3.0 * z);
+    f[3] = 2.0 * x * y;
+    for (unsigned int i = 0; i < c.size() && i < 4; i++)
+    {
+      r += c[i] * f[i];
+    }
+    return rho - 25.0 * r;
+  }
+  else
+  {
+    // Ellipsoid, with the distance approximated as k0 (k0 - 1) / k1 where
+    // k0 = |p / r| and k1 = |p / r^2|.  This is exact on the surface and
+    // along the axes, and close near the surface.
+    const double r[3] = { 30.0 * scale[0], 20.0 * scale[1], 15.0 * scale[2] };
+    double k0 = 0.0;
+    double k1 = 0.0;
+    for (unsigned int i = 0; i < 3; i++)
+    {
+      k0 += (p[i] / r[i]) * (p[i] / r[i]);
+      k1 += (p[i] / (r[i] * r[i])) * (p[i] / (r[i] * r[i]));
+    }
+    k0 = sqrt(k0);
+    k1 = sqrt(k1);
+    if (k1 < 1.0e-12) return -std::min(r[0], std::min(r[1], r[2]));
+    return k0 * (k0 - 1.0) / k1;
+  }
+}
+
+template <class T, unsigned int D>
+void synthetic_cohort<T,D>::operator()()
+{
+  if (this->max_modes() == 0)
+  {
+    std::cerr << "synthetic_cohort:: unknown synthetic_shape " << m_shape
+              << " (ellipsoid, torus or bumpy_sphere)" << std::endl;
+    throw 1;
+  }
+  if (m_shapes < 1 || m_resolution < 8)
+  {
+    std::cerr << "synthetic_cohort:: need at least 1 shape and a resolution of 8" << std::endl;
+    throw 1;
+  }
+  if (m_modes < 0 || m_modes > static_cast<int>(this->max_modes()))
+  {
+    std::cerr << "synthetic_cohort:: " << m_shape << " has " << this->max_modes()
+              << " modes, using that many" << std::endl;
+    m_modes = this->max_modes();
+  }
+
+  // Draw all of the mode coefficients first, so that the cohort depends
+  // only on the seed.
+  vnl_random rng(static_cast<unsigned long>(m_seed));
+  std::vector< std::vector<double> > coefficients(m_shapes);
+  for (int s = 0; s < m_shapes; s++)
+  {
+    coefficients[s].resize(m_modes);
+    for (int m = 0; m < m_modes; m++)
+    {
+      coefficients[s][m] = m_variation * rng.normal64();
+    }
+  }
+
+  std::ofstream modes_file((m_prefix + ".modes").c_str());
+  if (!modes_file)
+  {
+    std::cerr << "synthetic_cohort:: could not write " << m_prefix << ".modes" << std::endl;
+    throw 1;
+  }
+  for (int s = 0; s < m_shapes; s++)
+  {
+    for (int m = 0; m < m_modes; m++)
+    {
+      modes_file << (m > 0 ? " " : "") << coefficients[s][m];
+    }
+    modes_file << std::endl;
+  }
+  modes_file.close();
+
+  const double half = this->extent();
+  const double spacing = 2.0 * half / m_resolution;
+
+  typename image_type::RegionType region;
+  typename image_type::SizeType size;
+  typename image_type::IndexType index;
+  double origin[D];
+  double spacings[D];
+  for (unsigned int i = 0; i < D; i++)
+  {
+    size[i] = m_resolution;
+    index[i] = 0;
+    origin[i] = -half + 0.5 * spacing;
+    spacings[i] = spacing;
+  }
+  region.SetSize(size);
+  region.SetIndex(index);
+
+  int digits = 3;
+  for (int n = m_shapes - 1; n >= 1000; n /= 10) digits++;
+
+  std::vector<std::string> files(m_shapes);
+  for (int s = 0; s < m_shapes; s++)
+  {
+    char num[32];
+    sprintf(num, ".%0*d_DT.nrrd", digits, s);
+    files[s] = m_prefix + num;
+
+    // One image at a time, filled a slice per thread, so that memory stays
+    // at one volume even at high resolution.
+    typename image_type::Pointer img = image_type::New();
+    img->SetRegions(region);
+    img->SetOrigin(origin);
+    img->SetSpacing(spacings);
+    img->Allocate();
+
+    T *buffer = img->GetBufferPointer();
+    const long n = m_resolution;
+    const std::vector<double> &c = coefficients[s];
+
+#pragma omp parallel for schedule(dynamic, 1)
+    for (long z = 0; z < n; z++)
+    {
+      double p[3];
+      p[2] = origin[2] + z * spacing;
+      T *slice = buffer + z * n * n;
+      for (long y = 0; y < n; y++)
+      {
+        p[1] = origin[1] + y * spacing;
+        for (long x = 0; x < n; x++)
+        {
+          p[0] = origin[0] + x * spacing;
+          slice[y * n + x] = static_cast<T>(this->distance(p, c));
+        }
+      }
+    }
+
+    typename itk::ImageFileWriter<image_type>::Pointer writer =
+      itk::ImageFileWriter<image_type>::New();
+    writer->SetFileName(files[s].c_str());
+    writer->SetInput(img);
+    writer->SetUseCompression(true);
+    writer->Update();
+
+    std::cerr << "synthetic_cohort:: wrote " << files[s] << std::endl;
+  }
+
+  this->write_parameters(files);
+}
+
+template <class T, unsigned int D>
+void synthetic_cohort<T,D>::write_parameters(const std::vector<std::string> &files) const
+{
+  // The run file lives next to the images, and lists them by name only.
+  const std::string base = m_prefix.substr(m_prefix.find_last_of("/") + 1);
+
+  int particles = 1;
+  while (particles < m_particles) particles *= 2;
+  if (particles != m_particles)
+  {
+    std::cerr << "synthetic_cohort:: using " << particles << " particles" << std::endl;
+  }
+
+  std::ofstream out((m_prefix + ".run.xml").c_str());
+  if (!out)
+  {
+    std::cerr << "synthetic_cohort:: could not write " << m_prefix << ".run.xml" << std::endl;
+    throw 1;
+  }
+  out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+      << "<!--Synthetic " << m_shape << " cohort, " << m_modes << " modes of variation "
+      << m_variation << ", seed " << m_seed << "; coefficients in " << base << ".modes-->\n"
+      << "<number_of_particles>" << particles << "</number_of_particles>\n"
+      << "<iterations_per_split>100</iterations_per_split>\n"
+      << "<starting_regularization>1000</starting_regularization>\n"
+      << "<ending_regularization>10</ending_regularization>\n"
+      << "<optimization_iterations>100</optimization_iterations>\n"
+      << "<output_points_prefix>" << base << "</output_points_prefix>\n"
+      << "<inputs>\n";
+  for (unsigned int s = 0; s < files.size(); s++)
+  {
+    out << files[s].substr(files[s].find_last_of("/") + 1) << "\n";
+  }
+  out << "</inputs>\n";
+}
+
+} // end namespace
+
+#endif
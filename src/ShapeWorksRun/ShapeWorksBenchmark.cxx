@@ -0,0 +1,80 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: ShapeWorksBenchmark.cxx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "ShapeWorksBenchmarkApp.h"
+#include "CS6350.h"
+
+int main(int argc, char *argv[])
+{
+  try
+    {
+    if (argc < 3)
+      {
+      std::cerr << "Use: " << argv[0] << " results.csv parameterfile [parameterfile ...]"
+                << std::endl;
+      std::cerr << "Set SW_BENCHMARK_SECONDS to change the minimum time per kernel (1 s)."
+                << std::endl;
+      return 1;
+      }
+
+    // Results are appended, so that several invocations can share one file.
+    bool empty = true;
+      {
+      std::ifstream in(argv[1]);
+      empty = (in.is_open() == false || in.peek() == std::ifstream::traits_type::eof());
+      }
+    std::ofstream out(argv[1], std::ios::app);
+    if (out.is_open() == false)
+      {
+      std::cerr << "Could not open " << argv[1] << std::endl;
+      return 1;
+      }
+    if (empty == true) ShapeWorksBenchmarkApp<>::WriteHeader(out);
+
+    for (int i = 2; i < argc; i++)
+      {
+      ShapeWorksBenchmarkApp<> app(argv[i]);
+      if (getenv("SW_BENCHMARK_SECONDS") != NULL)
+        {
+        app.SetMinimumSeconds(atof(getenv("SW_BENCHMARK_SECONDS")));
+        }
+      app.RunBenchmarks();
+      app.WriteResults(out);
+      out.flush();
+      }
+    }
+  catch (itk::ExceptionObject &e)
+    {
+    std::cerr << e << std::endl;
+    return 1;
+    }
+  catch( CS6350::exception & eg )
+    {
+    std::cerr << eg << std::endl;
+    return 2;
+    }
+  catch( std::exception & ex )
+    {
+    std::cerr << ex.what() << std::endl;
+    return 3;
+    }
+  catch( ... )
+    {
+    std::cerr << "Unknown exception" << std::endl;
+    return 5;
+    }
+
+  std::cerr << "*** ShapeWorksBenchmark completed successfully\n";
+  return 0;
+}
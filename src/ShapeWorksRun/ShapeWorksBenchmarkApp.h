@@ -0,0 +1,122 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: ShapeWorksBenchmarkApp.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __ShapeWorksBenchmarkApp_h
+#define __ShapeWorksBenchmarkApp_h
+
+#include "ShapeWorksRunApp.h"
+#include "itkRealTimeClock.h"
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * \class ShapeWorksBenchmarkApp
+ *
+ * Times ShapeWorksRun on a parameter file.  The full optimization (Run) is
+ * timed first, with the wall time and the particle count of every optimizer
+ * iteration recorded.  The main kernels of the optimizer are then timed on
+ * their own against the optimized particle system, so that the numbers
+ * reflect realistic neighborhood sizes and sigmas:
+ *
+ *   neighborhood_query  ParticleSystem::FindNeighborhoodPoints
+ *   sigma_estimation    ParticleEntropyGradientFunction::EstimateSigma
+ *   covariance          ParticleEnsembleEntropyFunction::ComputeCovarianceMatrix
+ *   procrustes          ParticleProcrustesRegistration::RunRegistration
+ *   projection          ParticleDomain::ApplyConstraints
+ *
+ * Each kernel is repeated until at least MinimumSeconds have passed.  Results
+ * are written as CSV rows, see WriteResults.
+ */
+template< typename SAMPLERTYPE
+          = itk::MaximumEntropyCorrespondenceSampler<itk::Image<float, 3> > >
+class ShapeWorksBenchmarkApp : public ShapeWorksRunApp<SAMPLERTYPE>
+{
+public:
+  typedef ShapeWorksRunApp<SAMPLERTYPE> Superclass;
+  typedef itk::ParticleSystem<3>::PointType PointType;
+  typedef itk::ParticleSystem<3>::PointVectorType PointVectorType;
+
+  /** One timed benchmark.  An item is one unit of work of the benchmark,
+      e.g. one particle update or one neighborhood query. */
+  struct Result
+  {
+    std::string name;
+    unsigned long repetitions;
+    double seconds;
+    double items;
+  };
+
+  ShapeWorksBenchmarkApp(const char *fn);
+  virtual ~ShapeWorksBenchmarkApp() {}
+
+  /** Runs the optimization and then the kernel benchmarks. */
+  void RunBenchmarks();
+
+  /** Writes one CSV row per result, prefixed with the parameter file name.
+      The columns are input, benchmark, repetitions, wall_seconds,
+      seconds_per_repetition and items_per_second. */
+  void WriteResults(std::ostream &out) const;
+
+  /** Writes the CSV column names. */
+  static void WriteHeader(std::ostream &out);
+
+  void SetMinimumSeconds(double s)
+  { m_MinimumSeconds = s; }
+  double GetMinimumSeconds() const
+  { return m_MinimumSeconds; }
+
+protected:
+  void BenchmarkCallback(itk::Object *, const itk::EventObject &);
+  void StartCallback(itk::Object *, const itk::EventObject &);
+
+  void TimeOptimization();
+  void TimeNeighborhoodQueries();
+  void TimeSigmaEstimation();
+  void TimeCovariance();
+  void TimeProcrustes();
+  void TimeProjection();
+
+  /** Neighborhood radius used by the gradient function for particle k of
+      domain d, as in ParticleEntropyGradientFunction::Evaluate. */
+  double NeighborhoodRadius(unsigned int k, unsigned int d) const;
+
+  unsigned long GetTotalNumberOfParticles() const;
+  double Now() const
+  { return m_Clock->GetTimeInSeconds(); }
+  bool Done(unsigned long reps, double start) const
+  { return reps >= 3 && this->Now() - start >= m_MinimumSeconds; }
+  void AddResult(const std::string &name, unsigned long reps, double seconds,
+                 double items);
+
+  typename itk::MemberCommand<ShapeWorksBenchmarkApp>::Pointer m_Benchmarkcmd;
+  typename itk::MemberCommand<ShapeWorksBenchmarkApp>::Pointer m_Startcmd;
+  itk::RealTimeClock::Pointer m_Clock;
+
+  std::string m_FileName;
+  double m_MinimumSeconds;
+  std::vector<Result> m_Results;
+
+  // Per-iteration record of the optimization
+  double m_LastIterationTime;
+  std::vector<double> m_IterationSeconds;
+  std::vector<unsigned long> m_IterationParticles;
+};
+
+#if ITK_TEMPLATE_EXPLICIT
+#include "Templates/ShapeWorksBenchmarkApp.txx+-.h"
+#endif
+
+#if ITK_TEMPLATE_TXX
+#include "ShapeWorksBenchmarkApp.txx"
+#endif
+
+#endif
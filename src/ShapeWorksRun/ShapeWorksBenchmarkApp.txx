@@ -0,0 +1,348 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: ShapeWorksBenchmarkApp.txx,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#include "itkParticleImageDomainWithGradients.h"
+#include <cmath>
+#include <iostream>
+
+template <class SAMPLERTYPE>
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::ShapeWorksBenchmarkApp(const char *fn)
+  : ShapeWorksRunApp<SAMPLERTYPE>(fn)
+{
+  m_FileName = fn;
+  m_MinimumSeconds = 1.0;
+  m_LastIterationTime = 0.0;
+  m_Clock = itk::RealTimeClock::New();
+
+  m_Benchmarkcmd = itk::MemberCommand<ShapeWorksBenchmarkApp>::New();
+  m_Benchmarkcmd->SetCallbackFunction(this, &ShapeWorksBenchmarkApp::BenchmarkCallback);
+  this->m_Sampler->GetOptimizer()->AddObserver(itk::IterationEvent(), m_Benchmarkcmd);
+
+  m_Startcmd = itk::MemberCommand<ShapeWorksBenchmarkApp>::New();
+  m_Startcmd->SetCallbackFunction(this, &ShapeWorksBenchmarkApp::StartCallback);
+  this->m_Sampler->GetOptimizer()->AddObserver(itk::StartEvent(), m_Startcmd);
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::RunBenchmarks()
+{
+  m_Results.clear();
+
+  this->TimeOptimization();
+
+  // The kernel timings below are written directly.
+  itk::ParticleLog::Flush();
+  std::cerr << "------------------------------\n";
+  std::cerr << "*** Kernel Benchmarks\n";
+  std::cerr << "------------------------------\n";
+
+  this->TimeNeighborhoodQueries();
+  this->TimeSigmaEstimation();
+  this->TimeCovariance();
+  this->TimeProjection();
+  // Last, since it changes the transforms of the particle system.
+  this->TimeProcrustes();
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::StartCallback(itk::Object *, const itk::EventObject &)
+{
+  // The first iteration of a stage is timed from the optimizer start, not
+  // from the last iteration of the previous stage.
+  m_LastIterationTime = this->Now();
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::BenchmarkCallback(itk::Object *, const itk::EventObject &)
+{
+  const double now = this->Now();
+  m_IterationSeconds.push_back(now - m_LastIterationTime);
+  m_IterationParticles.push_back(this->GetTotalNumberOfParticles());
+  m_LastIterationTime = now;
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::TimeOptimization()
+{
+  m_IterationSeconds.clear();
+  m_IterationParticles.clear();
+
+  const double start = this->Now();
+  this->Run();
+  const double seconds = this->Now() - start;
+
+  // Particle updates, counting every particle of every iteration.  Time
+  // spent outside of the optimizer (reading inputs, splitting, writing,
+  // Procrustes between stages) is in the total wall time only.
+  double updates = 0.0;
+  double iteration_seconds = 0.0;
+  for (unsigned int i = 0; i < m_IterationSeconds.size(); i++)
+    {
+    updates += m_IterationParticles[i];
+    iteration_seconds += m_IterationSeconds[i];
+    }
+
+  this->AddResult("optimize_total", 1, seconds, updates);
+  this->AddResult("optimize_iteration", m_IterationSeconds.size(),
+                  iteration_seconds, updates);
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::TimeNeighborhoodQueries()
+{
+  const itk::ParticleSystem<3> *ps = this->m_Sampler->GetParticleSystem();
+
+  std::vector< std::vector<double> > radius(ps->GetNumberOfDomains());
+  for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+    {
+    radius[d].resize(ps->GetNumberOfParticles(d));
+    for (unsigned int k = 0; k < radius[d].size(); k++)
+      {
+      radius[d][k] = this->NeighborhoodRadius(k, d);
+      }
+    }
+
+  unsigned long reps = 0;
+  double found = 0.0;
+  const double start = this->Now();
+  do
+    {
+    for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+      {
+      for (unsigned int k = 0; k < radius[d].size(); k++)
+        {
+        found += ps->FindNeighborhoodPoints(k, radius[d][k], d).size();
+        }
+      }
+    reps++;
+    }
+  while (this->Done(reps, start) == false);
+
+  std::cerr << "Mean neighborhood size " << found / (reps * this->GetTotalNumberOfParticles())
+            << std::endl;
+  this->AddResult("neighborhood_query", reps, this->Now() - start,
+                  static_cast<double>(reps) * this->GetTotalNumberOfParticles());
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::TimeSigmaEstimation()
+{
+  typedef itk::ParticleImageDomainWithGradients<float, 3> DomainType;
+  const itk::ParticleSystem<3> *ps = this->m_Sampler->GetParticleSystem();
+  const itk::ParticleEntropyGradientFunction<float, 3> *f
+    = this->m_Sampler->GetGradientFunction();
+  const double epsilon = 1.0e-6;
+
+  // The neighborhoods and their weights are gathered up front so that only
+  // the estimation itself is timed.
+  std::vector< std::vector<PointVectorType> > neighborhood(ps->GetNumberOfDomains());
+  std::vector< std::vector< std::vector<double> > > weights(ps->GetNumberOfDomains());
+  std::vector< std::vector<double> > sigma(ps->GetNumberOfDomains());
+  for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+    {
+    const DomainType *domain = static_cast<const DomainType *>(ps->GetDomain(d));
+    const unsigned int n = ps->GetNumberOfParticles(d);
+    neighborhood[d].resize(n);
+    weights[d].resize(n);
+    sigma[d].resize(n);
+    for (unsigned int k = 0; k < n; k++)
+      {
+      const double r = this->NeighborhoodRadius(k, d);
+      neighborhood[d][k] = ps->FindNeighborhoodPoints(k, r, d);
+      f->ComputeAngularWeights(ps->GetPosition(k, d), neighborhood[d][k], domain,
+                               weights[d][k]);
+      sigma[d][k] = r / f->GetNeighborhoodToSigmaRatio();
+      }
+    }
+
+  unsigned long reps = 0;
+  unsigned long failures = 0;
+  const double start = this->Now();
+  do
+    {
+    for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+      {
+      for (unsigned int k = 0; k < sigma[d].size(); k++)
+        {
+        int err;
+        f->EstimateSigma(k, neighborhood[d][k], weights[d][k], ps->GetPosition(k, d),
+                         sigma[d][k], epsilon, err);
+        if (err != 0) failures++;
+        }
+      }
+    reps++;
+    }
+  while (this->Done(reps, start) == false);
+
+  std::cerr << "Sigma estimation failures " << failures / reps << std::endl;
+  this->AddResult("sigma_estimation", reps, this->Now() - start,
+                  static_cast<double>(reps) * this->GetTotalNumberOfParticles());
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::TimeCovariance()
+{
+  if (this->m_Sampler->GetParticleSystem()->GetNumberOfDomains() < 2)
+    {
+    std::cerr << "Skipping covariance benchmark for a single shape" << std::endl;
+    return;
+    }
+
+  unsigned long reps = 0;
+  const double start = this->Now();
+  do
+    {
+    this->m_Sampler->GetEnsembleEntropyFunction()->ComputeCovarianceMatrix();
+    reps++;
+    }
+  while (this->Done(reps, start) == false);
+
+  this->AddResult("covariance", reps, this->Now() - start, static_cast<double>(reps));
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::TimeProcrustes()
+{
+  unsigned long reps = 0;
+  const double start = this->Now();
+  do
+    {
+    this->m_Procrustes->RunRegistration();
+    reps++;
+    }
+  while (this->Done(reps, start) == false);
+
+  this->AddResult("procrustes", reps, this->Now() - start,
+                  static_cast<double>(reps)
+                  * this->m_Sampler->GetParticleSystem()->GetNumberOfDomains());
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::TimeProjection()
+{
+  const itk::ParticleSystem<3> *ps = this->m_Sampler->GetParticleSystem();
+
+  // Every particle is moved off the surface by one voxel, in a direction
+  // that varies from particle to particle, and projected back.
+  std::vector< std::vector<PointType> > moved(ps->GetNumberOfDomains());
+  for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+    {
+    moved[d].resize(ps->GetNumberOfParticles(d));
+    for (unsigned int k = 0; k < moved[d].size(); k++)
+      {
+      double v[3] = { sin(1.0 + k), cos(1.3 * k), sin(2.1 * k + 0.5) };
+      const double norm = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) + 1.0e-12;
+      moved[d][k] = ps->GetPosition(k, d);
+      for (unsigned int i = 0; i < 3; i++)
+        {
+        moved[d][k][i] += this->m_spacing * v[i] / norm;
+        }
+      }
+    }
+
+  unsigned long reps = 0;
+  const double start = this->Now();
+  do
+    {
+    for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+      {
+      const itk::ParticleDomain<3> *domain = ps->GetDomain(d);
+      for (unsigned int k = 0; k < moved[d].size(); k++)
+        {
+        PointType p = moved[d][k];
+        domain->ApplyConstraints(p);
+        }
+      }
+    reps++;
+    }
+  while (this->Done(reps, start) == false);
+
+  this->AddResult("projection", reps, this->Now() - start,
+                  static_cast<double>(reps) * this->GetTotalNumberOfParticles());
+}
+
+template <class SAMPLERTYPE>
+double
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::NeighborhoodRadius(unsigned int k, unsigned int d) const
+{
+  const itk::ParticleEntropyGradientFunction<float, 3> *f
+    = this->m_Sampler->GetGradientFunction();
+
+  double sigma = f->GetSpatialSigmaCache()->operator[](d)->operator[](k);
+  if (sigma < 1.0e-6)
+    {
+    sigma = f->GetMinimumNeighborhoodRadius() / f->GetNeighborhoodToSigmaRatio();
+    }
+  double r = sigma * f->GetNeighborhoodToSigmaRatio();
+  if (r > f->GetMaximumNeighborhoodRadius())
+    {
+    r = f->GetMaximumNeighborhoodRadius();
+    }
+  return r;
+}
+
+template <class SAMPLERTYPE>
+unsigned long
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::GetTotalNumberOfParticles() const
+{
+  const itk::ParticleSystem<3> *ps = this->m_Sampler->GetParticleSystem();
+  unsigned long n = 0;
+  for (unsigned int d = 0; d < ps->GetNumberOfDomains(); d++)
+    {
+    n += ps->GetNumberOfParticles(d);
+    }
+  return n;
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::AddResult(const std::string &name, unsigned long reps,
+                                               double seconds, double items)
+{
+  Result r;
+  r.name = name;
+  r.repetitions = reps;
+  r.seconds = seconds;
+  r.items = items;
+  m_Results.push_back(r);
+
+  std::cerr << name << ": " << reps << " repetitions in " << seconds << " s" << std::endl;
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::WriteHeader(std::ostream &out)
+{
+  out << "input,benchmark,repetitions,wall_seconds,seconds_per_repetition,items_per_second"
+      << std::endl;
+}
+
+template <class SAMPLERTYPE>
+void
+ShapeWorksBenchmarkApp<SAMPLERTYPE>::WriteResults(std::ostream &out) const
+{
+  for (unsigned int i = 0; i < m_Results.size(); i++)
+    {
+    const Result &r = m_Results[i];
+    out << m_FileName << "," << r.name << "," << r.repetitions << "," << r.seconds << ","
+        << (r.repetitions > 0 ? r.seconds / r.repetitions : 0.0) << ","
+        << (r.seconds > 0.0 ? r.items / r.seconds : 0.0) << std::endl;
+    }
+}
@@ -26,6 +26,8 @@
 #include "itkCommand.h"
 #include <vector>
 #include "tinyxml.h"
+#include "ShapeWorksRunParameters.h"
+#include "ShapeWorksRunConvergence.h"
 #include "itkParticleProcrustesRegistration.h"
 #include <sstream>
 #include <string>
@@ -59,7 +61,7 @@ class ShapeWorksRunApp
   virtual void optimize_start();
   virtual void optimize_stop();
 
-  virtual void ReadInputs(const char *fname);
+  virtual void ReadInputs();
 
   virtual void ReadPrefixTransformFile(const std::string &s);
   virtual void ReadTransformFile();
@@ -86,7 +88,19 @@ class ShapeWorksRunApp
     m_Sampler->GetOptimizer()->AddObserver(itk::IterationEvent(), m_Iteratecmd);
   }
   
-  void SetUserParameters(const char *fname);
+  void SetUserParameters();
+
+  /** Runs the sampler for one stage of at most the given number of
+      iterations, stopping early if the stage converges (see
+      ShapeWorksRunConvergence), and logs why the stage stopped. */
+  void RunStage(const char *stage, unsigned int iterations);
+
+  /** Energy of the active correspondence term, or 0 if it has none. */
+  double GetCorrespondenceEnergy() const;
+
+  /** Number of times the correspondence energy has been recomputed, or 0 if
+      there is no correspondence term. */
+  unsigned long GetNumberOfCorrespondenceUpdates() const;
   
   virtual void SplitAllParticles()
   {
@@ -108,9 +122,9 @@ class ShapeWorksRunApp
   virtual void WriteTransformFile( int iter = -1 ) const;
   virtual void WriteParameters( int iter = -1 );  
 
-  void ReadExplanatoryVariables(const char *fname);
+  void ReadExplanatoryVariables();
 
-  void FlagDomainFct(const char *fname);
+  void FlagDomainFct();
 
   typename itk::MemberCommand< ShapeWorksRunApp<SamplerType> >::Pointer m_Iteratecmd;
   
@@ -121,6 +135,10 @@ protected:
   int m_CheckpointCounter;
   int m_ProcrustesCounter;
   
+  /** Reads a list of volumes concurrently, in order. */
+  void ReadImages(const std::vector<std::string> &files,
+                  std::vector<typename ImageType::Pointer> &images);
+
   static ITK_THREAD_RETURN_TYPE optimize_callback( void *arg );
   //  static ITK_THREAD_RETURN_TYPE auto_init_callback( void *arg );  
 
@@ -133,6 +151,9 @@ protected:
   bool m_use_regression;
   bool m_use_mixed_effects;
 
+  // The parsed parameter file
+  ShapeWorksRunParameters m_parameters;
+
   // User-specified parameters
   int m_optimization_iterations;
   int m_optimization_iterations_completed;
@@ -145,6 +166,8 @@ protected:
   double m_starting_regularization;
   double m_ending_regularization;
   int m_recompute_regularization_interval;
+  double m_recompute_regularization_tolerance;
+  int m_recompute_regularization_max_interval;
   double m_relative_weighting;
   double m_norm_penalty_weighting;
   double m_initial_relative_weighting;
@@ -162,6 +185,16 @@ protected:
   int m_spheres_per_domain;
   int m_adaptivity_mode;
   int m_keep_checkpoints;
+  double m_domain_memory_limit;
+  std::string m_domain_cache_directory;
+  int m_io_threads;
+  ShapeWorksRunConvergence m_convergence;
+  unsigned long m_correspondence_updates;
+  double m_active_set_tolerance;
+  unsigned int m_active_set_recheck_interval;
+  double m_verlet_skin;
+  int m_verbosity;
+  int m_log_asynchronous;
 };
 
 #if ITK_TEMPLATE_EXPLICIT
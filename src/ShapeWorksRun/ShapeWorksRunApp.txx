@@ -14,6 +14,7 @@
 =========================================================================*/
 #include "itkImageFileReader.h"
 #include "itkMultiThreader.h"
+#include "itkParticleLog.h"
 #include "tinyxml.h"
 #include <sstream>
 #include <string>
@@ -42,18 +43,30 @@ ShapeWorksRunApp<SAMPLERTYPE>::ShapeWorksRunApp(const char *fn)
   m_disable_procrustes = true;
   m_disable_checkpointing = true;
   m_optimizing = false;
+  m_correspondence_updates = 0;
   m_use_normal_penalty = false;
   m_use_initial_normal_penalty = false;
   m_use_regression = false;
   m_use_mixed_effects = false;
   
-  // Read parameter file
-  this->SetUserParameters(fn);
+  // Read parameter file.  It is parsed once here; all of the methods below
+  // take their values from m_parameters.
+  if (m_parameters.Read(fn) == false)
+  {
+    itkParticleLogMacro(Errors, "Could not read parameter file " << fn << std::endl);
+  }
+  this->SetUserParameters();
+
+  // From here on, output goes through the background writer if asked for.
+  itk::ParticleLog::SetAsynchronous(m_log_asynchronous != 0);
 
   // Set up the optimization process
   m_Sampler = itk::MaximumEntropyCorrespondenceSampler<ImageType>::New();  
   m_Sampler->SetDomainsPerShape(m_domains_per_shape); // must be done first!
   m_Sampler->SetTimeptsPerIndividual(m_timepts_per_subject);
+  m_Sampler->SetDomainConstructionMemoryLimit(m_domain_memory_limit);
+  m_Sampler->SetDomainFieldCacheDirectory(m_domain_cache_directory);
+  m_Sampler->SetVerletSkin(m_verlet_skin);
 
   // Set up the procrustes registration object.
   m_Procrustes = itk::ParticleProcrustesRegistration<3>::New();
@@ -62,12 +75,12 @@ ShapeWorksRunApp<SAMPLERTYPE>::ShapeWorksRunApp(const char *fn)
   if (m_procrustes_scaling == 0)
     {
     m_Procrustes->ScalingOff();
-    std::cout << "Procrustes scaling is off" << std::endl;
+    itkParticleLogMacro(Info, "Procrustes scaling is off" << std::endl);
     }
   else
     {
     m_Procrustes->ScalingOn();
-    std::cout << "Procrustes scaling is on" << std::endl;
+    itkParticleLogMacro(Info, "Procrustes scaling is on" << std::endl);
     }
 
   //   // Read fixed scales if present
@@ -87,11 +100,11 @@ ShapeWorksRunApp<SAMPLERTYPE>::ShapeWorksRunApp(const char *fn)
   // SCALE ON OR OFF
   
   //this->ReadInputs(pf);
-  this->ReadInputs(fn);
+  this->ReadInputs();
   this->SetIterationCommand();
   this->InitializeSampler();
-  this->ReadExplanatoryVariables(fn);
-  this->FlagDomainFct(fn);
+  this->ReadExplanatoryVariables();
+  this->FlagDomainFct();
   
   // Now read the transform file if present.
   if ( m_transform_file != "" )       this->ReadTransformFile();
@@ -102,8 +115,19 @@ template < class SAMPLERTYPE>
 void
 ShapeWorksRunApp<SAMPLERTYPE>::IterateCallback(itk::Object *, const itk::EventObject &)
 {
-  std::cout << ".";
-  std::cout.flush();
+  itkParticleLogMacro(Iterations, ".");
+
+  // The correspondence energy only changes when the covariance is recomputed.
+  const unsigned long updates = this->GetNumberOfCorrespondenceUpdates();
+  const bool updated = (updates != m_correspondence_updates);
+  m_correspondence_updates = updates;
+
+  if (m_convergence.Update(m_Sampler->GetOptimizer()->GetAverageEnergy(),
+                           this->GetCorrespondenceEnergy(), updated,
+                           m_Sampler->GetOptimizer()->GetMaximumMove()) == true)
+    {
+    this->optimize_stop();
+    }
 
   if (m_optimizing == false) return;
   
@@ -180,311 +204,250 @@ ShapeWorksRunApp<SAMPLERTYPE>::IterateCallback(itk::Object *, const itk::EventOb
 
 template < class SAMPLERTYPE>
 void
-ShapeWorksRunApp<SAMPLERTYPE>::ReadInputs(const char *fname)
+ShapeWorksRunApp<SAMPLERTYPE>::ReadInputs()
 {
-  TiXmlDocument doc(fname);
-  bool loadOkay = doc.LoadFile();
+  int numShapes = 0;
 
-  if (loadOkay)
+  // load input shapes
+  std::vector<std::string> shapeFiles;
+  if (m_parameters.GetList("inputs", shapeFiles) == false || shapeFiles.size() == 0)
   {
-    TiXmlHandle docHandle( &doc );
-    TiXmlElement *elem;
+    itkParticleLogMacro(Errors, "No input files have been specified" << std::endl);
+    throw 1;
+  }
+  else
+  {
+    numShapes = shapeFiles.size();
+
+    // try to fix the parameter file's input data names to match the parameter file's path
+    std::string pname(m_parameters.GetFileName());
+    std::string path = pname.substr(0,pname.find_last_of("/") + 1);
+    std::ifstream test(shapeFiles[0].c_str());
+    if (!test.is_open()) {
+      for (int i = 0; i < shapeFiles.size(); i++) {
+        shapeFiles[i] = path + shapeFiles[i];
+      }
+    } else test.close();
+
+    std::vector<typename ImageType::Pointer> images;
+    this->ReadImages(shapeFiles, images);
+    for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
+    {
+      m_Sampler->SetInput(shapeCount, images[shapeCount]); // set the ith input
+    }
 
-    std::istringstream inputsBuffer;
-    std::string filename;
-    int numShapes = 0;
+    // Use the first loaded image to set some numerical constants
+    m_spacing = images[0]->GetSpacing()[0];
+  }
 
-    // load input shapes
-    std::vector<std::string> shapeFiles;
-    elem = docHandle.FirstChild( "inputs" ).Element();
-    if (!elem)
+  // load point files
+  std::vector<std::string> pointFiles;
+  if (m_parameters.GetList("point_files", pointFiles))
+  {
+    // read point files only if they are all present
+    if (pointFiles.size() < numShapes)
     {
-      std::cerr << "No input files have been specified" << std::endl;
-      throw 1;
+      itkParticleLogMacro(Errors, "not enough point files, none will be loaded" << std::endl);
     }
     else
     {
-      inputsBuffer.str(elem->GetText());
-      while (inputsBuffer >> filename)
-      {
-        shapeFiles.push_back(filename);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
-
-      numShapes = shapeFiles.size();
-	  
-	  // try to fix the parameter file's input data names to match the parameter file's path
-	  std::string pname(fname);
-	  std::string path = pname.substr(0,pname.find_last_of("/") + 1);
-	  std::ifstream test(shapeFiles[0].c_str());
-	  if (!test.is_open()) {
-		  for (int i = 0; i < shapeFiles.size(); i++) {
-			  shapeFiles[i] = path + shapeFiles[i];
-		  }
-	  } else test.close();
-
       for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
       {
-        typename itk::ImageFileReader<ImageType>::Pointer reader = itk::ImageFileReader<ImageType>::New();
-        reader->SetFileName(shapeFiles[shapeCount].c_str());
-        reader->UpdateLargestPossibleRegion();
-        m_Sampler->SetInput(shapeCount, reader->GetOutput()); // set the ith input
-
-        // Use the first loaded image to set some numerical constants
-        if (shapeCount == 0)
-        {
-          m_spacing = reader->GetOutput()->GetSpacing()[0];
-        }
+        m_Sampler->SetPointsFile(shapeCount, pointFiles[shapeCount]);
       }
-
-      shapeFiles.clear();
     }
-
-    // load point files
-    std::vector<std::string> pointFiles;
-    elem = docHandle.FirstChild( "point_files" ).Element();
-    if (elem)
-    {
-      inputsBuffer.str(elem->GetText());
-      while (inputsBuffer >> filename)
-      {
-        pointFiles.push_back(filename);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
-
-      // read point files only if they are all present
-      if (pointFiles.size() < numShapes)
-      {
-        std::cerr << "not enough point files, none will be loaded" << std::endl;
-      }
-      else
-      {
-        for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
-        {
-          m_Sampler->SetPointsFile(shapeCount, pointFiles[shapeCount]);
-        }
-      }
-
-      pointFiles.clear();
-    }   
+  }
 
 
 #ifdef SW_USE_MESH
-    // load mesh files
-    std::vector<std::string> meshFiles;
-    elem = docHandle.FirstChild( "mesh_files" ).Element();
-    if (elem)
+  // load mesh files
+  std::vector<std::string> meshFiles;
+  if (m_parameters.GetList("mesh_files", meshFiles))
+  {
+    // read mesh files only if they are all present
+    if (meshFiles.size() < numShapes)
     {
-      inputsBuffer.str(elem->GetText());
-      while (inputsBuffer >> filename)
-      {
-        meshFiles.push_back(filename);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
-
-      // read mesh files only if they are all present
-      if (meshFiles.size() < numShapes)
-      {
-        std::cerr << "not enough mesh files, none will be loaded" << std::endl;
-      }
-      else
+      itkParticleLogMacro(Errors, "not enough mesh files, none will be loaded" << std::endl);
+    }
+    else
+    {
+      for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
       {
-        for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
-        {
-          m_Sampler->SetMeshFile(shapeCount, meshFiles[shapeCount]);
-        }
+        m_Sampler->SetMeshFile(shapeCount, meshFiles[shapeCount]);
       }
-
-      meshFiles.clear();
     }
+  }
 
 
 #endif
 
-    // read geometric constraints, if present
-    // cutting planes
-    elem = docHandle.FirstChild( "cutting_planes" ).Element();
-    if (elem)
+  // read geometric constraints, if present
+  // cutting planes
+  std::vector<double> cpVals;
+  if (m_parameters.GetList("cutting_planes", cpVals))
+  {
+    if (cpVals.size() < 9*numShapes)
     {
-      inputsBuffer.str(elem->GetText());
-
-      std::vector<double> cpVals;
-      double pt;
-
-      while (inputsBuffer >> pt)
-      {
-        cpVals.push_back(pt);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
+      itkParticleLogMacro(Errors, "ERROR: Incomplete cutting plane data! No cutting planes will be loaded!!" << std::endl);
+    }
+    else
+    {
+      vnl_vector_fixed<double,3> a,b,c;
+      int ctr = 0;
 
-      if (cpVals.size() < 9*numShapes)
+      for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
       {
-        std::cerr << "ERROR: Incomplete cutting plane data! No cutting planes will be loaded!!" << std::endl;
-      }
-      else
-      {
-        vnl_vector_fixed<double,3> a,b,c;
-        int ctr = 0;
-
-        for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
-        {
-          a[0] = cpVals[ctr++];
-          a[1] = cpVals[ctr++];
-          a[2] = cpVals[ctr++];
-
-          b[0] = cpVals[ctr++];
-          b[1] = cpVals[ctr++];
-          b[2] = cpVals[ctr++];
-
-          c[0] = cpVals[ctr++];
-          c[1] = cpVals[ctr++];
-          c[2] = cpVals[ctr++];
-
-          std::cout << "CorrespondenceApp-> Setting Cutting Plane "
-                    << shapeCount << " (" << a << ") (" << b << ") (" << c << ")"<< std::endl;
-          
-          m_Sampler->SetCuttingPlane(shapeCount,a,b,c);
-        }
+        a[0] = cpVals[ctr++];
+        a[1] = cpVals[ctr++];
+        a[2] = cpVals[ctr++];
+
+        b[0] = cpVals[ctr++];
+        b[1] = cpVals[ctr++];
+        b[2] = cpVals[ctr++];
+
+        c[0] = cpVals[ctr++];
+        c[1] = cpVals[ctr++];
+        c[2] = cpVals[ctr++];
+
+        itkParticleLogMacro(Info, "CorrespondenceApp-> Setting Cutting Plane "
+                            << shapeCount << " (" << a << ") (" << b << ") (" << c << ")"<< std::endl);
+        
+        m_Sampler->SetCuttingPlane(shapeCount,a,b,c);
       }
     }
+  }
 
-    // sphere radii and centers
-    this->m_spheres_per_domain = 0;
-    elem = docHandle.FirstChild( "spheres_per_domain" ).Element();
-    if (elem) this->m_spheres_per_domain = atoi(elem->GetText());
+  // sphere radii and centers
+  this->m_spheres_per_domain = 0;
+  m_parameters.Get("spheres_per_domain", this->m_spheres_per_domain);
 
-    int numSpheres = numShapes * this->m_spheres_per_domain;
-    std::vector<double> radList;
-    double r;
+  int numSpheres = numShapes * this->m_spheres_per_domain;
+  std::vector<double> radList;
 
-    elem = docHandle.FirstChild( "sphere_radii" ).Element();
-    if (elem)
+  if (m_parameters.GetList("sphere_radii", radList))
+  {
+    if (radList.size() < numSpheres)
     {
-      inputsBuffer.str(elem->GetText());
-
-      while (inputsBuffer >> r)
-      {
-        radList.push_back(r);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
-
-      if (radList.size() < numSpheres)
-      {
-        std::cerr << "ERROR: Incomplete sphere radius data! No spheres will be loaded!!" << std::endl;
-      }
-      else
+      itkParticleLogMacro(Errors, "ERROR: Incomplete sphere radius data! No spheres will be loaded!!" << std::endl);
+    }
+    else
+    {
+      std::vector<double> spVals;
+      if (m_parameters.GetList("sphere_centers", spVals))
       {
-        elem = docHandle.FirstChild( "sphere_centers" ).Element();
-        if (elem)
+        if (spVals.size() < 3*numSpheres)
         {
-          inputsBuffer.str(elem->GetText());
-
-          std::vector<double> spVals;
-          double pt;
-
-          while (inputsBuffer >> pt)
-          {
-            spVals.push_back(pt);
-          }
-          inputsBuffer.clear();
-          inputsBuffer.str("");
+          itkParticleLogMacro(Errors, "ERROR: Incomplete sphere center data! No spheres will be loaded!!" << std::endl);
+        }
+        else
+        {
+          vnl_vector_fixed<double,3> center;
+          double rad;
+          int c_ctr = 0;
+          int r_ctr = 0;
 
-          if (spVals.size() < 3*numSpheres)
-          {
-            std::cerr << "ERROR: Incomplete sphere center data! No spheres will be loaded!!" << std::endl;
-          }
-          else
+          for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
           {
-            vnl_vector_fixed<double,3> center;
-            double rad;
-            int c_ctr = 0;
-            int r_ctr = 0;
-
-            for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
+            for (int sphereCount = 0; sphereCount < m_spheres_per_domain; sphereCount++)
             {
-              for (int sphereCount = 0; sphereCount < m_spheres_per_domain; sphereCount++)
-              {
-                center[0] = spVals[c_ctr++];
-                center[1] = spVals[c_ctr++];
-                center[2] = spVals[c_ctr++];
+              center[0] = spVals[c_ctr++];
+              center[1] = spVals[c_ctr++];
+              center[2] = spVals[c_ctr++];
 
-                rad = radList[r_ctr++];
+              rad = radList[r_ctr++];
 
-                m_Sampler->AddSphere(shapeCount,center,rad);
-              }
+              m_Sampler->AddSphere(shapeCount,center,rad);
             }
           }
         }
       }
     }
+  }
 
-    // attributes
-    if (this->m_attributes_per_domain >= 1)
-    {
-      // attribute scales
-      double sc;
-      std::vector<double> attr_scales;
+  // attributes
+  if (this->m_attributes_per_domain >= 1)
+  {
+    // attribute scales
+    std::vector<double> attr_scales;
+    m_parameters.GetList("attribute_scales", attr_scales);
 
-      elem = docHandle.FirstChild( "attribute_scales" ).Element();
-      if (elem)
+    // attribute files
+    std::vector<std::string> attrFiles;
+    if (m_parameters.GetList("attribute_files", attrFiles))
+    {
+      if ( (attr_scales.size() < m_attributes_per_domain) || (attrFiles.size() < numShapes*m_attributes_per_domain) )
       {
-        inputsBuffer.str(elem->GetText());
-
-        while (inputsBuffer >> sc)
-        {
-          attr_scales.push_back(sc);
-        }
-        inputsBuffer.clear();
-        inputsBuffer.str("");
+        itkParticleLogMacro(Errors, "ERROR: Incomplete attribute scales or filenames ! No attributes will be loaded!!" << std::endl);
       }
-
-      // attribute files
-      std::vector<std::string> attrFiles;
-      elem = docHandle.FirstChild( "attribute_files" ).Element();
-      if (elem)
+      else
       {
-        inputsBuffer.str(elem->GetText());
+        m_Sampler->SetAttributeScales(attr_scales);
 
-        while (inputsBuffer >> filename)
-        {
-          attrFiles.push_back(filename);
-        }
+        attrFiles.resize(numShapes*m_attributes_per_domain);
+        std::vector<typename ImageType::Pointer> attrImages;
+        this->ReadImages(attrFiles, attrImages);
 
-        inputsBuffer.clear();
-        inputsBuffer.str("");
+        int ctr = 0;
 
-        if ( (attr_scales.size() < m_attributes_per_domain) || (attrFiles.size() < numShapes*m_attributes_per_domain) )
-        {
-          std::cerr << "ERROR: Incomplete attribute scales or filenames ! No attributes will be loaded!!" << std::endl;
-        }
-        else
+        for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
         {
-          m_Sampler->SetAttributeScales(attr_scales);
-
-          int ctr = 0;
-
-          for (int shapeCount = 0; shapeCount < numShapes; shapeCount++)
+          for (int attrCount = 0; attrCount < m_attributes_per_domain; attrCount++)
           {
-            for (int attrCount = 0; attrCount < m_attributes_per_domain; attrCount++)
-            {
-              typename itk::ImageFileReader<ImageType>::Pointer reader2 = itk::ImageFileReader<ImageType>::New();
-              reader2->SetFileName(attrFiles[ctr++].c_str());
-              reader2->Update();
-              m_Sampler->AddAttributeImage(shapeCount, reader2->GetOutput());
-            }
+            m_Sampler->AddAttributeImage(shapeCount, attrImages[ctr++]);
           }
         }
       }
     }
-
-  } // end: document check
+  }
 } // end ReadInputs
 
+template < class SAMPLERTYPE>
+void
+ShapeWorksRunApp<SAMPLERTYPE>::ReadImages(const std::vector<std::string> &files,
+                                          std::vector<typename ImageType::Pointer> &images)
+{
+  images.resize(files.size());
+  if (files.size() == 0) return;
+
+  // The first volume is read on its own, which also registers the ImageIO
+  // factories before any concurrent reads.  The rest are read (and
+  // decompressed) m_io_threads at a time.
+  typename itk::ImageFileReader<ImageType>::Pointer first = itk::ImageFileReader<ImageType>::New();
+  first->SetFileName(files[0].c_str());
+  first->UpdateLargestPossibleRegion();
+  images[0] = first->GetOutput();
+
+  const int num_threads = (m_io_threads > 0) ? m_io_threads : 1;
+  bool failed = false;
+  itk::ExceptionObject error;
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+  for (int i = 1; i < static_cast<int>(files.size()); i++)
+  {
+    try
+    {
+      typename itk::ImageFileReader<ImageType>::Pointer reader = itk::ImageFileReader<ImageType>::New();
+      reader->SetFileName(files[i].c_str());
+      reader->UpdateLargestPossibleRegion();
+      images[i] = reader->GetOutput();
+    }
+    catch (itk::ExceptionObject &e)
+    {
+#pragma omp critical
+      {
+        if (failed == false)
+        {
+          failed = true;
+          error = e;
+        }
+      }
+    }
+  }
+
+  // Exceptions may not leave the parallel loop; report the first one here.
+  if (failed == true) throw error;
+}
+
 
 template < class SAMPLERTYPE>
 void
@@ -580,7 +543,7 @@ ShapeWorksRunApp<SAMPLERTYPE>::ReadTransformFile()
   object_reader< itk::ParticleSystem<3>::TransformType > reader;
   reader.SetFileName(m_transform_file);
   reader.Update();
-  std::cout << "Read transform file " << m_transform_file << std::endl;
+  itkParticleLogMacro(Info, "Read transform file " << m_transform_file << std::endl);
   for (unsigned int i = 0; i < m_Sampler->GetParticleSystem()->GetNumberOfDomains();
        i++)
     {
@@ -596,7 +559,7 @@ ShapeWorksRunApp<SAMPLERTYPE>::ReadPrefixTransformFile(const std::string &fn)
   object_reader< itk::ParticleSystem<3>::TransformType > reader;
   reader.SetFileName(fn.c_str());
   reader.Update();
-  std::cout << "Read prefix transform file " << fn << std::endl;
+  itkParticleLogMacro(Info, "Read prefix transform file " << fn << std::endl);
   for (unsigned int i = 0; i < m_Sampler->GetParticleSystem()->GetNumberOfDomains();
        i++)
     {
@@ -632,7 +595,7 @@ ShapeWorksRunApp<SAMPLERTYPE>::WritePointFiles( int iter )
 
   int counter;
 
-  std::cout << "\n";
+  itkParticleLogMacro(Info, "\n");
   for (int i = 0; i < n; i++)
   {
     counter = 0;
@@ -646,11 +609,10 @@ ShapeWorksRunApp<SAMPLERTYPE>::WritePointFiles( int iter )
     std::ofstream out( local_file.c_str() );
     std::ofstream outw( world_file.c_str() );
 
-    std::cout << "Writing " << world_file << " ";
     
     if ( !out || !outw )
       {
-        std::cerr << "EnsembleSystem()::Error opening output file" << std::endl;
+        itkParticleLogMacro(Errors, "EnsembleSystem()::Error opening output file" << std::endl);
         throw 1;
       }
     
@@ -673,175 +635,195 @@ ShapeWorksRunApp<SAMPLERTYPE>::WritePointFiles( int iter )
     
     out.close();
     outw.close();
-    std::cout << " with " << counter << " points" << std::endl;
+    itkParticleLogMacro(Info, "Writing " << world_file << " with " << counter << " points" << std::endl);
   } // end for files
   }
 
 template < class SAMPLERTYPE>
 void
-ShapeWorksRunApp<SAMPLERTYPE>::SetUserParameters(const char *fname)
+ShapeWorksRunApp<SAMPLERTYPE>::SetUserParameters()
 {
+  // read values from parameter file: 1. set default value, 2. try to read XML tag, 3. if present, set new value
+  // Verbosity comes first, as it decides what is written below.
+  this->m_verbosity = itk::ParticleLog::Iterations;
+  m_parameters.Get("verbosity", this->m_verbosity);
+  itk::ParticleLog::SetLevel(this->m_verbosity);
 
-  TiXmlDocument doc(fname);
-  bool loadOkay = doc.LoadFile();
+  this->m_log_asynchronous = 1;
+  m_parameters.Get("log_asynchronous", this->m_log_asynchronous);
 
-  if (loadOkay)
-  {
-    TiXmlHandle docHandle( &doc );
-    TiXmlElement *elem;
-
-    // read values from parameter file: 1. set default value, 2. try to read XML tag, 3. if present, set new value
-    this->m_processing_mode = 3;
-    elem = docHandle.FirstChild( "processing_mode" ).Element();
-    if (elem) this->m_processing_mode = atoi(elem->GetText());
-
-    this->m_number_of_particles = 1024;
-    elem = docHandle.FirstChild( "number_of_particles" ).Element();
-    if (elem) this->m_number_of_particles = atoi(elem->GetText());
-
-    // Parameters with defaults
-    this->m_optimization_iterations = -1;
-    elem = docHandle.FirstChild( "optimization_iterations" ).Element();
-    if (elem) this->m_optimization_iterations = atoi(elem->GetText());
-      
+  this->m_processing_mode = 3;
+  m_parameters.Get("processing_mode", this->m_processing_mode);
+
+  this->m_number_of_particles = 1024;
+  m_parameters.Get("number_of_particles", this->m_number_of_particles);
+
+  // Parameters with defaults
+  this->m_optimization_iterations = -1;
+  m_parameters.Get("optimization_iterations", this->m_optimization_iterations);
+    
 	this->m_optimization_iterations_completed = 0;
-	elem = docHandle.FirstChild( "optimization_iterations_completed" ).Element();
-	if (elem) this->m_optimization_iterations_completed = atoi(elem->GetText());
+	m_parameters.Get("optimization_iterations_completed", this->m_optimization_iterations_completed);
 
-    this->m_output_points_prefix = "output_points";
-    elem = docHandle.FirstChild( "output_points_prefix" ).Element();
-    if (elem) this->m_output_points_prefix = elem->GetText();
+  this->m_output_points_prefix = "output_points";
+  m_parameters.Get("output_points_prefix", this->m_output_points_prefix);
 
-    this->m_output_transform_file = "output_transform_file";
-    elem = docHandle.FirstChild( "output_transform_file" ).Element();
-    if (elem) this->m_output_transform_file = elem->GetText();
+  this->m_output_transform_file = "output_transform_file";
+  m_parameters.Get("output_transform_file", this->m_output_transform_file);
 
-    this->m_domains_per_shape = 1;
-    elem = docHandle.FirstChild( "domains_per_shape" ).Element();
-    if (elem) this->m_domains_per_shape = atoi(elem->GetText());
+  this->m_domains_per_shape = 1;
+  m_parameters.Get("domains_per_shape", this->m_domains_per_shape);
 
-    this->m_timepts_per_subject = 1;
-    elem = docHandle.FirstChild( "timepts_per_subject" ).Element();
-    if (elem) this->m_timepts_per_subject = atoi(elem->GetText());
+  this->m_timepts_per_subject = 1;
+  m_parameters.Get("timepts_per_subject", this->m_timepts_per_subject);
 
-    this->m_starting_regularization = 500.0;
-    elem = docHandle.FirstChild( "starting_regularization" ).Element();
-    if (elem) this->m_starting_regularization = atof(elem->GetText());
+  this->m_starting_regularization = 500.0;
+  m_parameters.Get("starting_regularization", this->m_starting_regularization);
 
-    this->m_ending_regularization = 500.0;
-    elem = docHandle.FirstChild( "ending_regularization" ).Element();
-    if (elem) this->m_ending_regularization = atof(elem->GetText());
+  this->m_ending_regularization = 500.0;
+  m_parameters.Get("ending_regularization", this->m_ending_regularization);
 
-    this->m_iterations_per_split = 0;
-    elem = docHandle.FirstChild( "iterations_per_split" ).Element();
-    if (elem) this->m_iterations_per_split = atoi(elem->GetText());
+  this->m_iterations_per_split = 0;
+  m_parameters.Get("iterations_per_split", this->m_iterations_per_split);
 
-    this->m_relative_weighting = 1.0;
-    elem = docHandle.FirstChild( "relative_weighting" ).Element();
-    if (elem) this->m_relative_weighting = atof(elem->GetText());
+  this->m_relative_weighting = 1.0;
+  m_parameters.Get("relative_weighting", this->m_relative_weighting);
 
-    this->m_norm_penalty_weighting = 0.0;
-    elem = docHandle.FirstChild( "norm_penalty_weighting" ).Element();
-    if (elem)
+  this->m_norm_penalty_weighting = 0.0;
+  if (m_parameters.Get("norm_penalty_weighting", this->m_norm_penalty_weighting))
+  {
+    if (this->m_norm_penalty_weighting > 0.0)
     {
-      this->m_norm_penalty_weighting = atof(elem->GetText());
-      if (this->m_norm_penalty_weighting > 0.0)
-      {
-        this->m_use_normal_penalty = true;
-      }
-      else
-      {
-        this->m_use_normal_penalty = false;
-      }
+      this->m_use_normal_penalty = true;
+    }
+    else
+    {
+      this->m_use_normal_penalty = false;
     }
+  }
 
-    //this->m_initial_relative_weighting = 0.05;
-    this->m_initial_relative_weighting = 20; // shireen - sampling is now the weighted part we increase it during init
-    elem = docHandle.FirstChild( "initial_relative_weighting" ).Element();
-    if (elem) this->m_initial_relative_weighting = atof(elem->GetText());
+  //this->m_initial_relative_weighting = 0.05;
+  this->m_initial_relative_weighting = 20; // shireen - sampling is now the weighted part we increase it during init
+  m_parameters.Get("initial_relative_weighting", this->m_initial_relative_weighting);
 
-    this->m_initial_norm_penalty_weighting = 0.0;
-    elem = docHandle.FirstChild( "initial_norm_penalty_weighting" ).Element();
-    if (elem)
+  this->m_initial_norm_penalty_weighting = 0.0;
+  if (m_parameters.Get("initial_norm_penalty_weighting", this->m_initial_norm_penalty_weighting))
+  {
+    if (this->m_initial_norm_penalty_weighting > 0.0)
     {
-      this->m_initial_norm_penalty_weighting = atof(elem->GetText());
-      if (this->m_initial_norm_penalty_weighting > 0.0)
-      {
-        this->m_use_initial_normal_penalty = true;
-      }
-      else
-      {
-        this->m_use_initial_normal_penalty = false;
-      }
+      this->m_use_initial_normal_penalty = true;
     }
+    else
+    {
+      this->m_use_initial_normal_penalty = false;
+    }
+  }
 
-    this->m_adaptivity_strength = 0.0;
-    elem = docHandle.FirstChild( "adaptivity_strength" ).Element();
-    if (elem) this->m_adaptivity_strength = atof(elem->GetText());
+  this->m_adaptivity_strength = 0.0;
+  m_parameters.Get("adaptivity_strength", this->m_adaptivity_strength);
 
-    this->m_attributes_per_domain = 0;
-    elem = docHandle.FirstChild( "attributes_per_domain" ).Element();
-    if (elem) this->m_attributes_per_domain = atoi(elem->GetText());
+  this->m_attributes_per_domain = 0;
+  m_parameters.Get("attributes_per_domain", this->m_attributes_per_domain);
 
-    this->m_checkpointing_interval = 0;
-    elem = docHandle.FirstChild( "checkpointing_interval" ).Element();
-    if (elem) this->m_checkpointing_interval = atoi(elem->GetText());
+  this->m_checkpointing_interval = 0;
+  m_parameters.Get("checkpointing_interval", this->m_checkpointing_interval);
 
-    this->m_transform_file = "";
-    elem = docHandle.FirstChild( "transform_file" ).Element();
-    if (elem) this->m_transform_file = elem->GetText();
+  this->m_transform_file = "";
+  m_parameters.Get("transform_file", this->m_transform_file);
 
-    this->m_prefix_transform_file = "";
-    elem = docHandle.FirstChild( "prefix_transform_file" ).Element();
-    if (elem) this->m_prefix_transform_file = elem->GetText();
+  this->m_prefix_transform_file = "";
+  m_parameters.Get("prefix_transform_file", this->m_prefix_transform_file);
 
-    this->m_procrustes_interval = 0;
-    elem = docHandle.FirstChild( "procrustes_interval" ).Element();
-    if (elem) this->m_procrustes_interval = atoi(elem->GetText());
+  this->m_procrustes_interval = 0;
+  m_parameters.Get("procrustes_interval", this->m_procrustes_interval);
 
-    this->m_recompute_regularization_interval = 1;
-    elem = docHandle.FirstChild( "recompute_regularization_interval" ).Element();
-    if (elem) this->m_recompute_regularization_interval = atoi(elem->GetText());
+  this->m_recompute_regularization_interval = 1;
+  m_parameters.Get("recompute_regularization_interval", this->m_recompute_regularization_interval);
 
-    this->m_procrustes_scaling = 1;
-    elem = docHandle.FirstChild( "procrustes_scaling" ).Element();
-    if (elem) this->m_procrustes_scaling = atoi(elem->GetText());
+  this->m_recompute_regularization_tolerance = 0.0;
+  m_parameters.Get("recompute_regularization_tolerance", this->m_recompute_regularization_tolerance);
 
-    this->m_adaptivity_mode = 0;
-    elem = docHandle.FirstChild( "adaptivity_mode" ).Element();
-    if (elem) this->m_adaptivity_mode = atoi(elem->GetText());
+  this->m_recompute_regularization_max_interval = 10 * this->m_recompute_regularization_interval;
+  m_parameters.Get("recompute_regularization_max_interval", this->m_recompute_regularization_max_interval);
 
-    this->m_keep_checkpoints = 0;
-    elem = docHandle.FirstChild( "keep_checkpoints" ).Element();
-    if (elem) this->m_keep_checkpoints = atoi(elem->GetText());
-  }
+  this->m_procrustes_scaling = 1;
+  m_parameters.Get("procrustes_scaling", this->m_procrustes_scaling);
+
+  this->m_adaptivity_mode = 0;
+  m_parameters.Get("adaptivity_mode", this->m_adaptivity_mode);
+
+  this->m_keep_checkpoints = 0;
+  m_parameters.Get("keep_checkpoints", this->m_keep_checkpoints);
+
+  this->m_domain_memory_limit = 0.0;
+  m_parameters.Get("domain_memory_limit", this->m_domain_memory_limit);
+
+  this->m_domain_cache_directory = "";
+  m_parameters.Get("domain_cache_directory", this->m_domain_cache_directory);
+
+  this->m_io_threads = 8;
+  m_parameters.Get("io_threads", this->m_io_threads);
+
+  this->m_active_set_tolerance = 0.0;
+  m_parameters.Get("active_set_tolerance", this->m_active_set_tolerance);
+
+  this->m_active_set_recheck_interval = 10;
+  m_parameters.Get("active_set_recheck_interval", this->m_active_set_recheck_interval);
+
+  this->m_verlet_skin = 0.0;
+  m_parameters.Get("verlet_skin", this->m_verlet_skin);
+
+  unsigned int convergence_window = 0;
+  m_parameters.Get("convergence_window", convergence_window);
+  m_convergence.SetWindow(convergence_window);
+
+  double convergence_energy_tolerance = 1.0e-4;
+  m_parameters.Get("convergence_energy_tolerance", convergence_energy_tolerance);
+  m_convergence.SetEnergyTolerance(convergence_energy_tolerance);
+
+  double convergence_movement_tolerance = 0.0;
+  m_parameters.Get("convergence_movement_tolerance", convergence_movement_tolerance);
+  m_convergence.SetMovementTolerance(convergence_movement_tolerance);
 
   // Write out the parameters
-  std::cout << "m_processing_mode = " << m_processing_mode << std::endl;
-  std::cout << "m_number_of_particles = " << m_number_of_particles << std::endl;
-  std::cout << "m_optimization_iterations = " << m_optimization_iterations << std::endl;
-  std::cout << "m_output_points_prefix = " << m_output_points_prefix << std::endl;
-  std::cout << "m_output_transform_file = " << m_output_transform_file << std::endl;
-  std::cout << "m_domains_per_shape = " << m_domains_per_shape << std::endl;
-  std::cout << "m_timepts_per_subject = " << m_timepts_per_subject << std::endl;
-  std::cout << "m_starting_regularization = " << m_starting_regularization << std::endl;
-  std::cout << "m_ending_regularization = " << m_ending_regularization << std::endl;
-  std::cout << "m_iterations_per_split = " << m_iterations_per_split << std::endl;
-  std::cout << "m_relative_weighting = " << m_relative_weighting << std::endl;
-  std::cout << "m_norm_penalty_weighting = " << m_norm_penalty_weighting << std::endl;
-  std::cout << "m_initial_relative_weighting = " << m_initial_relative_weighting << std::endl;
-  std::cout << "m_initial_norm_penalty_weighting = " << m_initial_norm_penalty_weighting << std::endl;
-  std::cout << "m_adaptivity_strength = " << m_adaptivity_strength << std::endl;
-  std::cout << "m_attributes_per_domain = " << m_attributes_per_domain << std::endl;
-  std::cout << "m_checkpointing_interval = " << m_checkpointing_interval << std::endl;
-  std::cout << "m_transform_file = " << m_transform_file << std::endl;
-  std::cout << "m_prefix_transform_file = " << m_prefix_transform_file << std::endl;
-  std::cout << "m_procrustes_interval = " << m_procrustes_interval << std::endl;
-  std::cout << "m_recompute_regularization_interval = " << m_recompute_regularization_interval << std::endl;
-  std::cout << "m_procrustes_scaling = " << m_procrustes_scaling << std::endl;
-  std::cout << "m_adaptivity_mode = " << m_adaptivity_mode << std::endl;
-  std::cout << "m_keep_checkpoints = " << m_keep_checkpoints << std::endl;
-  std::cout << "m_optimization_iterations_completed = " << m_optimization_iterations_completed << std::endl;
+  itkParticleLogMacro(Info, "m_processing_mode = " << m_processing_mode << std::endl);
+  itkParticleLogMacro(Info, "m_number_of_particles = " << m_number_of_particles << std::endl);
+  itkParticleLogMacro(Info, "m_optimization_iterations = " << m_optimization_iterations << std::endl);
+  itkParticleLogMacro(Info, "m_output_points_prefix = " << m_output_points_prefix << std::endl);
+  itkParticleLogMacro(Info, "m_output_transform_file = " << m_output_transform_file << std::endl);
+  itkParticleLogMacro(Info, "m_domains_per_shape = " << m_domains_per_shape << std::endl);
+  itkParticleLogMacro(Info, "m_timepts_per_subject = " << m_timepts_per_subject << std::endl);
+  itkParticleLogMacro(Info, "m_starting_regularization = " << m_starting_regularization << std::endl);
+  itkParticleLogMacro(Info, "m_ending_regularization = " << m_ending_regularization << std::endl);
+  itkParticleLogMacro(Info, "m_iterations_per_split = " << m_iterations_per_split << std::endl);
+  itkParticleLogMacro(Info, "m_relative_weighting = " << m_relative_weighting << std::endl);
+  itkParticleLogMacro(Info, "m_norm_penalty_weighting = " << m_norm_penalty_weighting << std::endl);
+  itkParticleLogMacro(Info, "m_initial_relative_weighting = " << m_initial_relative_weighting << std::endl);
+  itkParticleLogMacro(Info, "m_initial_norm_penalty_weighting = " << m_initial_norm_penalty_weighting << std::endl);
+  itkParticleLogMacro(Info, "m_adaptivity_strength = " << m_adaptivity_strength << std::endl);
+  itkParticleLogMacro(Info, "m_attributes_per_domain = " << m_attributes_per_domain << std::endl);
+  itkParticleLogMacro(Info, "m_checkpointing_interval = " << m_checkpointing_interval << std::endl);
+  itkParticleLogMacro(Info, "m_transform_file = " << m_transform_file << std::endl);
+  itkParticleLogMacro(Info, "m_prefix_transform_file = " << m_prefix_transform_file << std::endl);
+  itkParticleLogMacro(Info, "m_procrustes_interval = " << m_procrustes_interval << std::endl);
+  itkParticleLogMacro(Info, "m_recompute_regularization_interval = " << m_recompute_regularization_interval << std::endl);
+  itkParticleLogMacro(Info, "m_recompute_regularization_tolerance = " << m_recompute_regularization_tolerance << std::endl);
+  itkParticleLogMacro(Info, "m_recompute_regularization_max_interval = " << m_recompute_regularization_max_interval << std::endl);
+  itkParticleLogMacro(Info, "m_procrustes_scaling = " << m_procrustes_scaling << std::endl);
+  itkParticleLogMacro(Info, "m_adaptivity_mode = " << m_adaptivity_mode << std::endl);
+  itkParticleLogMacro(Info, "m_keep_checkpoints = " << m_keep_checkpoints << std::endl);
+  itkParticleLogMacro(Info, "m_domain_memory_limit = " << m_domain_memory_limit << std::endl);
+  itkParticleLogMacro(Info, "m_domain_cache_directory = " << m_domain_cache_directory << std::endl);
+  itkParticleLogMacro(Info, "m_io_threads = " << m_io_threads << std::endl);
+  itkParticleLogMacro(Info, "m_active_set_tolerance = " << m_active_set_tolerance << std::endl);
+  itkParticleLogMacro(Info, "m_active_set_recheck_interval = " << m_active_set_recheck_interval << std::endl);
+  itkParticleLogMacro(Info, "m_verlet_skin = " << m_verlet_skin << std::endl);
+  itkParticleLogMacro(Info, "convergence_window = " << m_convergence.GetWindow() << std::endl);
+  itkParticleLogMacro(Info, "convergence_energy_tolerance = " << m_convergence.GetEnergyTolerance() << std::endl);
+  itkParticleLogMacro(Info, "convergence_movement_tolerance = " << m_convergence.GetMovementTolerance() << std::endl);
+  itkParticleLogMacro(Info, "m_verbosity = " << m_verbosity << std::endl);
+  itkParticleLogMacro(Info, "m_log_asynchronous = " << m_log_asynchronous << std::endl);
+  itkParticleLogMacro(Info, "m_optimization_iterations_completed = " << m_optimization_iterations_completed << std::endl);
 
 }
 
@@ -893,6 +875,21 @@ ShapeWorksRunApp<SAMPLERTYPE>::InitializeSampler()
     ->SetRecomputeCovarianceInterval(m_recompute_regularization_interval);
   m_Sampler->GetEnsembleMixedEffectsEntropyFunction()
     ->SetRecomputeCovarianceInterval(m_recompute_regularization_interval);
+
+  // With a tolerance the interval above is the shortest, and the covariance
+  // is only recomputed when the shape matrix has changed enough.
+  m_Sampler->GetEnsembleEntropyFunction()
+    ->SetRecomputeCovarianceTolerance(m_recompute_regularization_tolerance);
+  m_Sampler->GetEnsembleEntropyFunction()
+    ->SetMaximumRecomputeCovarianceInterval(m_recompute_regularization_max_interval);
+  m_Sampler->GetEnsembleRegressionEntropyFunction()
+    ->SetRecomputeCovarianceTolerance(m_recompute_regularization_tolerance);
+  m_Sampler->GetEnsembleRegressionEntropyFunction()
+    ->SetMaximumRecomputeCovarianceInterval(m_recompute_regularization_max_interval);
+  m_Sampler->GetEnsembleMixedEffectsEntropyFunction()
+    ->SetRecomputeCovarianceTolerance(m_recompute_regularization_tolerance);
+  m_Sampler->GetEnsembleMixedEffectsEntropyFunction()
+    ->SetMaximumRecomputeCovarianceInterval(m_recompute_regularization_max_interval);
   
   m_Sampler->Initialize();
   m_Sampler->GetOptimizer()->SetTolerance(0.0);
@@ -902,9 +899,9 @@ template < class SAMPLERTYPE>
 void
 ShapeWorksRunApp<SAMPLERTYPE>::Initialize()
 {
-  std::cerr << "------------------------------\n";
-  std::cerr << "*** Initialize Step\n";
-  std::cerr << "------------------------------\n";
+  itkParticleLogMacro(Info, "------------------------------\n"
+                      << "*** Initialize Step\n"
+                      << "------------------------------\n");
 
   m_disable_checkpointing = true;
   m_disable_procrustes = true;
@@ -929,13 +926,10 @@ ShapeWorksRunApp<SAMPLERTYPE>::Initialize()
   while (m_Sampler->GetParticleSystem()->GetNumberOfParticles() < m_number_of_particles)
   {
     this->SplitAllParticles();
-    std::cout << std::endl << "Particle count: "
-              << m_Sampler->GetParticleSystem()->GetNumberOfParticles() << std::endl;
+    itkParticleLogMacro(Info, std::endl << "Particle count: "
+                        << m_Sampler->GetParticleSystem()->GetNumberOfParticles() << std::endl);
     
-    m_Sampler->GetOptimizer()->SetMaximumNumberOfIterations(m_iterations_per_split);
-    m_Sampler->GetOptimizer()->SetNumberOfIterations(0);
-    m_Sampler->Modified();
-    m_Sampler->Update();
+    this->RunStage("Initialize", m_iterations_per_split);
 
     this->WritePointFiles();
     this->WriteTransformFile();
@@ -948,14 +942,14 @@ template < class SAMPLERTYPE>
 void
 ShapeWorksRunApp<SAMPLERTYPE>::AddAdaptivity()
 {
-  std::cerr << "------------------------------\n";
-  std::cerr << "*** AddAdaptivity Step\n";
-  std::cerr << "------------------------------\n";
+  itkParticleLogMacro(Info, "------------------------------\n"
+                      << "*** AddAdaptivity Step\n"
+                      << "------------------------------\n");
 
   if (m_adaptivity_strength == 0.0) return;
   m_disable_checkpointing = true;
   m_disable_procrustes = true;
-  std::cout << "Adding adaptivity." << std::endl;
+  itkParticleLogMacro(Info, "Adding adaptivity." << std::endl);
   m_Sampler->GetCurvatureGradientFunction()->SetRho(m_adaptivity_strength);
   m_Sampler->GetOmegaGradientFunction()->SetRho(m_adaptivity_strength);
   m_Sampler->GetLinkingFunction()->SetRelativeGradientScaling(m_initial_relative_weighting);
@@ -970,10 +964,7 @@ ShapeWorksRunApp<SAMPLERTYPE>::AddAdaptivity()
 
   //  if (tmpNoAdaptivityFlag == true) return;
   
-  m_Sampler->GetOptimizer()->SetMaximumNumberOfIterations(m_iterations_per_split);
-  m_Sampler->GetOptimizer()->SetNumberOfIterations(0);
-  m_Sampler->Modified();
-  m_Sampler->Update();
+  this->RunStage("AddAdaptivity", m_iterations_per_split);
   
   this->WritePointFiles();
   this->WriteTransformFile();
@@ -983,9 +974,9 @@ template < class SAMPLERTYPE>
 void
 ShapeWorksRunApp<SAMPLERTYPE>::Optimize()
 {
-  std::cerr << "------------------------------\n";
-  std::cerr << "*** Optimize Step\n";
-  std::cerr << "------------------------------\n";
+  itkParticleLogMacro(Info, "------------------------------\n"
+                      << "*** Optimize Step\n"
+                      << "------------------------------\n");
 
   m_optimizing = true;  
   m_Sampler->GetCurvatureGradientFunction()->SetRho(m_adaptivity_strength);
@@ -1007,6 +998,8 @@ ShapeWorksRunApp<SAMPLERTYPE>::Optimize()
   
   //  m_Sampler->GetOptimizer()->SetModeToGaussSeidel();
   m_Sampler->GetOptimizer()->SetModeToAdaptiveGaussSeidel();
+  m_Sampler->GetOptimizer()->SetActiveSetTolerance(m_active_set_tolerance);
+  m_Sampler->GetOptimizer()->SetActiveSetRecheckInterval(m_active_set_recheck_interval);
 
   // Set up the minimum variance decay
   m_Sampler->GetEnsembleEntropyFunction()->SetMinimumVarianceDecay(m_starting_regularization,
@@ -1032,7 +1025,7 @@ ShapeWorksRunApp<SAMPLERTYPE>::Optimize()
                                                                              m_optimization_iterations-
 																			                                       m_optimization_iterations_completed);
   
-  std::cout << "Optimizing correspondences." << std::endl;
+  itkParticleLogMacro(Info, "Optimizing correspondences." << std::endl);
 
   if (m_use_normal_penalty == true) m_Sampler->SetNormalEnergyOn();
     
@@ -1060,15 +1053,10 @@ ShapeWorksRunApp<SAMPLERTYPE>::Optimize()
     m_Sampler->SetCorrespondenceMode(1); // Normal
   }
                                                         
-  if (m_optimization_iterations-m_optimization_iterations_completed > 0)
-    m_Sampler->GetOptimizer()->SetMaximumNumberOfIterations(m_optimization_iterations-m_optimization_iterations_completed);
-  else m_Sampler->GetOptimizer()->SetMaximumNumberOfIterations(0);
-
-  
-  m_Sampler->GetOptimizer()->SetNumberOfIterations(0);
   m_Sampler->GetOptimizer()->SetTolerance(0.0);
-  m_Sampler->Modified();
-  m_Sampler->Update();
+  if (m_optimization_iterations-m_optimization_iterations_completed > 0)
+    this->RunStage("Optimize", m_optimization_iterations-m_optimization_iterations_completed);
+  else this->RunStage("Optimize", 0);
   
   this->WritePointFiles();
   this->WriteTransformFile();
@@ -1078,41 +1066,20 @@ ShapeWorksRunApp<SAMPLERTYPE>::Optimize()
 
 template < class SAMPLERTYPE >
 void
-ShapeWorksRunApp<SAMPLERTYPE>::ReadExplanatoryVariables(const char *fname)
+ShapeWorksRunApp<SAMPLERTYPE>::ReadExplanatoryVariables()
 {
-  TiXmlDocument doc(fname);
-  bool loadOkay = doc.LoadFile();
-
-  if (loadOkay)
+  std::vector<double> evars;
+  if (m_parameters.GetList("explanatory_variable", evars))
   {
-    TiXmlHandle docHandle( &doc );
-    TiXmlElement *elem;
-
-    std::istringstream inputsBuffer;
-    std::vector<double> evars;
-    double etmp;
-
-    elem = docHandle.FirstChild( "explanatory_variable" ).Element();
-    if (elem)
-    {
-      inputsBuffer.str(elem->GetText());
-      while (inputsBuffer >> etmp)
-      {
-        evars.push_back(etmp);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
+    dynamic_cast<itk::ParticleShapeLinearRegressionMatrixAttribute<double,3> *>
+      (m_Sampler->GetEnsembleRegressionEntropyFunction()->GetShapeMatrix())->SetExplanatory(evars);
 
-      dynamic_cast<itk::ParticleShapeLinearRegressionMatrixAttribute<double,3> *>
-        (m_Sampler->GetEnsembleRegressionEntropyFunction()->GetShapeMatrix())->SetExplanatory(evars);
+    dynamic_cast<itk::ParticleShapeMixedEffectsMatrixAttribute<double,3> *>
+      (m_Sampler->GetEnsembleMixedEffectsEntropyFunction()->GetShapeMatrix())->SetExplanatory(evars);
 
-      dynamic_cast<itk::ParticleShapeMixedEffectsMatrixAttribute<double,3> *>
-        (m_Sampler->GetEnsembleMixedEffectsEntropyFunction()->GetShapeMatrix())->SetExplanatory(evars);
-
-      m_use_regression = true;
-      if (this->m_timepts_per_subject > 1) m_use_mixed_effects = true;
-    }
-  } 
+    m_use_regression = true;
+    if (this->m_timepts_per_subject > 1) m_use_mixed_effects = true;
+  }
 }
 
 
@@ -1126,9 +1093,66 @@ void
 ShapeWorksRunApp<SAMPLERTYPE>::optimize_stop()
 {  m_Sampler->GetOptimizer()->StopOptimization();}
 
+template < class SAMPLERTYPE>
+void
+ShapeWorksRunApp<SAMPLERTYPE>::RunStage(const char *stage, unsigned int iterations)
+{
+  m_convergence.Reset();
+  m_Sampler->GetOptimizer()->SetMaximumNumberOfIterations(iterations);
+  m_Sampler->GetOptimizer()->SetNumberOfIterations(0);
+  m_Sampler->Modified();
+  m_Sampler->Update();
+
+  // Record why the stage stopped
+  std::ostringstream reason;
+  if (m_convergence.GetConverged() == true)
+    {
+    reason << m_convergence.GetReason();
+    }
+  else if (iterations > 0 && m_Sampler->GetOptimizer()->GetNumberOfIterations() >= iterations)
+    {
+    reason << "iteration limit " << iterations;
+    }
+  else
+    {
+    reason << "stopped by the optimizer or the regularization schedule";
+    }
+  itkParticleLogMacro(Info, std::endl << stage << " stage stopped after "
+                      << m_Sampler->GetOptimizer()->GetNumberOfIterations() << " iterations: "
+                      << reason.str() << std::endl);
+}
+
+template < class SAMPLERTYPE>
+double
+ShapeWorksRunApp<SAMPLERTYPE>::GetCorrespondenceEnergy() const
+{
+  if (m_Sampler->GetCorrespondenceMode() == 1)
+    return m_Sampler->GetEnsembleEntropyFunction()->GetCurrentEnergy();
+  if (m_Sampler->GetCorrespondenceMode() == 3)
+    return m_Sampler->GetEnsembleRegressionEntropyFunction()->GetCurrentEnergy();
+  if (m_Sampler->GetCorrespondenceMode() == 4)
+    return m_Sampler->GetEnsembleMixedEffectsEntropyFunction()->GetCurrentEnergy();
+  return 0.0;
+}
+
+template < class SAMPLERTYPE>
+unsigned long
+ShapeWorksRunApp<SAMPLERTYPE>::GetNumberOfCorrespondenceUpdates() const
+{
+  if (m_Sampler->GetCorrespondenceMode() == 1)
+    return m_Sampler->GetEnsembleEntropyFunction()->GetNumberOfCovarianceUpdates();
+  if (m_Sampler->GetCorrespondenceMode() == 3)
+    return m_Sampler->GetEnsembleRegressionEntropyFunction()->GetNumberOfCovarianceUpdates();
+  if (m_Sampler->GetCorrespondenceMode() == 4)
+    return m_Sampler->GetEnsembleMixedEffectsEntropyFunction()->GetNumberOfCovarianceUpdates();
+  return 0;
+}
+
 template < class SAMPLERTYPE>
 ShapeWorksRunApp<SAMPLERTYPE>::~ShapeWorksRunApp()
 {
+  // Write out anything still queued and stop the writer.
+  itk::ParticleLog::SetAsynchronous(false);
 }
 
 template < class SAMPLERTYPE>
@@ -1149,8 +1173,8 @@ ShapeWorksRunApp<SAMPLERTYPE>::WriteParameters( int iter )
     interceptname = "./.iter" + ss.str() + "/" + interceptname;
   }
   
-  std::cout << "writing " << slopename << std::endl;
-  std::cout << "writing " << interceptname << std::endl;
+  itkParticleLogMacro(Info, "writing " << slopename << std::endl);
+  itkParticleLogMacro(Info, "writing " << interceptname << std::endl);
 
   std::vector< double > slope;
   std::vector< double > intercept;
@@ -1199,8 +1223,8 @@ ShapeWorksRunApp<SAMPLERTYPE>::WriteParameters( int iter )
       interceptname = "./.iter" + ss.str() + "/" + interceptname;
     }
 
-    std::cout << "writing " << slopename << std::endl;
-    std::cout << "writing " << interceptname << std::endl;
+    itkParticleLogMacro(Info, "writing " << slopename << std::endl);
+    itkParticleLogMacro(Info, "writing " << interceptname << std::endl);
 
     vnl_matrix<double> sloperand_mat = dynamic_cast<itk::ParticleShapeMixedEffectsMatrixAttribute<double,3> *>
         (m_Sampler->GetEnsembleMixedEffectsEntropyFunction()->GetShapeMatrix())->GetSlopeRandom();
@@ -1267,58 +1291,27 @@ ShapeWorksRunApp<SAMPLERTYPE>::WriteParameters( int iter )
 
 template < class SAMPLERTYPE>
 void
-ShapeWorksRunApp<SAMPLERTYPE>::FlagDomainFct(const char *fname)
+ShapeWorksRunApp<SAMPLERTYPE>::FlagDomainFct()
 {
-  TiXmlDocument doc(fname);
-  bool loadOkay = doc.LoadFile();
+  std::vector<int> f;
 
-  if (loadOkay)
+  // set up fixed landmark positions
+  if (m_parameters.GetList("fixed_landmarks", f))
   {
-    TiXmlHandle docHandle( &doc );
-    TiXmlElement *elem;
-
-    std::istringstream inputsBuffer;
-    std::vector<int> f;
-    int ftmp;
-
-    // set up fixed landmark positions
-
-    elem = docHandle.FirstChild( "fixed_landmarks" ).Element();
-    if (elem)
+    for (unsigned int i = 0; i < f.size(); i++)
     {
-      inputsBuffer.str(elem->GetText());
-      while (inputsBuffer >> ftmp)
-      {
-        f.push_back(ftmp);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
-
-      for (unsigned int i = 0; i < f.size(); i++)
-      {
-        m_Sampler->GetParticleSystem()->SetFixedParticleFlag(f[i]);
-      }
+      m_Sampler->GetParticleSystem()->SetFixedParticleFlag(f[i]);
     }
+  }
 
-    f.clear();
-    elem = docHandle.FirstChild( "fixed_domains" ).Element();
-    if (elem)
+  if (m_parameters.GetList("fixed_domains", f))
+  {
+    for (unsigned int i = 0; i < f.size(); i++)
     {
-      inputsBuffer.str(elem->GetText());
-      while (inputsBuffer >> ftmp)
+      //if (f[i] > 0.0)
       {
-        f.push_back(ftmp);
-      }
-      inputsBuffer.clear();
-      inputsBuffer.str("");
-
-      for (unsigned int i = 0; i < f.size(); i++)
-      {
-        //if (f[i] > 0.0)
-        {
-          std::cerr << "domain " << f[i] << " is flagged!\n";
-          m_Sampler->GetParticleSystem()->FlagDomain(f[i]);
-        }
+        itkParticleLogMacro(Info, "domain " << f[i] << " is flagged!\n");
+        m_Sampler->GetParticleSystem()->FlagDomain(f[i]);
       }
     }
   }
@@ -0,0 +1,167 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: ShapeWorksRunConvergence.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __ShapeWorksRunConvergence_h
+#define __ShapeWorksRunConvergence_h
+
+#include <cmath>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <utility>
+
+/**
+ * \class ShapeWorksRunConvergence
+ *
+ * Energy-plateau test for one stage of ShapeWorksRun.  Update is called once
+ * per optimizer iteration with the mean particle energy (the sampling and
+ * correspondence terms combined, as the optimizer sees them), the ensemble
+ * correspondence energy and the longest particle move of that iteration, and
+ * keeps the last Window iterations.  The stage has converged once the window
+ * is full and
+ *
+ *   |E_last - E_first| / max(|E_first|, 1e-12) < EnergyTolerance
+ *
+ * holds for both energies over the window, and, if MovementTolerance is
+ * positive, no particle moved further than MovementTolerance in the window.
+ * A Window of zero turns the test off.
+ *
+ * The correspondence energy is only recomputed with the covariance, which
+ * need not happen every iteration, so the caller says whether the value is
+ * new.  E_first is then the value in effect when the window starts and
+ * E_last the latest one, and the test waits until both are known and a new
+ * value has been recorded inside the window, so a window shorter than the
+ * gap between covariance updates never sees a spurious zero change.
+ */
+class ShapeWorksRunConvergence
+{
+public:
+  ShapeWorksRunConvergence()
+  {
+    m_Window = 0;
+    m_EnergyTolerance = 1.0e-4;
+    m_MovementTolerance = 0.0;
+    this->Reset();
+  }
+
+  void SetWindow(unsigned int w)
+  { m_Window = w; }
+  unsigned int GetWindow() const
+  { return m_Window; }
+
+  void SetEnergyTolerance(double t)
+  { m_EnergyTolerance = t; }
+  double GetEnergyTolerance() const
+  { return m_EnergyTolerance; }
+
+  void SetMovementTolerance(double t)
+  { m_MovementTolerance = t; }
+  double GetMovementTolerance() const
+  { return m_MovementTolerance; }
+
+  /** Forgets all recorded iterations, at the start of a stage. */
+  void Reset()
+  {
+    m_Energy.clear();
+    m_Correspondence.clear();
+    m_Moves.clear();
+    m_Iterations = 0;
+    m_Converged = false;
+    m_Reason = "";
+  }
+
+  /** Records one iteration.  Returns true if the stage has converged.
+      correspondence is only recorded if updated is true, i.e. if it was
+      recomputed in this iteration. */
+  bool Update(double energy, double correspondence, bool updated, double maxmove)
+  {
+    m_Iterations++;
+    if (m_Window == 0 || m_Converged == true) return m_Converged;
+
+    m_Energy.push_back(energy);
+    m_Moves.push_back(maxmove);
+    if (updated == true)
+      {
+      m_Correspondence.push_back(std::make_pair(m_Iterations, correspondence));
+      }
+    if (m_Energy.size() > m_Window)
+      {
+      m_Energy.pop_front();
+      m_Moves.pop_front();
+      }
+
+    // Keep the correspondence energy in effect at the first iteration of the
+    // window, and every value recorded since.
+    const unsigned int first = m_Iterations < m_Window ? 1 : m_Iterations - m_Window + 1;
+    while (m_Correspondence.size() > 1 && m_Correspondence[1].first <= first)
+      {
+      m_Correspondence.pop_front();
+      }
+    if (m_Energy.size() < m_Window) return false;
+    if (m_Correspondence.empty() == false
+        && (m_Correspondence.front().first > first || m_Correspondence.back().first <= first))
+      {
+      return false;
+      }
+
+    const double de = RelativeChange(m_Energy.front(), m_Energy.back());
+    const double dc = m_Correspondence.empty() ? 0.0
+      : RelativeChange(m_Correspondence.front().second, m_Correspondence.back().second);
+    if (de >= m_EnergyTolerance || dc >= m_EnergyTolerance) return false;
+
+    double maxmove_window = 0.0;
+    for (unsigned int i = 0; i < m_Moves.size(); i++)
+      {
+      if (m_Moves[i] > maxmove_window) maxmove_window = m_Moves[i];
+      }
+    if (m_MovementTolerance > 0.0 && maxmove_window >= m_MovementTolerance) return false;
+
+    std::ostringstream reason;
+    reason << "energy plateau after " << m_Iterations << " iterations: relative change over "
+           << m_Window << " iterations " << de << " (particles) and " << dc
+           << " (correspondence) < " << m_EnergyTolerance << ", longest move " << maxmove_window;
+    if (m_MovementTolerance > 0.0) reason << " < " << m_MovementTolerance;
+    m_Reason = reason.str();
+    m_Converged = true;
+    return true;
+  }
+
+  bool GetConverged() const
+  { return m_Converged; }
+
+  /** Number of iterations recorded since the last Reset. */
+  unsigned int GetNumberOfIterations() const
+  { return m_Iterations; }
+
+  /** Why the stage converged, for the log. */
+  const std::string &GetReason() const
+  { return m_Reason; }
+
+private:
+  static double RelativeChange(double first, double last)
+  {
+    const double scale = std::fabs(first) > 1.0e-12 ? std::fabs(first) : 1.0e-12;
+    return std::fabs(last - first) / scale;
+  }
+
+  unsigned int m_Window;
+  double m_EnergyTolerance;
+  double m_MovementTolerance;
+
+  std::deque<double> m_Energy;
+  std::deque< std::pair<unsigned int, double> > m_Correspondence; // (iteration, energy)
+  std::deque<double> m_Moves;
+  unsigned int m_Iterations;
+  bool m_Converged;
+  std::string m_Reason;
+};
+
+#endif
@@ -0,0 +1,103 @@
+/*=========================================================================
+  Program:   ShapeWorks: Particle-based Shape Correspondence & Visualization
+  Module:    $RCSfile: ShapeWorksRunParameters.h,v $
+
+  Copyright (c) 2009 Scientific Computing and Imaging Institute.
+  See ShapeWorksLicense.txt for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+=========================================================================*/
+#ifndef __ShapeWorksRunParameters_h
+#define __ShapeWorksRunParameters_h
+
+#include "tinyxml.h"
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * \class ShapeWorksRunParameters
+ *
+ * The ShapeWorksRun parameter file, parsed once.  The text of every top-level
+ * element is kept by tag name (the first element wins if a tag is repeated,
+ * as with TiXmlHandle::FirstChild), and is converted on request to a single
+ * typed value or to a list of values.  Absent or empty tags leave the output
+ * untouched, so callers set a default first and then call Get.
+ */
+class ShapeWorksRunParameters
+{
+public:
+  ShapeWorksRunParameters() {}
+
+  /** Parses the parameter file.  Returns false if it could not be read. */
+  bool Read(const char *fname)
+  {
+    m_FileName = fname;
+    m_Values.clear();
+
+    TiXmlDocument doc(fname);
+    if (doc.LoadFile() == false) return false;
+
+    for (TiXmlElement *elem = doc.FirstChildElement(); elem != NULL;
+         elem = elem->NextSiblingElement())
+      {
+      if (m_Values.find(elem->Value()) == m_Values.end())
+        {
+        m_Values[elem->Value()] = (elem->GetText() != NULL) ? elem->GetText() : "";
+        }
+      }
+    return true;
+  }
+
+  /** Name of the parameter file, used to resolve relative input paths. */
+  const std::string &GetFileName() const
+  { return m_FileName; }
+
+  /** True if the tag is present with non-empty text. */
+  bool Has(const char *tag) const
+  {
+    std::map<std::string, std::string>::const_iterator it = m_Values.find(tag);
+    return it != m_Values.end() && it->second != "";
+  }
+
+  /** Reads the first value of a tag. */
+  template <class T>
+  bool Get(const char *tag, T &value) const
+  {
+    if (this->Has(tag) == false) return false;
+    std::istringstream in(m_Values.find(tag)->second);
+    T tmp;
+    if (!(in >> tmp)) return false;
+    value = tmp;
+    return true;
+  }
+
+  /** Reads the whole text of a tag, e.g. a file name. */
+  bool Get(const char *tag, std::string &value) const
+  {
+    if (this->Has(tag) == false) return false;
+    value = m_Values.find(tag)->second;
+    return true;
+  }
+
+  /** Reads all whitespace separated values of a tag. */
+  template <class T>
+  bool GetList(const char *tag, std::vector<T> &values) const
+  {
+    values.clear();
+    if (this->Has(tag) == false) return false;
+    std::istringstream in(m_Values.find(tag)->second);
+    T tmp;
+    while (in >> tmp) values.push_back(tmp);
+    return true;
+  }
+
+private:
+  std::string m_FileName;
+  std::map<std::string, std::string> m_Values;
+};
+
+#endif
@@ -24,21 +24,30 @@
 #endif // ifndef __APPLE__
 #endif // ifdef _WIN32
 
+#include <cstring>
+
 #include <MeshCache.h>
 
 #include <vtkPolyData.h>
 
-bool vnl_vector_compare::operator()( const vnl_vector<double> &a, const vnl_vector<double> &b) const
+quint64 MeshCache::shapeDigest( const vnl_vector<double>& shape )
 {
-  if ( a.size() < b.size() )
-    return true;
-  for ( unsigned i = 0; i < a.size(); i++ ) {
-	if ( (a[i] < b[i]) )
-		return true;
-	else if ( b[i] < a[i])
-		return false;
+  // FNV-1a over whole 64-bit words with a final avalanche step.  Equal shapes
+  // always give equal digests; collisions are resolved by comparing shapes.
+  quint64 hash = Q_UINT64_C( 14695981039346656037 );
+  const quint64 prime = Q_UINT64_C( 1099511628211 );
+  for ( unsigned i = 0; i < shape.size(); i++ )
+  {
+    quint64 word;
+    memcpy( &word, &shape[i], sizeof( quint64 ) );
+    hash = ( hash ^ word ) * prime;
+    hash ^= hash >> 32;
   }
-  return false;
+  hash ^= shape.size();
+  hash ^= hash >> 33;
+  hash *= Q_UINT64_C( 0xff51afd7ed558ccd );
+  hash ^= hash >> 33;
+  return hash;
 }
 
 long long MeshCache::getTotalPhysicalMemory()
@@ -94,26 +103,68 @@ MeshCache::MeshCache(Preferences& prefs) : preferences_(prefs)
 {
   this->maxMemory = MeshCache::getTotalAddressiblePhysicalMemory();
   this->memorySize = 0;
+  this->lruHead = NULL;
+  this->lruTail = NULL;
   this->pref_ref_ = &this->preferences_;
 }
 
-vtkSmartPointer<vtkPolyData> MeshCache::getMesh( const vnl_vector<double>& shape )
+MeshCache::~MeshCache()
 {
-  QMutexLocker locker( &mutex );
+  this->clear();
+}
 
+CacheEntry* MeshCache::findEntry( quint64 digest, const vnl_vector<double>& shape )
+{
+  for ( CacheMap::iterator it = this->meshCache.find( digest );
+        it != this->meshCache.end() && it.key() == digest; ++it )
+  {
+    if ( it.value()->shape == shape )
+    {
+      return it.value();
+    }
+  }
+  return NULL;
+}
+
+void MeshCache::unlink( CacheEntry* entry )
+{
+  if ( entry->prev ) { entry->prev->next = entry->next; } else { this->lruHead = entry->next; }
+  if ( entry->next ) { entry->next->prev = entry->prev; } else { this->lruTail = entry->prev; }
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+void MeshCache::pushFront( CacheEntry* entry )
+{
+  entry->prev = NULL;
+  entry->next = this->lruHead;
+  if ( this->lruHead ) { this->lruHead->prev = entry; } else { this->lruTail = entry; }
+  this->lruHead = entry;
+}
+
+vtkSmartPointer<vtkPolyData> MeshCache::getMesh( const vnl_vector<double>& shape )
+{
   if ( !preferences_.getCacheEnabled() )
   {
     return NULL;
   }
 
+  quint64 digest = MeshCache::shapeDigest( shape );
+
+  QMutexLocker locker( &mutex );
+
   // search the cache for this shape
-  CacheMap::iterator it = this->meshCache.find( shape );
-  if ( it == this->meshCache.end() )
+  CacheEntry* entry = this->findEntry( digest, shape );
+  if ( !entry )
   {
     return NULL;
   }
 
-  return it->second;
+  // mark as most recently used
+  this->unlink( entry );
+  this->pushFront( entry );
+
+  return entry->mesh;
 }
 
 void MeshCache::insertMesh( const vnl_vector<double>& shape, vtkSmartPointer<vtkPolyData> mesh )
@@ -123,30 +174,51 @@ void MeshCache::insertMesh( const vnl_vector<double>& shape, vtkSmartPointer<vtk
     return;
   }
 
-  QMutexLocker locker( &mutex );
+  quint64 digest = MeshCache::shapeDigest( shape );
 
   // compute the memory size of this shape
   size_t shapeSize = shape.size() * sizeof( double );
   size_t meshSize = mesh->GetActualMemorySize() * 1024; // given in kb
-  size_t combinedSize = ( shapeSize * 2 ) + meshSize;
+  size_t combinedSize = shapeSize + meshSize + sizeof( CacheEntry );
+
+  QMutexLocker locker( &mutex );
 
+  CacheEntry* entry = this->findEntry( digest, shape );
+  if ( entry )
+  {
+    // already built by another worker, keep the newer mesh
+    this->unlink( entry );
+    this->memorySize -= entry->memorySize;
+  }
+  else
+  {
+    entry = new CacheEntry;
+    entry->digest = digest;
+    entry->shape = shape;
+    this->meshCache.insert( digest, entry );
+  }
+  entry->mesh = mesh;
+  entry->memorySize = combinedSize;
+
+  // evict before linking the new entry, so it is never evicted itself
   this->freeSpaceForAmount( combinedSize );
 
-  this->meshCache[shape] = mesh;
+  this->pushFront( entry );
   this->memorySize += combinedSize;
   //std::cerr << "Cache now holds " << this->meshCache.size() << " items\n";
-
-  // add to LRC list
-  CacheListItem item;
-  item.key = shape;
-  item.memorySize = combinedSize;
-  this->cacheList.push_back( item );
 }
 
 void MeshCache::clear()
 {
   QMutexLocker locker( &mutex );
 
+  while ( this->lruHead )
+  {
+    CacheEntry* entry = this->lruHead;
+    this->lruHead = entry->next;
+    delete entry;
+  }
+  this->lruTail = NULL;
   this->meshCache.clear();
   this->memorySize = 0;
 }
@@ -155,12 +227,14 @@ void MeshCache::freeSpaceForAmount( size_t allocation )
 {
   size_t memoryLimit = ( preferences_.getCacheMemory() / 100.0 ) * this->maxMemory;
 
-  while ( !this->cacheList.empty() && this->memorySize + allocation > memoryLimit )
+  // evict least recently used entries first
+  while ( this->lruTail && this->memorySize + allocation > memoryLimit )
   {
-    CacheListItem item = this->cacheList.back();
-    this->memorySize -= item.memorySize;
-    this->cacheList.pop_back();
-    std::cerr << "erasing item for " << item.memorySize / 1024 << " kb savings\n";
-    this->meshCache.erase( item.key );
+    CacheEntry* entry = this->lruTail;
+    this->unlink( entry );
+    this->memorySize -= entry->memorySize;
+    std::cerr << "erasing item for " << entry->memorySize / 1024 << " kb savings\n";
+    this->meshCache.remove( entry->digest, entry );
+    delete entry;
   }
 }
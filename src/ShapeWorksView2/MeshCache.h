@@ -6,16 +6,18 @@
  * @file MeshCache.h
  * @brief Thread safe cache for meshes index by shape
  *
- * The MeshCache implements a std::map keyed by shape (list of points) with vtkPolyData values.
+ * The MeshCache implements a hash table keyed by a 64-bit digest of the shape (list of points)
+ * with vtkPolyData values.  Each entry keeps its full shape so digest collisions are resolved
+ * by comparing shapes, and entries are threaded on an intrusive least recently used list so
+ * that lookups, insertions and evictions are all constant time.  The digest is computed
+ * outside the lock, so the lock is only ever held for O(1) work.
  * It is thread-safe and can be used from any thread.
  */
 
 #ifndef MESH_CACHE_H
 #define MESH_CACHE_H
 
-#include <list>
-#include <map>
-
+#include <QMultiHash>
 #include <QMutex>
 
 #include <vtkSmartPointer.h>
@@ -28,25 +30,21 @@
 
 class vtkPolyData;
 
-class CacheListItem
+class CacheEntry
 {
 public:
-  vnl_vector<double> key;
+  quint64 digest;
+  vnl_vector<double> shape;
+  vtkSmartPointer<vtkPolyData> mesh;
   size_t memorySize;
-};
 
-// comparison class for vnl_vectors (for cache)
-class vnl_vector_compare
-{
-public:
-  bool operator()( const vnl_vector<double> &a, const vnl_vector<double> &b) const;
+  // LRU list links, most recently used first
+  CacheEntry* prev;
+  CacheEntry* next;
 };
 
-// mesh cache type
-typedef std::map< const vnl_vector<double>, vtkSmartPointer<vtkPolyData>, vnl_vector_compare > CacheMap;
-
-// LRC list
-typedef std::list< CacheListItem > CacheList;
+// mesh cache type, entries with colliding digests share a key
+typedef QMultiHash< quint64, CacheEntry* > CacheMap;
 
 class MeshCache
 {
@@ -54,6 +52,10 @@ class MeshCache
 public:
 
   MeshCache(Preferences& prefs);
+  ~MeshCache();
+
+  /// 64-bit digest of a shape, used as its hash key
+  static quint64 shapeDigest( const vnl_vector<double>& shape );
 
   vtkSmartPointer<vtkPolyData> getMesh( const vnl_vector<double>& vector );
 
@@ -67,6 +69,13 @@ private:
 
   void freeSpaceForAmount( size_t allocation );
 
+  // the entry for this shape, or NULL (caller holds the lock)
+  CacheEntry* findEntry( quint64 digest, const vnl_vector<double>& shape );
+
+  // LRU list maintenance (caller holds the lock)
+  void unlink( CacheEntry* entry );
+  void pushFront( CacheEntry* entry );
+
   static long long getTotalPhysicalMemory();
   static long long getTotalAddressibleMemory();
   static long long getTotalAddressiblePhysicalMemory();
@@ -75,8 +84,9 @@ private:
   // mesh cache
   CacheMap meshCache;
 
-  // lrc list
-  CacheList cacheList;
+  // lru list
+  CacheEntry* lruHead;
+  CacheEntry* lruTail;
 
   // size of memory in use by the cache
   size_t memorySize;
@@ -40,7 +40,47 @@ MeshGenerator::MeshGenerator(Preferences& prefs) : prefs_(prefs)
 }
 MeshGenerator::~MeshGenerator() {}
 
+void MeshGenerator::setTemplates( const std::vector< QSharedPointer<MeshTemplate> >& templates )
+{
+  this->templates_ = templates;
+}
+
+MeshTemplate* MeshGenerator::findTemplate( const vnl_vector<double>& shape )
+{
+  // with several domains, pick the domain whose reference is closest
+  MeshTemplate* best = NULL;
+  double bestDistance = std::numeric_limits<double>::max();
+  for ( size_t i = 0; i < this->templates_.size(); i++ )
+  {
+    const vnl_vector<double>& reference = this->templates_[i]->getReference();
+    if ( reference.size() != shape.size() )
+    {
+      continue;
+    }
+    double distance = vnl_vector_ssd( reference, shape );
+    if ( distance < bestDistance )
+    {
+      bestDistance = distance;
+      best = this->templates_[i].data();
+    }
+  }
+  return best;
+}
+
 vtkSmartPointer<vtkPolyData> MeshGenerator::buildMesh( const vnl_vector<double>& shape )
+{
+  if ( this->prefs_.getTemplateWarpEnabled() )
+  {
+    MeshTemplate* meshTemplate = this->findTemplate( shape );
+    if ( meshTemplate && meshTemplate->build( *this ) )
+    {
+      return meshTemplate->warp( shape );
+    }
+  }
+  return this->reconstructMesh( shape );
+}
+
+vtkSmartPointer<vtkPolyData> MeshGenerator::reconstructMesh( const vnl_vector<double>& shape )
 {
   // copy shape points into point set
   int numPoints = shape.size() / 3;
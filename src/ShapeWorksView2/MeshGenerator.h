@@ -7,12 +7,18 @@
  * @brief Mesh generation
  *
  * The MeshGenerator performs the actual work of reconstructing
- * a mesh from a shape (list of points).
+ * a mesh from a shape (list of points).  Meshes are either reconstructed
+ * from scratch, or, when template warping is enabled, warped from the
+ * MeshTemplate built for the matching reference shape.
  */
 
 #ifndef MESH_GENERATOR_H
 #define MESH_GENERATOR_H
 
+#include <vector>
+
+#include <QSharedPointer>
+
 #include "vnl/vnl_vector.h"
 
 #include <vtkSmartPointer.h>
@@ -21,6 +27,7 @@
 #include <vtkContourFilter.h>
 #include <vtkReverseSense.h>
 #include <vtkSmoothPolyDataFilter.h>
+#include <MeshTemplate.h>
 #include <Preferences.h>
 
 class MeshGenerator
@@ -30,7 +37,18 @@ class MeshGenerator
     ~MeshGenerator();
     vtkSmartPointer<vtkPolyData> buildMesh( const vnl_vector<double>& shape );
 
+    // full implicit surface reconstruction, regardless of preferences
+    vtkSmartPointer<vtkPolyData> reconstructMesh( const vnl_vector<double>& shape );
+
+    // templates to warp from, one per domain
+    void setTemplates( const std::vector< QSharedPointer<MeshTemplate> >& templates );
+
   private:
+    // the template whose reference is closest to shape, or NULL
+    MeshTemplate* findTemplate( const vnl_vector<double>& shape );
+
+    std::vector< QSharedPointer<MeshTemplate> > templates_;
+
     vtkSmartPointer<vtkPolyData> transform_back(
         vtkSmartPointer<vtkPoints> pt,
         vtkSmartPointer<vtkPolyData> pd);
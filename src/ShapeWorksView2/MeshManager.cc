@@ -2,9 +2,6 @@
  * Shapeworks license
  */
 
-// qt
-#include <QThread>
-
 // vtk
 #include <vtkPolyData.h>
 
@@ -12,39 +9,91 @@
 
 MeshManager::MeshManager(Preferences& prefs) : prefs_(prefs), meshCache_(prefs), meshGenerator_(prefs)
 {
-	this->thread_count_ = 0;
+	this->request_count_ = 0;
+	this->active_workers_ = 0;
+
+	// keep the worker threads alive between requests
+	this->thread_pool_.setExpiryTimeout( -1 );
 }
 
-MeshManager::~MeshManager() {}
+MeshManager::~MeshManager()
+{
+	this->workQueue_.clear();
+	this->thread_pool_.waitForDone();
+}
 
 void MeshManager::clear_cache() { 
+	this->workQueue_.clear();
+	this->workQueue_.invalidate();
 	this->meshCache_.clear(); 
-	this->threads_.clear();
-	while(!this->workQueue_.isEmpty())
-		this->workQueue_.pop();
+
+	// the templates depend on the reconstruction settings too
+	this->resetTemplates();
 }
 
-void MeshManager::generateMesh( const vnl_vector<double>& shape )
+void MeshManager::setTemplateShapes( const std::vector< vnl_vector<double> >& shapes )
 {
-  // check cache first
-  if ( !this->meshCache_.getMesh( shape )
-       && !this->workQueue_.isInside( shape ) )
-  {
-      this->workQueue_.push( shape );
-	  //todo
-	  QThread *thread = new QThread;
-	  MeshWorker *worker = new MeshWorker(this->prefs_,shape,&this->workQueue_,&this->meshCache_);
-	  worker->moveToThread(thread);
-  	  connect(thread, SIGNAL(started()), worker, SLOT(process()));
-  	  connect(worker, SIGNAL(result_ready()),  this, SLOT(handle_thread_complete()));
-  	  connect(thread, SIGNAL(finished()), thread, SLOT(deleteLater()));
-	  size_t tmp_max = this->prefs_.getNumThreads();
-	  if (this->thread_count_ < tmp_max) {
-  		thread->start();
-		this->thread_count_++;
-	  } else 
-		threads_.push_back(thread);
-  }
+	this->templateShapes_ = shapes;
+	this->resetTemplates();
+}
+
+void MeshManager::resetTemplates()
+{
+	// workers still running keep their own references to the old templates
+	this->templates_.clear();
+	for ( size_t i = 0; i < this->templateShapes_.size(); i++ )
+	{
+		this->templates_.push_back( QSharedPointer<MeshTemplate>( new MeshTemplate( this->templateShapes_[i] ) ) );
+	}
+	this->meshGenerator_.setTemplates( this->templates_ );
+}
+
+void MeshManager::cancelPending()
+{
+	this->workQueue_.clear();
+}
+
+void MeshManager::generateMesh( const vnl_vector<double>& shape, long long priority )
+{
+	this->workQueue_.push( shape, priority );
+	this->startWorkers();
+}
+
+void MeshManager::startWorkers()
+{
+	int max_threads = this->prefs_.getNumThreads();
+	if ( this->thread_pool_.maxThreadCount() != max_threads && max_threads > 0 )
+	{
+		this->thread_pool_.setMaxThreadCount( max_threads );
+	}
+
+	while ( this->active_workers_ < max_threads && !this->workQueue_.isEmpty() )
+	{
+		MeshWorker *worker = new MeshWorker( this->prefs_, &this->workQueue_, &this->meshCache_, this->templates_ );
+		connect( worker, SIGNAL( result_ready() ), this, SLOT( handle_thread_complete() ) );
+		connect( worker, SIGNAL( finished() ), this, SLOT( handle_worker_finished() ) );
+		this->active_workers_++;
+		this->thread_pool_.start( worker );
+	}
+}
+
+void MeshManager::prefetchMeshes( const std::vector< vnl_vector<double> >& shapes )
+{
+	if ( !this->prefs_.getCacheEnabled() || !this->prefs_.getParallelEnabled() )
+	{
+		return;
+	}
+
+	// negative priorities keep prefetching behind every direct request,
+	// earlier shapes in the list first
+	for ( size_t i = 0; i < shapes.size(); i++ )
+	{
+		if ( !this->meshCache_.getMesh( shapes[i] ) )
+		{
+			this->workQueue_.push( shapes[i], -static_cast<long long>( i + 1 ) );
+		}
+	}
+	this->startWorkers();
 }
 
 vtkSmartPointer<vtkPolyData> MeshManager::getMesh( const vnl_vector<double>& shape )
@@ -58,7 +107,7 @@ vtkSmartPointer<vtkPolyData> MeshManager::getMesh( const vnl_vector<double>& sha
 	  if (prefs_.getParallelEnabled() && 
 		  (this->prefs_.getNumThreads() > 0))
 	  {
-		 this->generateMesh(shape);
+		 this->generateMesh( shape, ++this->request_count_ );
 	  } else {
 		 polyData = this->meshGenerator_.buildMesh( shape );
 		 this->meshCache_.insertMesh( shape, polyData );
@@ -73,13 +122,12 @@ vtkSmartPointer<vtkPolyData> MeshManager::getMesh( const vnl_vector<double>& sha
 }
 
 void MeshManager::handle_thread_complete() {
-	this->thread_count_ --;
-	size_t tmp_max = this->prefs_.getNumThreads();
-	while (!this->threads_.empty() && this->thread_count_ < tmp_max) {
-		QThread *thread = this->threads_.back();
-		this->threads_.pop_back();
-		thread->start();
-		this->thread_count_++;
-	}
 	emit new_mesh();
 }
+
+void MeshManager::handle_worker_finished() {
+	this->active_workers_--;
+
+	// a shape may have been queued while this worker was running out of work
+	this->startWorkers();
+}
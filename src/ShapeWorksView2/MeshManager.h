@@ -7,8 +7,9 @@
  * @brief Class to manage meshes
  *
  * The MeshManager handles all aspects of mesh generation and caching.
- * It houses the cache and manages threads to work on mesh generation
- * in the background.
+ * It houses the cache and a persistent pool of worker threads that build
+ * meshes in the background.  The newest request is always built first,
+ * and prefetched shapes are only built when no request is waiting.
  */
 
 #ifndef MESH_MANAGER_H
@@ -16,7 +17,7 @@
 
 #include <vtkSmartPointer.h>
 
-#include <QWaitCondition>
+#include <QThreadPool>
 
 #include <MeshCache.h>
 #include <MeshGenerator.h>
@@ -34,10 +35,20 @@ public:
 
   vtkSmartPointer<vtkPolyData> getMesh( const vnl_vector<double>& shape );
 
+  // queue meshes likely to be needed soon, in order, behind all requests
+  void prefetchMeshes( const std::vector< vnl_vector<double> >& shapes );
+
+  // drop requested and prefetched meshes whose construction has not started
+  void cancelPending();
+
+  // reference shapes (one per domain) for template warping
+  void setTemplateShapes( const std::vector< vnl_vector<double> >& shapes );
+
   void clear_cache();
 
 public Q_SLOTS:
   void handle_thread_complete();
+  void handle_worker_finished();
 
 signals:
   void new_mesh();
@@ -45,7 +56,13 @@ signals:
 private:
 
   // generate and cache a mesh for this shape in a queue
-  void generateMesh( const vnl_vector<double>& shape );
+  void generateMesh( const vnl_vector<double>& shape, long long priority );
+
+  // start pool workers for queued shapes, up to the thread preference
+  void startWorkers();
+
+  // fresh (unbuilt) templates for the current reference shapes
+  void resetTemplates();
 
   Preferences& prefs_;
 
@@ -57,11 +74,19 @@ private:
 
   // queue of meshes to build
   MeshWorkQueue workQueue_;
+
+  // templates shared by all generators, replaced (not modified) when settings change
+  std::vector< vnl_vector<double> > templateShapes_;
+  std::vector< QSharedPointer<MeshTemplate> > templates_;
   
-  // the workers
-  std::vector<QThread*> threads_;
-  
-  size_t thread_count_;
+  // priority of the most recent request
+  long long request_count_;
+
+  // number of workers started on the pool and not yet finished
+  int active_workers_;
+
+  // the workers, declared last so it is destroyed (and waited for) first
+  QThreadPool thread_pool_;
 };
 
 #endif // ifndef MESH_Manager_H
@@ -0,0 +1,174 @@
+/*
+ * Shapeworks license
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include <vtkCellArray.h>
+#include <vtkIdList.h>
+#include <vtkIdTypeArray.h>
+#include <vtkKdTreePointLocator.h>
+#include <vtkMath.h>
+#include <vtkPoints.h>
+#include <vtkPolyData.h>
+#include <vtkPolyDataNormals.h>
+
+#include <MeshGenerator.h>
+#include <MeshTemplate.h>
+
+MeshTemplate::MeshTemplate( const vnl_vector<double>& reference ) : reference_( reference )
+{
+  this->numPolys_ = 0;
+  this->built_ = false;
+  this->valid_ = false;
+}
+
+const vnl_vector<double>& MeshTemplate::getReference() const
+{
+  return this->reference_;
+}
+
+bool MeshTemplate::build( MeshGenerator& generator )
+{
+  QMutexLocker locker( &this->mutex_ );
+
+  if ( this->built_ )
+  {
+    return this->valid_;
+  }
+  this->built_ = true;
+
+  vtkSmartPointer<vtkPolyData> mesh = generator.reconstructMesh( this->reference_ );
+  int numParticles = this->reference_.size() / 3;
+  if ( !mesh || mesh->GetNumberOfPoints() == 0 || numParticles < 1 )
+  {
+    return false;
+  }
+
+  // keep the template as plain arrays, which workers may then read concurrently
+  vtkIdType numVertices = mesh->GetNumberOfPoints();
+  this->vertices_.resize( numVertices * 3 );
+  for ( vtkIdType i = 0; i < numVertices; i++ )
+  {
+    mesh->GetPoint( i, &this->vertices_[i * 3] );
+  }
+
+  vtkIdTypeArray* cells = mesh->GetPolys()->GetData();
+  this->polys_.assign( cells->GetPointer( 0 ), cells->GetPointer( 0 ) + cells->GetNumberOfTuples() );
+  this->numPolys_ = mesh->GetPolys()->GetNumberOfCells();
+
+  // nearest particles of every template vertex
+  vtkSmartPointer<vtkPoints> particlePoints = vtkSmartPointer<vtkPoints>::New();
+  particlePoints->SetDataTypeToDouble();
+  particlePoints->SetNumberOfPoints( numParticles );
+  for ( int i = 0; i < numParticles; i++ )
+  {
+    particlePoints->SetPoint( i, this->reference_[i * 3], this->reference_[i * 3 + 1], this->reference_[i * 3 + 2] );
+  }
+  vtkSmartPointer<vtkPolyData> particleSet = vtkSmartPointer<vtkPolyData>::New();
+  particleSet->SetPoints( particlePoints );
+
+  vtkSmartPointer<vtkKdTreePointLocator> locator = vtkSmartPointer<vtkKdTreePointLocator>::New();
+  locator->SetDataSet( particleSet );
+  locator->BuildLocator();
+
+  int k = std::min( (int)NUM_NEIGHBORS, numParticles );
+  vtkSmartPointer<vtkIdList> neighbors = vtkSmartPointer<vtkIdList>::New();
+
+  this->rowStart_.resize( numVertices + 1 );
+  this->particles_.clear();
+  this->weights_.clear();
+  this->particles_.reserve( numVertices * k );
+  this->weights_.reserve( numVertices * k );
+
+  for ( vtkIdType i = 0; i < numVertices; i++ )
+  {
+    this->rowStart_[i] = this->particles_.size();
+
+    // the support radius reaches just past the k-th nearest particle, one more
+    // neighbor is asked for so the radius adapts to the local particle spacing
+    const double* v = &this->vertices_[i * 3];
+    locator->FindClosestNPoints( std::min( k + 1, numParticles ), v, neighbors );
+
+    double radius = 0.0;
+    for ( vtkIdType j = 0; j < neighbors->GetNumberOfIds(); j++ )
+    {
+      double p[3];
+      particlePoints->GetPoint( neighbors->GetId( j ), p );
+      double r = sqrt( vtkMath::Distance2BetweenPoints( v, p ) );
+      if ( r > radius ) { radius = r; }
+    }
+    radius = radius * 1.01 + 1e-12;
+
+    double sum = 0.0;
+    for ( vtkIdType j = 0; j < neighbors->GetNumberOfIds() && j < k; j++ )
+    {
+      double p[3];
+      particlePoints->GetPoint( neighbors->GetId( j ), p );
+      double r = sqrt( vtkMath::Distance2BetweenPoints( v, p ) ) / radius;
+
+      // Wendland C2 kernel, (1 - r)^4 (4r + 1)
+      double w = ( 1.0 - r ) * ( 1.0 - r ) * ( 1.0 - r ) * ( 1.0 - r ) * ( 4.0 * r + 1.0 );
+      this->particles_.push_back( neighbors->GetId( j ) );
+      this->weights_.push_back( w );
+      sum += w;
+    }
+
+    // normalized, so rigid translations are reproduced exactly
+    for ( unsigned int j = this->rowStart_[i]; j < this->particles_.size(); j++ )
+    {
+      this->weights_[j] /= sum;
+    }
+  }
+  this->rowStart_[numVertices] = this->particles_.size();
+
+  this->valid_ = true;
+  return true;
+}
+
+vtkSmartPointer<vtkPolyData> MeshTemplate::warp( const vnl_vector<double>& shape ) const
+{
+  vtkIdType numVertices = this->vertices_.size() / 3;
+
+  vtkSmartPointer<vtkPoints> points = vtkSmartPointer<vtkPoints>::New();
+  points->SetDataTypeToDouble();
+  points->SetNumberOfPoints( numVertices );
+
+  for ( vtkIdType i = 0; i < numVertices; i++ )
+  {
+    double x[3] = { this->vertices_[i * 3], this->vertices_[i * 3 + 1], this->vertices_[i * 3 + 2] };
+    for ( unsigned int j = this->rowStart_[i]; j < this->rowStart_[i + 1]; j++ )
+    {
+      unsigned int p = this->particles_[j] * 3;
+      double w = this->weights_[j];
+      x[0] += w * ( shape[p] - this->reference_[p] );
+      x[1] += w * ( shape[p + 1] - this->reference_[p + 1] );
+      x[2] += w * ( shape[p + 2] - this->reference_[p + 2] );
+    }
+    points->SetPoint( i, x );
+  }
+
+  vtkSmartPointer<vtkIdTypeArray> cells = vtkSmartPointer<vtkIdTypeArray>::New();
+  cells->SetNumberOfValues( this->polys_.size() );
+  std::copy( this->polys_.begin(), this->polys_.end(), cells->GetPointer( 0 ) );
+  vtkSmartPointer<vtkCellArray> polys = vtkSmartPointer<vtkCellArray>::New();
+  polys->SetCells( this->numPolys_, cells );
+
+  vtkSmartPointer<vtkPolyData> mesh = vtkSmartPointer<vtkPolyData>::New();
+  mesh->SetPoints( points );
+  mesh->SetPolys( polys );
+
+  // the template is already consistently oriented, only the normals move
+  vtkSmartPointer<vtkPolyDataNormals> normals = vtkSmartPointer<vtkPolyDataNormals>::New();
+#if VTK_MAJOR_VERSION <= 5
+  normals->SetInput( mesh );
+#else
+  normals->SetInputData( mesh );
+#endif
+  normals->SplittingOff();
+  normals->ConsistencyOff();
+  normals->AutoOrientNormalsOff();
+  normals->Update();
+  return normals->GetOutput();
+}
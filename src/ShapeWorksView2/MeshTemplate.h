@@ -0,0 +1,66 @@
+/*
+ * Shapeworks license
+ */
+
+/**
+ * @file MeshTemplate.h
+ * @brief Mesh reconstruction by warping a template mesh
+ *
+ * The MeshTemplate reconstructs a mesh for a reference shape (e.g. the mean) once, and
+ * builds every other shape by moving the template's vertices with the particles.  Each
+ * vertex follows a Wendland radial basis weighted average of the displacements of its
+ * nearest particles.  The weights are precomputed as a sparse matrix, so a new shape costs
+ * one sparse matrix-vector product plus recomputing the normals.
+ */
+
+#ifndef MESH_TEMPLATE_H
+#define MESH_TEMPLATE_H
+
+#include <vector>
+
+#include <QMutex>
+
+#include <vtkSmartPointer.h>
+#include <vtkType.h>
+
+#include <vnl/vnl_vector.h>
+
+class vtkPolyData;
+class MeshGenerator;
+
+class MeshTemplate
+{
+public:
+  MeshTemplate( const vnl_vector<double>& reference );
+
+  const vnl_vector<double>& getReference() const;
+
+  /// reconstruct the reference mesh and precompute the weights, if not yet done
+  bool build( MeshGenerator& generator );
+
+  /// the mesh for shape, which must have as many points as the reference (requires build())
+  vtkSmartPointer<vtkPolyData> warp( const vnl_vector<double>& shape ) const;
+
+private:
+
+  // number of particles each vertex follows
+  enum { NUM_NEIGHBORS = 8 };
+
+  vnl_vector<double> reference_;
+
+  // template vertices (x, y, z interleaved) and polygons (vtk legacy cell layout)
+  std::vector<double> vertices_;
+  std::vector<vtkIdType> polys_;
+  vtkIdType numPolys_;
+
+  // sparse weights, row i holds the particles and weights for vertex i
+  std::vector<unsigned int> rowStart_;
+  std::vector<unsigned int> particles_;
+  std::vector<double> weights_;
+
+  bool built_;
+  bool valid_;
+  QMutex mutex_;
+};
+
+#endif // ifndef MESH_TEMPLATE_H
@@ -3,41 +3,122 @@
  */
 
 #include <MeshWorkQueue.h>
+#include <MeshCache.h>
 
 MeshWorkQueue::MeshWorkQueue()
-{}
+{
+  this->generation = 0;
+}
 
 MeshWorkQueue::~MeshWorkQueue()
 {}
 
-void MeshWorkQueue::push( const vnl_vector<double> &item )
+MeshWorkQueue::WorkList::iterator MeshWorkQueue::find( quint64 digest, const vnl_vector<double> &item )
+{
+  QMultiHash< quint64, WorkList::iterator >::iterator it = this->index.find( digest );
+  for ( ; it != this->index.end() && it.key() == digest; ++it )
+  {
+    if ( it.value()->second.shape == item )
+    {
+      return it.value();
+    }
+  }
+  return this->workList.end();
+}
+
+void MeshWorkQueue::erase( WorkList::iterator it )
 {
+  this->index.remove( it->second.digest, it );
+  this->workList.erase( it );
+}
+
+void MeshWorkQueue::push( const vnl_vector<double> &item, long long priority )
+{
+  MeshWorkItem work;
+  work.shape = item;
+  work.digest = MeshCache::shapeDigest( item );
+  work.priority = priority;
+  work.generation = 0;
+
   QMutexLocker locker( &this->mutex );
-  this->workList.push_back( item );
+
+  // already being built
+  QMultiHash< quint64, vnl_vector<double> >::iterator pit = this->inProgress.find( work.digest );
+  for ( ; pit != this->inProgress.end() && pit.key() == work.digest; ++pit )
+  {
+    if ( pit.value() == item )
+    {
+      return;
+    }
+  }
+
+  WorkList::iterator it = this->find( work.digest, item );
+  if ( it != this->workList.end() )
+  {
+    if ( it->first >= priority )
+    {
+      return;
+    }
+    this->erase( it );
+  }
+
+  it = this->workList.insert( std::make_pair( priority, work ) );
+  this->index.insert( work.digest, it );
 }
 
 MeshWorkItem* MeshWorkQueue::pop()
 {
   QMutexLocker locker( &this->mutex );
-  MeshWorkItem* item = new MeshWorkItem;
 
   if ( this->workList.empty() )
   {
     return NULL;
   }
 
-  item->shape = this->workList.front();
-  this->workList.pop_front();
+  WorkList::iterator it = --this->workList.end();
+  MeshWorkItem* item = new MeshWorkItem( it->second );
+  item->generation = this->generation;
+  this->erase( it );
+  this->inProgress.insert( item->digest, item->shape );
   return item;
 }
 
+void MeshWorkQueue::finish( const MeshWorkItem* item )
+{
+  QMutexLocker locker( &this->mutex );
+
+  QMultiHash< quint64, vnl_vector<double> >::iterator it = this->inProgress.find( item->digest );
+  for ( ; it != this->inProgress.end() && it.key() == item->digest; ++it )
+  {
+    if ( it.value() == item->shape )
+    {
+      this->inProgress.erase( it );
+      return;
+    }
+  }
+}
+
+bool MeshWorkQueue::isCurrent( const MeshWorkItem* item )
+{
+  QMutexLocker locker( &this->mutex );
+  return item->generation == this->generation;
+}
+
 bool MeshWorkQueue::isInside( const vnl_vector<double> &item )
 {
+  quint64 digest = MeshCache::shapeDigest( item );
+
   QMutexLocker locker( &this->mutex );
 
-  for ( WorkList::iterator it = this->workList.begin(); it != this->workList.end(); ++it )
+  if ( this->find( digest, item ) != this->workList.end() )
+  {
+    return true;
+  }
+
+  QMultiHash< quint64, vnl_vector<double> >::iterator it = this->inProgress.find( digest );
+  for ( ; it != this->inProgress.end() && it.key() == digest; ++it )
   {
-    if ( *it == item )
+    if ( it.value() == item )
     {
       return true;
     }
@@ -47,9 +128,28 @@ bool MeshWorkQueue::isInside( const vnl_vector<double> &item )
 
 void MeshWorkQueue::remove( const vnl_vector<double> &item )
 {
+  quint64 digest = MeshCache::shapeDigest( item );
+
   QMutexLocker locker( &this->mutex );
 
-  this->workList.remove( item );
+  WorkList::iterator it = this->find( digest, item );
+  if ( it != this->workList.end() )
+  {
+    this->erase( it );
+  }
+}
+
+void MeshWorkQueue::clear()
+{
+  QMutexLocker locker( &this->mutex );
+  this->workList.clear();
+  this->index.clear();
+}
+
+void MeshWorkQueue::invalidate()
+{
+  QMutexLocker locker( &this->mutex );
+  this->generation++;
 }
 
 bool MeshWorkQueue::isEmpty()
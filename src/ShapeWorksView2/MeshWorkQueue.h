@@ -6,15 +6,19 @@
  * @file MeshWorkQueue.h
  * @brief Provides concurrent access to a list of shapes to work needing reconstruction
  *
+ * Shapes are queued with a priority and handed out highest priority first.  Queued and
+ * in progress shapes are indexed by their MeshCache digest, so checking whether a shape
+ * is already in flight does not scan the queue.
  */
 
 #ifndef MESH_WORK_QUEUE_H
 #define MESH_WORK_QUEUE_H
 
 // stl
-#include <list>
+#include <map>
 
 // qt
+#include <QMultiHash>
 #include <QMutex>
 
 // vnl
@@ -24,6 +28,11 @@ class MeshWorkItem
 {
 public:
   vnl_vector<double> shape;
+  quint64 digest;
+  long long priority;
+
+  // value of the queue's generation when the item was handed out
+  int generation;
 };
 
 class MeshWorkQueue
@@ -33,14 +42,29 @@ public:
   MeshWorkQueue();
   ~MeshWorkQueue();
 
-  void push( const vnl_vector<double> &item );
+  /// queue a shape, or raise its priority if it is already queued; shapes in progress are skipped
+  void push( const vnl_vector<double> &item, long long priority );
 
+  /// take the highest priority shape, which is then in progress until finish()
   MeshWorkItem* pop();
 
+  /// mark a popped item as no longer in progress
+  void finish( const MeshWorkItem* item );
+
+  /// true unless invalidate() was called after the item was popped
+  bool isCurrent( const MeshWorkItem* item );
+
+  /// queued or in progress
   bool isInside( const vnl_vector<double> &item );
 
   void remove( const vnl_vector<double> &item );
 
+  /// drop all queued (not yet started) shapes
+  void clear();
+
+  /// mark all items in progress as stale, e.g. when mesh settings change
+  void invalidate();
+
   bool isEmpty();
 
 private:
@@ -48,9 +72,22 @@ private:
   // for concurrent access
   QMutex mutex;
 
-  typedef std::list< vnl_vector<double> > WorkList;
+  typedef std::multimap< long long, MeshWorkItem > WorkList;
+
+  // the queued item for this shape, or end() (caller holds the lock)
+  WorkList::iterator find( quint64 digest, const vnl_vector<double> &item );
+
+  void erase( WorkList::iterator it );
 
   WorkList workList;
+
+  // queued items by shape digest
+  QMultiHash< quint64, WorkList::iterator > index;
+
+  // shapes being built, by digest
+  QMultiHash< quint64, vnl_vector<double> > inProgress;
+
+  int generation;
 };
 
 #endif // ifndef MESH_WORK_QUEUE_H
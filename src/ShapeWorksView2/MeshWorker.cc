@@ -8,18 +8,31 @@
 #include <MeshWorker.h>
 
 MeshWorker::MeshWorker(Preferences& prefs, 
-		const vnl_vector<double> shape, 
 		MeshWorkQueue *queue,
-		MeshCache * cache) 
-	: prefs_(prefs), meshGenerator_(prefs), shape_(shape), queue_(queue), cache_(cache) {}
+		MeshCache * cache,
+		const std::vector< QSharedPointer<MeshTemplate> >& templates) 
+	: prefs_(prefs), queue_(queue), cache_(cache), templates_(templates) {}
 
 MeshWorker::~MeshWorker() {}
 
-void MeshWorker::process()
+void MeshWorker::run()
 {
-    // build the mesh using our MeshGenerator
-    vtkSmartPointer<vtkPolyData> mesh = this->meshGenerator_.buildMesh( this->shape_ );
-	this->queue_->remove(this->shape_);
-	this->cache_->insertMesh( this->shape_, mesh );
-	emit result_ready();
-}
\ No newline at end of file
+	MeshGenerator meshGenerator(this->prefs_);
+	meshGenerator.setTemplates(this->templates_);
+
+	while ( MeshWorkItem* item = this->queue_->pop() )
+	{
+		// build the mesh using our MeshGenerator
+		vtkSmartPointer<vtkPolyData> mesh = meshGenerator.buildMesh( item->shape );
+
+		// meshes built with settings that changed meanwhile are dropped
+		if ( this->queue_->isCurrent( item ) )
+		{
+			this->cache_->insertMesh( item->shape, mesh );
+		}
+		this->queue_->finish( item );
+		delete item;
+		emit result_ready();
+	}
+	emit finished();
+}
@@ -6,43 +6,43 @@
  * @file MeshWorker.h
  * @brief Worker class for parallel mesh reconstruction
  *
- * The MeshWorker implements each threads mesh construction management
+ * The MeshWorker runs on the MeshManager's thread pool.  It takes shapes from the work
+ * queue, highest priority first, and builds and caches their meshes until the queue is
+ * empty.
  */
 
 #ifndef MESH_WORKER_H
 #define MESH_WORKER_H
 
 #include <QObject>
-#include <QWaitCondition>
+#include <QRunnable>
 
 #include <MeshWorkQueue.h>
 #include <MeshCache.h>
 #include <MeshGenerator.h>
 
-class MeshWorker : public QObject
+class MeshWorker : public QObject, public QRunnable
 {
   Q_OBJECT
 
 public:
 	MeshWorker(Preferences& prefs, 
-		const vnl_vector<double> shape, 
 		MeshWorkQueue *queue,
-		MeshCache * cache);
+		MeshCache * cache,
+		const std::vector< QSharedPointer<MeshTemplate> >& templates);
 	~MeshWorker();
-  MeshGenerator* getMeshGenerator();
 
-public Q_SLOTS:
-  void process();
+  void run();
 
 Q_SIGNALS:
   void result_ready();
+  void finished();
 
 private:
   Preferences& prefs_;
-  MeshGenerator meshGenerator_;
-  vnl_vector<double> shape_;
   MeshWorkQueue *queue_;
   MeshCache * cache_;
+  std::vector< QSharedPointer<MeshTemplate> > templates_;
 
 };
 
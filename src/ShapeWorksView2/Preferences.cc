@@ -19,10 +19,13 @@ const float DEFAULT_NUM_THREADS = 100.0f;
 const float DEFAULT_PCA_RANGE = 2.0f;
 const int DEFAULT_PCA_STEPS = 40;
 const int DEFAULT_REGRESSION_STEPS = 50;
+const int DEFAULT_PCA_MODES = 0;
+const bool DEFAULT_SHAPE_CACHE_ENABLED = false;
 const int DEFAULT_SMOOTHING_AMOUNT = 1;
 const float DEFAULT_CACHE_EPSILON = 1e-3f;
 const float DEFAULT_SPACING = 8.f;
 const int DEFAULT_NEIGHBORHOOD = 8;
+const bool DEFAULT_TEMPLATE_WARP_ENABLED = false;
 
 //-----------------------------------------------------------------------------
 Preferences::Preferences()
@@ -210,6 +213,30 @@ void Preferences::setNumRegressionSteps( int value )
   emit this->sliders_changed_signal();
 }
 
+//-----------------------------------------------------------------------------
+int Preferences::getNumPcaModes()
+{
+  return this->settings.value( "Analysis/PcaModes", DEFAULT_PCA_MODES ).toInt();
+}
+
+//-----------------------------------------------------------------------------
+void Preferences::setNumPcaModes( int value )
+{
+  this->settings.setValue( "Analysis/PcaModes", value );
+}
+
+//-----------------------------------------------------------------------------
+bool Preferences::getShapeCacheEnabled()
+{
+  return this->settings.value( "Analysis/ShapeCache", DEFAULT_SHAPE_CACHE_ENABLED ).toBool();
+}
+
+//-----------------------------------------------------------------------------
+void Preferences::setShapeCacheEnabled( bool enabled )
+{
+  this->settings.setValue( "Analysis/ShapeCache", enabled );
+}
+
 int Preferences::getSmoothingAmount() {
 	return this->settings.value( "Mesh/SmoothingAmount", DEFAULT_SMOOTHING_AMOUNT ).toInt();
 }
@@ -238,6 +265,13 @@ void Preferences::setNeighborhood(int value) {
   this->settings.setValue( "Mesh/Neighborhood", value );
 }
 
+bool Preferences::getTemplateWarpEnabled() {
+	return this->settings.value( "Mesh/TemplateWarp", DEFAULT_TEMPLATE_WARP_ENABLED ).toBool();
+}
+void Preferences::setTemplateWarpEnabled(bool enabled) {
+  this->settings.setValue( "Mesh/TemplateWarp", enabled );
+}
+
 //-----------------------------------------------------------------------------
 void Preferences::restoreDefaults()
 {
@@ -251,6 +285,9 @@ void Preferences::restoreDefaults()
   this->settings.setValue( "Sliders/PcaRange", DEFAULT_PCA_RANGE );
   this->settings.setValue( "Sliders/PcaSteps", DEFAULT_PCA_STEPS );
   this->settings.setValue( "Sliders/RegressionSteps", DEFAULT_REGRESSION_STEPS );
+  this->settings.setValue( "Analysis/PcaModes", DEFAULT_PCA_MODES );
+  this->settings.setValue( "Analysis/ShapeCache", DEFAULT_SHAPE_CACHE_ENABLED );
   this->settings.setValue( "Mesh/SmoothingAmount", DEFAULT_SMOOTHING_AMOUNT );
   this->settings.setValue( "Mesh/CachingEpsilon", DEFAULT_CACHE_EPSILON );
+  this->settings.setValue( "Mesh/TemplateWarp", DEFAULT_TEMPLATE_WARP_ENABLED );
 }
@@ -65,6 +65,14 @@ public:
   int getNumRegressionSteps();
   void setNumRegressionSteps( int value );
 
+  /// number of leading PCA modes to compute, 0 for all
+  int getNumPcaModes();
+  void setNumPcaModes( int value );
+
+  /// cache the shape matrix next to the analysis file
+  bool getShapeCacheEnabled();
+  void setShapeCacheEnabled( bool enabled );
+
   /// restore all default values
   void restoreDefaults();
 
@@ -80,6 +88,10 @@ public:
   int getNeighborhood();
   void setNeighborhood(int value);
 
+  /// build meshes by warping the mean shape's mesh instead of reconstructing each one
+  bool getTemplateWarpEnabled();
+  void setTemplateWarpEnabled(bool enabled);
+
 Q_SIGNALS:
   void color_scheme_changed( int newIndex );
   void glyph_properties_changed();
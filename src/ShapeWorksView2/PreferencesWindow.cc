@@ -84,6 +84,21 @@ void PreferencesWindow::on_parallelEnabled_stateChanged( int state )
   prefs_.setParallelEnabled( this->ui->parallelEnabled->isChecked() );
 }
 
+void PreferencesWindow::on_templateWarpEnabled_stateChanged( int state )
+{
+  if ( prefs_.getTemplateWarpEnabled() == this->ui->templateWarpEnabled->isChecked() )
+  {
+    return;
+  }
+  prefs_.setTemplateWarpEnabled( this->ui->templateWarpEnabled->isChecked() );
+  emit clear_cache();
+}
+
+void PreferencesWindow::on_shapeCacheEnabled_stateChanged( int state )
+{
+  prefs_.setShapeCacheEnabled( this->ui->shapeCacheEnabled->isChecked() );
+}
+
 
 void PreferencesWindow::on_pcaRangeSpinBox_valueChanged( double value )
 {
@@ -120,6 +135,8 @@ void PreferencesWindow::setValuesFromPreferences()
 
   this->ui->numThreadsSlider->setValue( prefs_.getNumThreads() );
   this->ui->parallelEnabled->setChecked( prefs_.getParallelEnabled() );
+  this->ui->templateWarpEnabled->setChecked( prefs_.getTemplateWarpEnabled() );
+  this->ui->shapeCacheEnabled->setChecked( prefs_.getShapeCacheEnabled() );
 
   this->ui->pcaRangeSpinBox->setValue( prefs_.getPcaRange() );
   this->ui->pcaStepsSpinBox->setValue( prefs_.getNumPcaSteps() );
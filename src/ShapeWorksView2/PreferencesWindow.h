@@ -36,6 +36,8 @@ public Q_SLOTS:
   void on_glyphQuality_valueChanged( int value );
   void on_numThreadsSlider_valueChanged( int value );
   void on_parallelEnabled_stateChanged( int state );
+  void on_templateWarpEnabled_stateChanged( int state );
+  void on_shapeCacheEnabled_stateChanged( int state );
 
   void on_pcaRangeSpinBox_valueChanged( double value );
   void on_pcaStepsSpinBox_valueChanged( int value );
@@ -358,11 +358,8 @@ void ShapeWorksView2::on_actionExportVarianceReport_triggered()
   outfile.open( filename.toStdString().c_str() );
   outfile << "pca mode, variance, percent variance, sum percent\n";
 
-  double totalVariance = 0;
-  for ( int c = 0; c < this->stats.Eigenvectors().columns(); c++ )
-  {
-    totalVariance += this->stats.Eigenvalues()[this->stats.Eigenvectors().columns() - ( c + 1 )];
-  }
+  // includes the variance of modes that were not computed
+  double totalVariance = this->stats.TotalVariance();
 
   double sum_variance = 0;
   for ( int c = 0; c < this->stats.Eigenvectors().columns(); c++ )
@@ -606,7 +603,7 @@ void ShapeWorksView2::on_pcaSlider_valueChanged()
   // this will make the slider handle redraw making the UI appear more responsive
   QCoreApplication::processEvents();
 
-  this->computeModeShape();
+  this->computeModeShape( this->ui->pcaSlider );
   this->redraw();
 }
 
@@ -614,7 +611,7 @@ void ShapeWorksView2::on_pcaSlider_valueChanged()
 void ShapeWorksView2::on_pcaModeSpinBox_valueChanged()
 {
   
-  this->computeModeShape();
+  this->computeModeShape( this->ui->pcaSlider );
   this->redraw();
 }
 
@@ -624,7 +621,7 @@ void ShapeWorksView2::on_pcaGroupSlider_valueChanged()
   // this will make the UI appear more responsive
   QCoreApplication::processEvents();
 
-  this->computeModeShape();
+  this->computeModeShape( this->ui->pcaGroupSlider );
   this->redraw();
 }
 
@@ -995,7 +992,7 @@ void ShapeWorksView2::updateAnalysisMode()
   }
   else if ( this->ui->tabWidget->currentWidget() == this->ui->pcaTab )
   {
-    this->computeModeShape();
+    this->computeModeShape( this->ui->pcaSlider );
   }
   else if ( this->ui->tabWidget->currentWidget() == this->ui->regressionTab )
   {
@@ -1141,7 +1138,9 @@ bool ShapeWorksView2::readParameterFile( char* filename )
   if ( elem ) {this->numDomains = atoi( elem->GetText() ); }
 
   // Run statistics
+  this->stats.SetUseShapeMatrixCache( this->prefs_.getShapeCacheEnabled() );
   this->stats.ReadPointFiles( filename );
+  this->stats.SetNumberOfModes( this->prefs_.getNumPcaModes() );
   this->stats.ComputeModes();
   this->stats.PrincipalComponentProjections();
 
@@ -1151,6 +1150,14 @@ bool ShapeWorksView2::readParameterFile( char* filename )
 
   this->numSamples = this->stats.ShapeMatrix().cols();
 
+  // the mean shape of each domain is the template for fast reconstruction
+  std::vector< vnl_vector<double> > templateShapes;
+  for ( int i = 0; i < this->numDomains; i++ )
+  {
+    templateShapes.push_back( this->getDomainShape( this->stats.Mean(), i ) );
+  }
+  this->meshManager.setTemplateShapes( templateShapes );
+
   this->initializeRenderer();
   this->initializeGlyphs();
   this->initializeSurfaces();
@@ -1634,38 +1641,120 @@ void ShapeWorksView2::resetPointScalars()
 }
 
 //---------------------------------------------------------------------------
-void ShapeWorksView2::computeModeShape()
+void ShapeWorksView2::computeModeShape( QSlider* axis )
 {
   double pcaSliderValue = this->getPcaValue( this->ui->pcaSlider->value() );
   int box_val = this->ui->pcaModeSpinBox->value();
-  if (box_val > this->numSamples - 1) box_val = this->numSamples - 1;
+  int num_modes = this->stats.Eigenvectors().columns();
+  if (box_val > num_modes - 1) box_val = num_modes - 1;
   unsigned int m = this->stats.Eigenvectors().columns() - ( box_val + 1 );
 
-  vnl_vector<double> e = this->stats.Eigenvectors().get_column( m );
-
   double lambda = sqrt( this->stats.Eigenvalues()[m] );
 
   this->ui->pcaValueLabel->setText( QString::number( pcaSliderValue, 'g', 2 ) );
   this->ui->pcaEigenValueLabel->setText( QString::number( this->stats.Eigenvalues()[m] ) );
   this->ui->pcaLambdaLabel->setText( QString::number( pcaSliderValue * lambda ) );
 
-  double groupSliderValue = this->ui->pcaGroupSlider->value();
+  // meshes queued for the previous slider position are stale now
+  this->meshManager.cancelPending();
+  this->displayShape( this->getModeShape( this->ui->pcaSlider->value() ) );
+  this->prefetchMeshes( axis );
+}
+
+//---------------------------------------------------------------------------
+vnl_vector<double> ShapeWorksView2::getModeShape( int pcaSliderValue )
+{
+  return this->getModeShape( pcaSliderValue, this->ui->pcaGroupSlider->value() );
+}
+
+//---------------------------------------------------------------------------
+vnl_vector<double> ShapeWorksView2::getModeShape( int pcaSliderValue, int groupSliderValue )
+{
+  double pcaValue = this->getPcaValue( pcaSliderValue );
+  int box_val = this->ui->pcaModeSpinBox->value();
+  int num_modes = this->stats.Eigenvectors().columns();
+  if (box_val > num_modes - 1) box_val = num_modes - 1;
+  unsigned int m = this->stats.Eigenvectors().columns() - ( box_val + 1 );
+
+  vnl_vector<double> e = this->stats.Eigenvectors().get_column( m );
+
+  double lambda = sqrt( this->stats.Eigenvalues()[m] );
+
   double groupRatio = groupSliderValue / static_cast<double>( this->ui->pcaGroupSlider->maximum() );
   if ( this->groupsAvailable )
   {
-    this->displayShape( this->stats.Group1Mean() + ( this->stats.GroupDifference() * groupRatio ) + ( e * ( pcaSliderValue * lambda ) ) );
+    return this->stats.Group1Mean() + ( this->stats.GroupDifference() * groupRatio ) + ( e * ( pcaValue * lambda ) );
   }
   else
   {
-    this->displayShape( this->stats.Mean() + ( e * ( pcaSliderValue * lambda ) ) );
+    return this->stats.Mean() + ( e * ( pcaValue * lambda ) );
   }
 }
 
 //---------------------------------------------------------------------------
 void ShapeWorksView2::computeRegressionShape()
 {
-  vnl_vector<double> shape = this->regression->ComputeMean( this->getRegressionValue( this->ui->regressionSlider->value() ) );
-  this->displayShape( shape );
+  // meshes queued for the previous slider position are stale now
+  this->meshManager.cancelPending();
+  this->displayShape( this->getRegressionShape( this->ui->regressionSlider->value() ) );
+  this->prefetchMeshes( this->ui->regressionSlider );
+}
+
+//---------------------------------------------------------------------------
+vnl_vector<double> ShapeWorksView2::getRegressionShape( int regressionSliderValue )
+{
+  return this->regression->ComputeMean( this->getRegressionValue( regressionSliderValue ) );
+}
+
+//---------------------------------------------------------------------------
+void ShapeWorksView2::prefetchMeshes( QSlider* axis )
+{
+  if ( !this->ui->showSurface->isChecked() || !this->prefs_.getCacheEnabled()
+       || !this->prefs_.getParallelEnabled() || this->prefs_.getNumThreads() <= 0 )
+  {
+    return;
+  }
+
+  // look ahead in the animation direction, or to both sides when idle,
+  // a couple of positions per worker thread
+  this->setPregenSteps();
+  int positions = 2 * this->prefs_.getNumThreads();
+
+  std::vector< vnl_vector<double> > shapes;
+  for ( size_t i = 0; i < this->pregenSteps.size() && positions > 0; i++ )
+  {
+    if ( this->pregenSteps[i] == 0 )
+    {
+      continue;
+    }
+
+    int value = axis->value() + this->pregenSteps[i] * axis->singleStep();
+    if ( value < axis->minimum() || value > axis->maximum() )
+    {
+      continue;
+    }
+
+    vnl_vector<double> shape;
+    if ( axis == this->ui->regressionSlider )
+    {
+      shape = this->getRegressionShape( value );
+    }
+    else if ( axis == this->ui->pcaGroupSlider )
+    {
+      shape = this->getModeShape( this->ui->pcaSlider->value(), value );
+    }
+    else
+    {
+      shape = this->getModeShape( value );
+    }
+    for ( int d = 0; d < this->numDomains; d++ )
+    {
+      shapes.push_back( this->getDomainShape( shape, d ) );
+    }
+    positions--;
+  }
+
+  this->meshManager.prefetchMeshes( shapes );
 }
 
 //---------------------------------------------------------------------------
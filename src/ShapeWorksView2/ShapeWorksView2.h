@@ -25,6 +25,8 @@
 #include <Preferences.h>
 #include <PreferencesWindow.h>
 
+class QSlider;
+
 class vtkRenderer;
 class vtkLookupTable;
 class vtkColorTransferFunction;
@@ -147,9 +149,17 @@ private:
   void displaySpheres();
   void resetPointScalars();
 
-  void computeModeShape();
+  // display the mode shape, prefetching along the given slider (the pca or group slider)
+  void computeModeShape( QSlider* axis );
   void computeRegressionShape();
 
+  vnl_vector<double> getModeShape( int pcaSliderValue );
+  vnl_vector<double> getModeShape( int pcaSliderValue, int groupSliderValue );
+  vnl_vector<double> getRegressionShape( int regressionSliderValue );
+
+  // queue meshes for the positions around the current one along the given slider
+  void prefetchMeshes( QSlider* axis );
+
   double getRegressionValue( int sliderValue );
   double getPcaValue( int sliderValue );
 
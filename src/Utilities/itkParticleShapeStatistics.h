@@ -28,6 +28,7 @@
 #include <string>
 #include <cstdio>
 #include "itkParticlePositionWriter.h"
+#include "itkParticleTruncatedPCA.h"
 
 /**
  * \class ParticleShapeStatistics
@@ -38,7 +39,8 @@ template <unsigned int VDimension=3>
 class ITK_EXPORT ParticleShapeStatistics
 {
 public:
-  ParticleShapeStatistics() {}
+  ParticleShapeStatistics()
+    : m_numberOfModes(0), m_useCache(false), m_distancesValid(false) {}
   ~ParticleShapeStatistics() {}
 
  /** Dimensionality of the domain of the particle system. */
@@ -50,6 +52,17 @@ public:
   /** Reloads a set of point files and recomputes some statistics. */
   int ReloadPointFiles( );
 
+  /** Enables a binary cache of the shape matrix, stored next to the
+      parameter file as <parameter file>.shapes.  The cache is reused by
+      ReadPointFiles and ReloadPointFiles as long as the list of point files
+      and their sizes and modification times are unchanged.  Files modified
+      within a couple of seconds of writing the cache are also checked by
+      content hash.  Off by default. */
+  void SetUseShapeMatrixCache(bool b)
+  { m_useCache = b; }
+  bool GetUseShapeMatrixCache() const
+  { return m_useCache; }
+
   /** Writes a text file in comma-separated format.  Suitable for reading into
       excel or R or Matlab for analysis. */
   int WriteCSVFile(const char *s);
@@ -63,6 +76,15 @@ public:
       Requires that ReadPointFiles be called first. */
   int ComputeModes();
 
+  /** Set/Get the number of leading PCA modes computed by ComputeModes.  The
+      default of 0 computes all modes from the full Gram matrix.  A positive
+      value computes only that many modes with a randomized truncated PCA,
+      which is much faster for large numbers of shapes. */
+  void SetNumberOfModes(unsigned int n)
+  { m_numberOfModes = n; }
+  unsigned int GetNumberOfModes() const
+  { return m_numberOfModes; }
+
   /** Computes the principal component loadings, or projections onto the
       principal componenent axes for each of the samples.  ComputeModes must be
       called first. */
@@ -95,6 +117,15 @@ public:
   const vnl_vector<double> &Eigenvalues() const
   { return m_eigenvalues; }
 
+  /** Returns the total variance of the shapes, i.e. the sum of all
+      eigenvalues including those of modes that were not computed. */
+  double TotalVariance() const
+  { return m_totalVariance; }
+
+  /** Returns the number of modes held in Eigenvectors()/Eigenvalues(). */
+  unsigned int NumberOfComputedModes() const
+  { return m_eigenvalues.size(); }
+
   /** Returns the mean shape. */
   const vnl_vector<double> &Mean() const
   { return m_mean; }
@@ -121,6 +152,25 @@ public:
     /** Returns the euclidean L1 norm between shape a and b */
   double L1Norm(unsigned int a, unsigned int b);
 
+  /** Computes the matrices of L1 and L2 (Euclidean) distances between all
+      pairs of shapes.  The result is cached until the point files are
+      reloaded, so repeated median or nearest neighbor queries are cheap. */
+  void ComputeDistanceMatrices();
+  const vnl_matrix<double> &L1Distances()
+  { this->ComputeDistanceMatrices(); return m_L1Distances; }
+  const vnl_matrix<double> &L2Distances()
+  { this->ComputeDistanceMatrices(); return m_L2Distances; }
+
+  /** Returns the index of the shape closest to shape a in the L2 sense, or
+      -1 if there is no other shape. */
+  int NearestShape(unsigned int a);
+
+  /** Computes an outlier score for each shape: the mean L2 distance from the
+      shape to all others, in standard deviations from the average of that
+      quantity over all shapes.  Returns -1 if there are fewer than 3
+      shapes. */
+  int ComputeOutlierScores(std::vector<double> &scores);
+
   /** Returns the component loadings */
   const vnl_matrix<double> &PCALoadings() const
   { return m_principals; }
@@ -144,6 +194,38 @@ public:
                               double &a, double &b) const;
     
 protected:
+  /** Fills m_shapes from m_pointsfiles (or the cache), reading the point
+      files in parallel. */
+  int LoadShapeMatrix();
+
+  /** Recomputes the means and m_pointsMinusMean from m_shapes. */
+  void ComputeMeans();
+
+  /** Reads all coordinates of a point file.  Returns 0 on success. */
+  static int ParseCoordinateFile(const std::string &fn, std::vector<double> &out);
+
+  /** Parses one decimal number ([+-]digits[.digits][e[+-]digits]) at p,
+      independent of the C locale, and returns the end of it, or p if there
+      is none. */
+  static const char *ParseDecimal(const char *p, double &v);
+
+  /** What the shape matrix cache records about each point file.  The hash
+      is only set (and hashed nonzero) for recently modified files. */
+  struct FileSignature
+  {
+    long mtime;
+    long size;
+    unsigned char hashed;
+    unsigned int hash;
+  };
+  static void ComputeFileSignature(const std::string &fn, FileSignature &s);
+  static unsigned int HashFile(const std::string &fn);
+
+  /** Reads m_shapes from the cache.  Returns 0 if the cache is valid for the
+      given point files. */
+  int ReadShapeMatrixCache(const std::vector<FileSignature> &signatures);
+  void WriteShapeMatrixCache(const std::vector<FileSignature> &signatures) const;
+
   unsigned int m_numSamples1;
   unsigned int m_numSamples2;
   unsigned int m_numSamples;
@@ -154,6 +236,8 @@ protected:
   vnl_matrix<double> m_pooled_covariance;
   vnl_matrix<double> m_eigenvectors;
   vnl_vector<double> m_eigenvalues;
+  double m_totalVariance;
+  unsigned int m_numberOfModes;
   vnl_vector<double> m_mean;
   vnl_vector<double> m_mean1;
   vnl_vector<double> m_mean2;
@@ -174,6 +258,13 @@ protected:
 
   // used to keep the points' files that needs to be reloaded when new updates come in.
   std::vector< std::string > m_pointsfiles; 
+
+  bool m_useCache;
+  std::string m_cacheFileName;
+
+  bool m_distancesValid;
+  vnl_matrix<double> m_L1Distances;
+  vnl_matrix<double> m_L2Distances;
 };
 
 #if ITK_TEMPLATE_EXPLICIT
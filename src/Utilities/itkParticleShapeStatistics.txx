@@ -15,6 +15,14 @@
 #ifndef __itkParticleShapeStatistics_txx
 #define __itkParticleShapeStatistics_txx
 
+#include "itksys/SystemTools.hxx"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <locale>
+#include <sstream>
+
 template <unsigned int VDimension>
 int ParticleShapeStatistics<VDimension>
 ::SimpleLinearRegression(const std::vector<double> &y,
@@ -70,38 +78,31 @@ int ParticleShapeStatistics<VDimension>
 {
   int ret = -1;
   double min_L1 = 1.0e300;
-  //  std::cout << "ID == " << ID << std::endl;
   // Compile list of indices for groupIDs == ID
   std::vector<unsigned int> set;
   for (unsigned int i = 0; i < m_groupIDs.size(); i++)
     {
-    
     if (m_groupIDs[i] == ID || ID == -32) // -32 means use both groups
       {
-      //      std::cout << i << " -> " << m_groupIDs[i] << " =? " << ID << std::endl;
       set.push_back(i); }
     }
 
+  this->ComputeDistanceMatrices();
+
   // Find min sum L1 norms
   for (unsigned int i = 0; i < set.size(); i++)
     {
     double sum = 0.0;
-    //    std::cout << "set[" << i << "] = " << set[i] << std::endl;
-    
     for (unsigned int j = 0; j < set.size(); j++)
       {
-      if (i != j) sum += this->L1Norm(set[i],set[j]);
-      // std::cout << set[j] << "\t" << this->L1Norm(set[i],set[j]) << std::endl;
+      sum += m_L1Distances(set[i], set[j]);
       }
-    //    std::cout << sum << std::endl;
     if (sum < min_L1)
       {
       min_L1 = sum;
       ret = static_cast<int>(set[i]);
       }
     }
-  //  std::cout << "min_L1 = " << min_L1 << std::endl;
-  //  std::cout << "index = " << ret << std::endl;
   return ret; // if there has been some error ret == -1
 }
 
@@ -109,6 +110,8 @@ template <unsigned int VDimension>
 double ParticleShapeStatistics<VDimension>
 ::L1Norm(unsigned int a, unsigned int b)
 {
+  if (m_distancesValid) return m_L1Distances(a, b);
+
   double norm = 0.0;
   for (unsigned int i = 0; i < m_shapes.rows(); i++)
     {
@@ -117,6 +120,152 @@ double ParticleShapeStatistics<VDimension>
   return norm;
 }
 
+template <unsigned int VDimension>
+void ParticleShapeStatistics<VDimension>
+::ComputeDistanceMatrices()
+{
+  if (m_distancesValid) return;
+
+  const unsigned int n = m_numSamples;
+  const unsigned int dims = m_numDimensions;
+
+  // One shape per row, so that the inner loops run over contiguous memory
+  // and vectorize.
+  const vnl_matrix<double> shapes = m_shapes.transpose();
+
+  m_L1Distances.set_size(n, n);
+  m_L2Distances.set_size(n, n);
+  m_L1Distances.fill(0.0);
+  m_L2Distances.fill(0.0);
+
+  // Tiles of shapes x coordinates are sized to stay in cache.  Only tiles on
+  // or above the diagonal are computed; the matrices are symmetric.
+  const unsigned int shapeBlock = 16;
+  const unsigned int dimBlock = 2048;
+  const unsigned int numBlocks = (n + shapeBlock - 1) / shapeBlock;
+
+  std::vector< std::pair<unsigned int, unsigned int> > tiles;
+  for (unsigned int bi = 0; bi < numBlocks; bi++)
+    {
+    for (unsigned int bj = bi; bj < numBlocks; bj++)
+      {
+      tiles.push_back(std::make_pair(bi, bj));
+      }
+    }
+
+#pragma omp parallel for schedule(dynamic)
+  for (int t = 0; t < static_cast<int>(tiles.size()); t++)
+    {
+    const unsigned int i0 = tiles[t].first * shapeBlock;
+    const unsigned int j0 = tiles[t].second * shapeBlock;
+    const unsigned int i1 = std::min(i0 + shapeBlock, n);
+    const unsigned int j1 = std::min(j0 + shapeBlock, n);
+
+    double l1[shapeBlock][shapeBlock];
+    double l2[shapeBlock][shapeBlock];
+    for (unsigned int i = 0; i < shapeBlock; i++)
+      {
+      for (unsigned int j = 0; j < shapeBlock; j++)
+        {
+        l1[i][j] = 0.0;
+        l2[i][j] = 0.0;
+        }
+      }
+
+    for (unsigned int d0 = 0; d0 < dims; d0 += dimBlock)
+      {
+      const unsigned int d1 = std::min(d0 + dimBlock, dims);
+      for (unsigned int i = i0; i < i1; i++)
+        {
+        const double *a = shapes[i];
+        for (unsigned int j = std::max(j0, i + 1); j < j1; j++)
+          {
+          const double *b = shapes[j];
+          double s1 = 0.0;
+          double s2 = 0.0;
+          for (unsigned int d = d0; d < d1; d++)
+            {
+            const double diff = a[d] - b[d];
+            s1 += fabs(diff);
+            s2 += diff * diff;
+            }
+          l1[i - i0][j - j0] += s1;
+          l2[i - i0][j - j0] += s2;
+          }
+        }
+      }
+
+    // Tiles never overlap, so the results can be written without locking.
+    for (unsigned int i = i0; i < i1; i++)
+      {
+      for (unsigned int j = std::max(j0, i + 1); j < j1; j++)
+        {
+        const double dist = sqrt(l2[i - i0][j - j0]);
+        m_L1Distances(i, j) = m_L1Distances(j, i) = l1[i - i0][j - j0];
+        m_L2Distances(i, j) = m_L2Distances(j, i) = dist;
+        }
+      }
+    }
+
+  m_distancesValid = true;
+}
+
+template <unsigned int VDimension>
+int ParticleShapeStatistics<VDimension>
+::NearestShape(unsigned int a)
+{
+  this->ComputeDistanceMatrices();
+
+  int ret = -1;
+  double min_L2 = 1.0e300;
+  for (unsigned int j = 0; j < m_numSamples; j++)
+    {
+    if (j != a && m_L2Distances(a, j) < min_L2)
+      {
+      min_L2 = m_L2Distances(a, j);
+      ret = static_cast<int>(j);
+      }
+    }
+  return ret;
+}
+
+template <unsigned int VDimension>
+int ParticleShapeStatistics<VDimension>
+::ComputeOutlierScores(std::vector<double> &scores)
+{
+  if (m_numSamples < 3) return -1;
+  this->ComputeDistanceMatrices();
+
+  // Mean Euclidean distance from each shape to all others ...
+  std::vector<double> meanDist(m_numSamples, 0.0);
+  double mean = 0.0;
+  for (unsigned int i = 0; i < m_numSamples; i++)
+    {
+    for (unsigned int j = 0; j < m_numSamples; j++)
+      {
+      meanDist[i] += m_L2Distances(i, j);
+      }
+    meanDist[i] /= static_cast<double>(m_numSamples - 1);
+    mean += meanDist[i];
+    }
+  mean /= static_cast<double>(m_numSamples);
+
+  // ... expressed in standard deviations from the average over all shapes.
+  double var = 0.0;
+  for (unsigned int i = 0; i < m_numSamples; i++)
+    {
+    var += (meanDist[i] - mean) * (meanDist[i] - mean);
+    }
+  const double stddev = sqrt(var / static_cast<double>(m_numSamples - 1)) + 1.0e-15;
+
+  scores.resize(m_numSamples);
+  for (unsigned int i = 0; i < m_numSamples; i++)
+    {
+    scores[i] = (meanDist[i] - mean) / stddev;
+    }
+  return 0;
+}
+
 
 template <unsigned int VDimension>
 int ParticleShapeStatistics<VDimension>
@@ -139,8 +288,6 @@ int ParticleShapeStatistics<VDimension>
     while (inputsBuffer >> ptFileName)
     {
       pointsfiles.push_back(ptFileName);
-
-	  m_pointsfiles.push_back( ptFileName ); // Keep the points' files to reload.
     }
     inputsBuffer.clear();
     inputsBuffer.str("");
@@ -159,13 +306,25 @@ int ParticleShapeStatistics<VDimension>
 	  }
   } else test.close();
   // Read the point files.  Assumes all the same size.
-  typename itk::ParticlePositionReader<VDimension>::Pointer reader1 = itk::ParticlePositionReader<VDimension>::New();
-  reader1->SetFileName( pointsfiles[0].c_str() );
-  reader1->Update();
+  m_pointsfiles = pointsfiles; // Keep the points' files to reload.
+  m_cacheFileName = pname + ".shapes";
+
+  std::vector<double> first;
+  if (ParseCoordinateFile(pointsfiles[0], first) != 0)
+    {
+    std::cerr << "Could not read point file " << pointsfiles[0] << std::endl;
+    return 1;
+    }
   m_numSamples1 = 0;
   m_numSamples2 = 0;
   m_numSamples = pointsfiles.size() / m_domainsPerShape;
-  m_numDimensions = reader1->GetOutput().size() * VDimension * m_domainsPerShape;
+  if (pointsfiles.size() % m_domainsPerShape != 0)
+    {
+    std::cerr << "Ignoring the last " << pointsfiles.size() % m_domainsPerShape
+              << " point files, which do not make up a whole shape of "
+              << m_domainsPerShape << " domains" << std::endl;
+    }
+  m_numDimensions = first.size() * m_domainsPerShape;
 
   // Read the group ids
   int tmpID;
@@ -207,189 +366,395 @@ int ParticleShapeStatistics<VDimension>
   m_pointsMinusMean.set_size(m_numDimensions, m_numSamples);
   m_shapes.set_size(m_numDimensions, m_numSamples);
   m_mean.set_size(m_numDimensions);
-  m_mean.fill(0);
-
   m_mean1.set_size(m_numDimensions);
-  m_mean1.fill(0);
   m_mean2.set_size(m_numDimensions);
-  m_mean2.fill(0);
 
-  // Compile the "meta shapes"
-  for (unsigned int i = 0; i < m_numSamples; i++) 
+  if (this->LoadShapeMatrix() != 0) return 1;
+  this->ComputeMeans();
+
+  return 0;
+} // end ReadPointFiles
+
+
+/** Reloads a set of point files and recomputes some statistics. */
+
+template <unsigned int VDimension>
+int ParticleShapeStatistics<VDimension>
+::ReloadPointFiles( )
+{
+  if (this->LoadShapeMatrix() != 0) return 1;
+  this->ComputeMeans();
+
+  return 0;
+} // end ReloadPointFiles
+
+
+template <unsigned int VDimension>
+int ParticleShapeStatistics<VDimension>
+::ParseCoordinateFile(const std::string &fn, std::vector<double> &out)
+{
+  out.clear();
+
+  // Slurp the whole file and parse it in memory.  This is several times
+  // faster than extracting each coordinate with operator>>.
+  FILE *fp = fopen(fn.c_str(), "rb");
+  if (fp == NULL) return -1;
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  if (len < 0)
+    {
+    fclose(fp);
+    return -1;
+    }
+  fseek(fp, 0, SEEK_SET);
+  std::vector<char> buffer(len + 1);
+  size_t nread = fread(&buffer[0], 1, len, fp);
+  fclose(fp);
+  buffer[nread] = '\0';
+
+  const char *p = &buffer[0];
+  for (;;)
     {
-    for (unsigned int k = 0; k < m_domainsPerShape; k++) 
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'
+           || *p == '\f' || *p == '\v') p++;
+    double v;
+    const char *end = ParseDecimal(p, v);
+    if (end == p) break;
+    out.push_back(v);
+    p = end;
+    }
+
+  // Drop a trailing partial point, as ParticlePositionReader does.
+  out.resize(out.size() - (out.size() % VDimension));
+  return 0;
+}
+
+
+template <unsigned int VDimension>
+const char *ParticleShapeStatistics<VDimension>
+::ParseDecimal(const char *p, double &v)
+{
+  // strtod follows LC_NUMERIC, which Qt sets from the environment, and also
+  // accepts nan, inf and hex floats, so the syntax is checked here instead.
+  const char *q = p;
+  bool negative = false;
+  if (*q == '+' || *q == '-') negative = (*q++ == '-');
+
+  // Up to 15 significant digits are exact in a double.  Longer mantissas
+  // are counted, and left to the slow path below.
+  double mantissa = 0.0;
+  int digits = 0;
+  int exponent = 0;
+  bool any = false;
+  for (; *q >= '0' && *q <= '9'; q++)
+    {
+    any = true;
+    if (mantissa > 0.0 || *q != '0')
       {
-      // read file
-      typename itk::ParticlePositionReader<VDimension>::Pointer reader
-        = itk::ParticlePositionReader<VDimension>::New();
-      reader->SetFileName( pointsfiles[i*m_domainsPerShape + k].c_str() );
-      reader->Update();
-      unsigned int q = reader->GetOutput().size();  
-      for (unsigned int j = 0; j < q; j++)
+      if (digits < 15) mantissa = mantissa * 10.0 + (*q - '0');
+      digits++;
+      }
+    }
+  if (*q == '.')
+    {
+    for (q++; *q >= '0' && *q <= '9'; q++)
+      {
+      any = true;
+      if (mantissa > 0.0 || *q != '0')
         {
-        m_mean(q*k*VDimension +(VDimension*j)+0) += m_pointsMinusMean(q*k*VDimension +(VDimension*j)+0, i)
-          = reader->GetOutput()[j][0];
-        m_mean(q*k*VDimension +(VDimension*j)+1) += m_pointsMinusMean(q*k*VDimension +(VDimension*j)+1, i)
-          = reader->GetOutput()[j][1];
-        m_mean(q*k*VDimension +(VDimension*j)+2) += m_pointsMinusMean(q*k*VDimension +(VDimension*j)+2, i)
-          = reader->GetOutput()[j][2];
-
-        if (m_groupIDs[i] == 1)
-          {
-          m_mean1(q*k*VDimension +(VDimension*j)+0) += reader->GetOutput()[j][0];
-          m_mean1(q*k*VDimension +(VDimension*j)+1) += reader->GetOutput()[j][1];
-          m_mean1(q*k*VDimension +(VDimension*j)+2) += reader->GetOutput()[j][2];
-          }
-        else
-          {
-          m_mean2(q*k*VDimension +(VDimension*j)+0) += reader->GetOutput()[j][0];
-          m_mean2(q*k*VDimension +(VDimension*j)+1) += reader->GetOutput()[j][1];
-          m_mean2(q*k*VDimension +(VDimension*j)+2) += reader->GetOutput()[j][2];
-          }
-        
-        m_shapes(q*k*VDimension +(VDimension*j)+0,i) = reader->GetOutput()[j][0];
-        m_shapes(q*k*VDimension +(VDimension*j)+1,i) = reader->GetOutput()[j][1];
-        m_shapes(q*k*VDimension +(VDimension*j)+2,i) = reader->GetOutput()[j][2];
-                
+        if (digits < 15) mantissa = mantissa * 10.0 + (*q - '0');
+        digits++;
         }
+      exponent--;
       }
     }
+  if (any == false) return p;
 
-  for (unsigned int i = 0; i < m_numDimensions; i++)
+  if (*q == 'e' || *q == 'E')
     {
-    m_mean(i)  /= (double)m_numSamples;
-    m_mean1(i) /= (double)m_numSamples1;
-    m_mean2(i) /= (double)m_numSamples2;
-    }
-  
-  for (unsigned int j = 0; j < m_numDimensions; j++)
-    {
-    for (unsigned int i = 0; i < m_numSamples; i++)
+    const char *e = q + 1;
+    bool eneg = false;
+    if (*e == '+' || *e == '-') eneg = (*e++ == '-');
+    if (*e >= '0' && *e <= '9')
       {
-      m_pointsMinusMean(j, i) -= m_mean(j);
+      int x = 0;
+      for (; *e >= '0' && *e <= '9'; e++)
+        {
+        if (x < 10000) x = x * 10 + (*e - '0');
+        }
+      exponent += eneg ? -x : x;
+      q = e;
       }
     }
 
-  m_groupdiff = m_mean2 - m_mean1;
-  
-  return 0;
-} // end ReadPointFiles
+  // A mantissa and power of ten that are both exact give a correctly rounded
+  // result.  Anything else goes through a stream in the classic locale.
+  static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+  if (digits <= 15 && exponent >= -22 && exponent <= 22)
+    {
+    v = exponent < 0 ? mantissa / powers[-exponent] : mantissa * powers[exponent];
+    if (negative) v = -v;
+    return q;
+    }
 
+  std::istringstream in(std::string(p, q));
+  in.imbue(std::locale::classic());
+  if (!(in >> v)) return p;
+  return q;
+}
 
-/** Reloads a set of point files and recomputes some statistics. */
 
 template <unsigned int VDimension>
 int ParticleShapeStatistics<VDimension>
-::ReloadPointFiles( )
+::LoadShapeMatrix()
 {
-  
-  m_mean.fill(0);
-  m_mean1.fill(0);
-  m_mean2.fill(0);
+  // Trailing files that do not make up a whole shape are ignored.
+  const unsigned int numFiles = m_numSamples * m_domainsPerShape;
+  const unsigned int coordsPerFile = m_numDimensions / m_domainsPerShape;
+
+  m_shapes.set_size(m_numDimensions, m_numSamples);
 
-  // Compile the "meta shapes"
-  for (unsigned int i = 0; i < m_numSamples; i++) 
+  std::vector<FileSignature> signatures;
+  if (m_useCache)
     {
-    for (unsigned int k = 0; k < m_domainsPerShape; k++) 
+    signatures.resize(numFiles);
+    for (unsigned int f = 0; f < numFiles; f++)
       {
-      // read file
-      typename itk::ParticlePositionReader<VDimension>::Pointer reader
-        = itk::ParticlePositionReader<VDimension>::New();
-      reader->SetFileName( m_pointsfiles[i*m_domainsPerShape + k].c_str() );
-      reader->Update();
-      unsigned int q = reader->GetOutput().size();  
-      for (unsigned int j = 0; j < q; j++)
-        {
-        m_mean(q*k*VDimension +(VDimension*j)+0) += m_pointsMinusMean(q*k*VDimension +(VDimension*j)+0, i)
-          = reader->GetOutput()[j][0];
-        m_mean(q*k*VDimension +(VDimension*j)+1) += m_pointsMinusMean(q*k*VDimension +(VDimension*j)+1, i)
-          = reader->GetOutput()[j][1];
-        m_mean(q*k*VDimension +(VDimension*j)+2) += m_pointsMinusMean(q*k*VDimension +(VDimension*j)+2, i)
-          = reader->GetOutput()[j][2];
-
-        if (m_groupIDs[i] == 1)
-          {
-          m_mean1(q*k*VDimension +(VDimension*j)+0) += reader->GetOutput()[j][0];
-          m_mean1(q*k*VDimension +(VDimension*j)+1) += reader->GetOutput()[j][1];
-          m_mean1(q*k*VDimension +(VDimension*j)+2) += reader->GetOutput()[j][2];
-          }
-        else
-          {
-          m_mean2(q*k*VDimension +(VDimension*j)+0) += reader->GetOutput()[j][0];
-          m_mean2(q*k*VDimension +(VDimension*j)+1) += reader->GetOutput()[j][1];
-          m_mean2(q*k*VDimension +(VDimension*j)+2) += reader->GetOutput()[j][2];
-          }
-        
-        m_shapes(q*k*VDimension +(VDimension*j)+0,i) = reader->GetOutput()[j][0];
-        m_shapes(q*k*VDimension +(VDimension*j)+1,i) = reader->GetOutput()[j][1];
-        m_shapes(q*k*VDimension +(VDimension*j)+2,i) = reader->GetOutput()[j][2];
-                
-        }
+      ComputeFileSignature(m_pointsfiles[f], signatures[f]);
+      }
+    if (this->ReadShapeMatrixCache(signatures) == 0)
+      {
+      m_distancesValid = false;
+      return 0;
       }
     }
 
-  for (unsigned int i = 0; i < m_numDimensions; i++)
+  // Each file fills part of one column of m_shapes.
+  int failed = 0;
+#pragma omp parallel
+  {
+  std::vector<double> coords;
+#pragma omp for schedule(dynamic)
+  for (int f = 0; f < static_cast<int>(numFiles); f++)
     {
-    m_mean(i)  /= (double)m_numSamples;
-    m_mean1(i) /= (double)m_numSamples1;
-    m_mean2(i) /= (double)m_numSamples2;
+    if (ParseCoordinateFile(m_pointsfiles[f], coords) != 0
+        || coords.size() != coordsPerFile)
+      {
+#pragma omp critical
+      {
+      std::cerr << "Could not read " << coordsPerFile / VDimension
+                << " points from " << m_pointsfiles[f] << std::endl;
+      failed = 1;
+      }
+      continue;
+      }
+    const unsigned int i = f / m_domainsPerShape;
+    const unsigned int row = (f % m_domainsPerShape) * coordsPerFile;
+    for (unsigned int j = 0; j < coordsPerFile; j++)
+      {
+      m_shapes(row + j, i) = coords[j];
+      }
     }
-  
-  for (unsigned int j = 0; j < m_numDimensions; j++)
+  }
+
+  if (failed) return 1;
+
+  m_distancesValid = false;
+  if (m_useCache) this->WriteShapeMatrixCache(signatures);
+  return 0;
+}
+
+
+template <unsigned int VDimension>
+void ParticleShapeStatistics<VDimension>
+::ComputeMeans()
+{
+  const double n  = static_cast<double>(m_numSamples);
+  const double n1 = static_cast<double>(m_numSamples1);
+  const double n2 = static_cast<double>(m_numSamples2);
+
+#pragma omp parallel for
+  for (int j = 0; j < static_cast<int>(m_numDimensions); j++)
     {
+    const double *row = m_shapes[j];
+    double total = 0.0;
+    double total1 = 0.0;
+    double total2 = 0.0;
+    for (unsigned int i = 0; i < m_numSamples; i++)
+      {
+      total += row[i];
+      if (m_groupIDs[i] == 1) total1 += row[i];
+      else total2 += row[i];
+      }
+    m_mean(j)  = total / n;
+    m_mean1(j) = total1 / n1;
+    m_mean2(j) = total2 / n2;
+
+    double *pmm = m_pointsMinusMean[j];
     for (unsigned int i = 0; i < m_numSamples; i++)
       {
-      m_pointsMinusMean(j, i) -= m_mean(j);
+      pmm[i] = row[i] - m_mean(j);
       }
     }
 
   m_groupdiff = m_mean2 - m_mean1;
-  
-  return 0;
-} // end ReloadPointFiles
+}
 
 
 template <unsigned int VDimension>
-int ParticleShapeStatistics<VDimension>::ComputeModes()
+void ParticleShapeStatistics<VDimension>
+::ComputeFileSignature(const std::string &fn, FileSignature &s)
 {
-  // COMPUTE MODES
-  vnl_matrix<double> A = m_pointsMinusMean.transpose()
-    * m_pointsMinusMean * (1.0/((double)(m_numSamples-1)));
+  s.mtime = itksys::SystemTools::ModifiedTime(fn.c_str());
+  s.size = static_cast<long>(itksys::SystemTools::FileLength(fn.c_str()));
+  s.hashed = 0;
+  s.hash = 0;
+}
 
-  vnl_symmetric_eigensystem<double> symEigen(A);
-  m_eigenvectors = m_pointsMinusMean * symEigen.V;
-  m_eigenvalues.set_size(m_numSamples);
 
-  // normalize those eigenvectors
-  for (unsigned int i = 0; i < m_numSamples; i++)
+template <unsigned int VDimension>
+unsigned int ParticleShapeStatistics<VDimension>
+::HashFile(const std::string &fn)
+{
+  // 32-bit FNV-1a of the file contents.
+  unsigned int hash = 2166136261u;
+  FILE *fp = fopen(fn.c_str(), "rb");
+  if (fp == NULL) return hash;
+  unsigned char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0)
     {
-    double total = 0.0f;
-    for (unsigned int j = 0; j < m_numDimensions; j++)
+    for (size_t i = 0; i < n; i++)
       {
-      total += m_eigenvectors(j, i) * m_eigenvectors(j, i);
+      hash = (hash ^ buffer[i]) * 16777619u;
       }
-    total = sqrt(total);
-    
-    for (unsigned int j = 0; j < m_numDimensions; j++)
+    }
+  fclose(fp);
+  return hash;
+}
+
+
+template <unsigned int VDimension>
+int ParticleShapeStatistics<VDimension>
+::ReadShapeMatrixCache(const std::vector<FileSignature> &signatures)
+{
+  std::ifstream in(m_cacheFileName.c_str(), std::ios::binary);
+  if (!in) return -1;
+
+  char magic[8];
+  unsigned int header[3];
+  long written;
+  in.read(magic, 8);
+  in.read(reinterpret_cast<char *>(header), sizeof(header));
+  in.read(reinterpret_cast<char *>(&written), sizeof(written));
+  if (!in || strncmp(magic, "SWSHAPE3", 8) != 0) return -1;
+  if (header[0] != signatures.size() || header[1] != m_numSamples
+      || header[2] != m_numDimensions) return -1;
+
+  std::vector<unsigned int> hashed;
+  std::vector<unsigned int> hashes;
+  for (unsigned int f = 0; f < signatures.size(); f++)
+    {
+    FileSignature s;
+    unsigned int len;
+    in.read(reinterpret_cast<char *>(&s.mtime), sizeof(s.mtime));
+    in.read(reinterpret_cast<char *>(&s.size), sizeof(s.size));
+    in.read(reinterpret_cast<char *>(&s.hashed), sizeof(s.hashed));
+    in.read(reinterpret_cast<char *>(&s.hash), sizeof(s.hash));
+    in.read(reinterpret_cast<char *>(&len), sizeof(len));
+    if (!in || s.mtime != signatures[f].mtime || s.size != signatures[f].size
+        || len != m_pointsfiles[f].size()) return -1;
+    std::string name(len, ' ');
+    if (len > 0) in.read(&name[0], len);
+    if (!in || name != m_pointsfiles[f]) return -1;
+    if (s.hashed)
       {
-      m_eigenvectors(j, i) = m_eigenvectors(j, i) / (total + 1.0e-15);
+      hashed.push_back(f);
+      hashes.push_back(s.hash);
       }
+    }
 
-    m_eigenvalues(i) = symEigen.D(i, i);
+  // Files modified within the timestamp resolution of the cache could have
+  // changed again afterwards without a new time, so their contents decide.
+  for (unsigned int h = 0; h < hashed.size(); h++)
+    {
+    if (HashFile(m_pointsfiles[hashed[h]]) != hashes[h]) return -1;
     }
-  
-  float sum = 0.0;
-  for (unsigned int n = 0; n < m_numSamples; n++)
+
+  in.read(reinterpret_cast<char *>(m_shapes.data_block()),
+          sizeof(double) * m_numSamples * m_numDimensions);
+  if (!in) return -1;
+  return 0;
+}
+
+
+template <unsigned int VDimension>
+void ParticleShapeStatistics<VDimension>
+::WriteShapeMatrixCache(const std::vector<FileSignature> &signatures) const
+{
+  std::ofstream out(m_cacheFileName.c_str(), std::ios::binary);
+  if (!out) return; // the cache is optional, e.g. for read-only directories
+
+  unsigned int header[3];
+  header[0] = signatures.size();
+  header[1] = m_numSamples;
+  header[2] = m_numDimensions;
+  long written = static_cast<long>(time(NULL));
+  out.write("SWSHAPE3", 8);
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(&written), sizeof(written));
+
+  for (unsigned int f = 0; f < signatures.size(); f++)
     {
-    sum += m_eigenvalues[(m_numSamples-1)-n];
+    // Modification times only resolve to a second (two on some file
+    // systems), so a file modified that recently, or in the future, could
+    // still change without a new time.  Only such files are hashed.
+    FileSignature s = signatures[f];
+    if (s.mtime + 2 >= written)
+      {
+      s.hashed = 1;
+      s.hash = HashFile(m_pointsfiles[f]);
+      }
+    unsigned int len = m_pointsfiles[f].size();
+    out.write(reinterpret_cast<const char *>(&s.mtime), sizeof(s.mtime));
+    out.write(reinterpret_cast<const char *>(&s.size), sizeof(s.size));
+    out.write(reinterpret_cast<const char *>(&s.hashed), sizeof(s.hashed));
+    out.write(reinterpret_cast<const char *>(&s.hash), sizeof(s.hash));
+    out.write(reinterpret_cast<const char *>(&len), sizeof(len));
+    out.write(m_pointsfiles[f].c_str(), len);
     }
 
+  out.write(reinterpret_cast<const char *>(m_shapes.data_block()),
+            sizeof(double) * m_numSamples * m_numDimensions);
+}
+
+
+template <unsigned int VDimension>
+int ParticleShapeStatistics<VDimension>::ComputeModes()
+{
+  // COMPUTE MODES
+  itk::ParticleTruncatedPCA<double> pca;
+  pca.SetNumberOfModes(m_numberOfModes);
+  pca.Compute(m_pointsMinusMean);
+
+  m_eigenvectors = pca.GetEigenvectors();
+  m_eigenvalues  = pca.GetEigenvalues();
+  m_totalVariance = pca.GetTotalVariance();
+
+  // Percent variance is relative to the total variance, which is known even
+  // if only the leading modes were computed.
+  const unsigned int numModes = m_eigenvalues.size();
+  const double sum = m_totalVariance;
+
   m_top95 = 0;
-  float sum2 = 0.0;
+  m_percentVarByMode.clear();
+  double sum2 = 0.0;
   bool found= false;
-  for (unsigned int n = 0; n < m_numSamples; n++)
+  for (unsigned int n = 0; n < numModes; n++)
     {
-    sum2 += m_eigenvalues[(m_numSamples-1)-n];
+    sum2 += m_eigenvalues[(numModes-1)-n];
     m_percentVarByMode.push_back(sum2 / sum);
 
     if ((sum2 / sum) >= 0.95 && found==false)
@@ -406,17 +771,18 @@ template <unsigned int VDimension>
 int ParticleShapeStatistics<VDimension>::PrincipalComponentProjections()
 {
   // Now print the projection of each shape
-  m_principals.set_size(m_numSamples, m_numSamples);
-  
-  for (unsigned int n = 0; n < m_numSamples; n++)
+  const unsigned int numModes = m_eigenvalues.size();
+  vnl_matrix<double> projections;
+  itk::ParticleTruncatedPCA<double>::TransposeMultiply(m_pointsMinusMean,
+                                                       m_eigenvectors, projections);
+
+  // each row is a sample, columns index PC
+  m_principals.set_size(m_numSamples, numModes);
+  for (unsigned int n = 0; n < numModes; n++)
     {
     for (unsigned int s = 0; s < m_numSamples; s++)
       {
-      double p = dot_product<double>(m_eigenvectors.get_column((m_numSamples-1)-n),
-                                     m_pointsMinusMean.get_column(s));
-
-      m_principals(s, n) = p; // each row is a sample, columns index PC
-
+      m_principals(s, n) = projections(s, (numModes-1)-n);
       }
     }
 
@@ -426,6 +792,9 @@ int ParticleShapeStatistics<VDimension>::PrincipalComponentProjections()
 template <unsigned int VDimension>
 int ParticleShapeStatistics<VDimension>::FisherLinearDiscriminant(unsigned int numModes)
 {
+  const unsigned int numComputedModes = m_eigenvalues.size();
+  if (numModes > numComputedModes) numModes = numComputedModes;
+
   m_projectedMean1.set_size(numModes);
   m_projectedMean2.set_size(numModes);
   m_projectedMean1.fill(0.0);
@@ -442,7 +811,7 @@ int ParticleShapeStatistics<VDimension>::FisherLinearDiscriminant(unsigned int n
     s2 = 0;
     for (unsigned int s = 0; s < m_numSamples; s++)
       {
-      double p = dot_product<double>(m_eigenvectors.get_column((m_numSamples-1)-n),
+      double p = dot_product<double>(m_eigenvectors.get_column((numComputedModes-1)-n),
                                      m_pointsMinusMean.get_column(s));
       
       if (m_groupIDs[s] == 1)
@@ -496,8 +865,8 @@ int ParticleShapeStatistics<VDimension>::FisherLinearDiscriminant(unsigned int n
    double mag = mdiff.magnitude();
    m_fishersLD = (w * mag)/ sqrt(dot_product<double>(w,w));
 
-   vnl_vector<double> wext(m_numSamples);
-   for (unsigned int i = 0; i < m_numSamples; i++)
+   vnl_vector<double> wext(numComputedModes);
+   for (unsigned int i = 0; i < numComputedModes; i++)
      {
      if (i >= numModes) wext[i] = 0.0;
      else wext[i] = m_fishersLD[i];// * m_eigenvalues[(m_numSamples - 1) - i];
@@ -544,7 +913,7 @@ int ParticleShapeStatistics<VDimension>::WriteCSVFile2(const char *fn)
   outfile.open(fn);
 
   outfile << "Group";
-  for (unsigned int i = 0; i < m_numSamples; i++)
+  for (unsigned int i = 0; i < m_principals.cols(); i++)
     {
     outfile << ",P" << i;
     }
@@ -553,7 +922,7 @@ int ParticleShapeStatistics<VDimension>::WriteCSVFile2(const char *fn)
   for (unsigned int r = 0; r < m_numSamples; r++)
     {
     outfile << m_groupIDs[r];
-    for (unsigned int c = 0; c < m_numSamples; c++)
+    for (unsigned int c = 0; c < m_principals.cols(); c++)
       {
       outfile << "," << m_principals(r,c);
       }
@@ -573,7 +942,7 @@ int ParticleShapeStatistics<VDimension>::WriteCSVFile(const char *fn)
   outfile.open(fn);
 
   outfile << "Group,LDA,PV";
-  for (unsigned int i = 0; i < m_numSamples; i++)
+  for (unsigned int i = 0; i < m_principals.cols(); i++)
     {
     outfile << ",P" << i;
     }
@@ -583,8 +952,8 @@ int ParticleShapeStatistics<VDimension>::WriteCSVFile(const char *fn)
     {
     outfile << m_groupIDs[r] << ",";
     outfile << m_fishersProjection[r] << ",";
-    outfile << m_percentVarByMode[r];
-    for (unsigned int c = 0; c < m_numSamples; c++)
+    if (r < m_percentVarByMode.size()) outfile << m_percentVarByMode[r];
+    for (unsigned int c = 0; c < m_principals.cols(); c++)
       {
       outfile << "," << m_principals(r,c);
       }